@@ -24,12 +24,35 @@
 
 #pragma once
 
+#include <CrashLog.h>
+#include <MeshRing.h>
+#include <QuantileSketch.h>
+#include <StateMachine.h>
 #include <StatusLED.h>
+#include <SyncClock.h>
 #include <WiFiHandler.h>
 
+#include <bell/BellBeacon.h>
 #include <bell/BellCFG.h>
 #include <bell/RingReceiver.h>
 #include <bell/Buzzer.h>
+#include <bell/DoorAP.h>
+#include <bell/MetricsServer.h>
+#include <bell/PreRing.h>
+#include <bell/RingRelay.h>
+
+/**
+ * @brief Trace of a ring, joining the timings of the door and the bell
+ * 
+ * See RING_TLV_TRACE in ring_msg.h.
+ */
+struct ring_trace_join_t {
+	ring_trace_t door;	///< Trace context and phase timings of the door
+	uint32_t parse_us;	///< Packet arrived -> ring message parsed
+	uint32_t queue_us;	///< Parsed -> picked up by the main loop
+	uint32_t note_us;	///< Picked up -> first note played (includes a scheduled start)
+	uint32_t n;		///< Rings traced since boot
+};
 
 /**
  * @brief The Main Bell class
@@ -51,29 +74,127 @@ class Bell {
 		CONNECTED,	///< Connected to WiFi
 		RINGING,	///< Ringing (Ring message received)
 		ERROR,		///< Error occured
-		ERROR_HANDLING	///< Error being handled
+		ERROR_HANDLING,	///< Error being handled
+		N_BELL_STATES
 	};
 
+	typedef StateMachine<Bell, bell_state, N_BELL_STATES> bell_sm_t;
+
+	/// State table, see StateMachine.h
+	static const bell_sm_t::state_t states[N_BELL_STATES];
+
 	// Possible errors
 	enum error_type {
 		UNINITIALIZED,	///< Class only initialized with default constructor
 		CFG_INVALID	///< Configuration invalid
 	};
 
+	/// Paths rings are received on
+	enum ring_path {
+		PATH_TCP,	///< Ring message from the door or a relaying bell (See RingReceiver.h)
+		PATH_MESH	///< Ring frame over ESP-NOW (See MeshRing.h)
+	};
+
 	BellCFG cfg;
 
 	StatusLED led;
 	WiFiHandler wifi_handler;
-	bell_state state;
+	bell_sm_t sm;
 	error_type err;
 	RingReceiver *ring_receiver;
 	Buzzer buzzer;
+	BellBeacon beacon;
+	DoorAP door_ap;
+	RingRelay relay;
+	PreRing pre_ring;
+
+	bool speculative = false;	///< Ringing on a pre-ring, awaiting the ring message
+	Deadline prering_deadline;
+	sched_task_t prering_task;
+
+	ring_path last_path = PATH_TCP;
+	bool last_has_seq = false;
+	uint16_t last_seq;		///< Press counter of the last ring (See MeshRing.h)
+	Deadline dedup_deadline;	///< Until when a ring over the other path is considered a duplicate
+	unsigned long ring_us = 0;	///< Reception time of the last ring in microseconds
+	unsigned long pick_us = 0;	///< Time the last ring was picked up by the main loop in microseconds
+	ring_trace_join_t joined = {};	///< Trace of the last ring that carried a trace context
+
+	bool start_pending = false;	///< Ring tone scheduled, but not yet started (See SyncClock.h)
+	ring_class start_class;
+	uint32_t start_at;
+	sched_task_t start_task;
+
+	uint32_t ring_latency_us = 0;
+	uint32_t ring_latency_max_us = 0;
+	quantile_sketch_t ring_sketch = {};	///< Reception to first note in microseconds
 
 	/**
 	 * @brief Prints the boot message
 	 */
 	void bootMSG();
 
+	/**
+	 * @brief Registers the metrics of the bell and its components (See MetricsServer.h)
+	 */
+	void register_metrics();
+
+	/**
+	 * @brief Metric callback, reads the WiFi reconnects
+	 * @param arg Pointer to the WiFiHandler object
+	 */
+	static uint32_t wifi_reconnects(void *arg);
+
+	/**
+	 * @brief Metric callback, reads the signed clock offset to the sync master
+	 * @param arg Unused
+	 */
+	static uint32_t sync_offset(void *arg);
+
+	/**
+	 * @brief Formats a crash record as metric labels
+	 * @returns false If rec is NULL
+	 */
+	static bool crash_labels(const crash_record_t *rec, char *buf, size_t len);
+
+	/**
+	 * @brief Metric callback, formats the last crash of the bell
+	 */
+	static bool own_crash_labels(char *buf, size_t len, void *arg);
+
+	/**
+	 * @brief Metric callback, formats the last crash reported by the door
+	 * @param arg Pointer to the RingReceiver
+	 */
+	static bool door_crash_labels(char *buf, size_t len, void *arg);
+
+	/**
+	 * @brief Metric callback, formats the trace of the last ring
+	 * @param arg Pointer to the ring_trace_join_t
+	 */
+	static bool trace_labels(char *buf, size_t len, void *arg);
+
+	/**
+	 * @brief Joins the trace context of the door with the timings of the bell
+	 * 
+	 * Called once the first note of a ring has been played, ie. only
+	 * if the ring started a ring tone, as firstNoteAt() would otherwise
+	 * precede the ring. Rings without a trace context (ie. over ESP-NOW
+	 * or from a door that doesn't trace) are ignored.
+	 */
+	void join_trace();
+
+	/**
+	 * @brief Relays a received ring to the other bells (See RingRelay::send())
+	 * 
+	 * Passes on the press counter and, if the ring came from the door,
+	 * its trace context.
+	 * 
+	 * @param cls The ring class
+	 * @param start_at The scheduled start of the ring tone (NULL = none)
+	 */
+	void relay_ring(ring_class cls, const uint32_t *start_at);
+
 	/**
 	 * @brief Entry point of the state machine
 	 * 
@@ -108,7 +229,8 @@ class Bell {
 	 * The connecting() function handles the CONNECTING state.
 	 * The CONNECTING state keeps the LED blinking until the
 	 * WiFiHandler has successfully connected to the WiFi network.
-	 * Once connected, the state machine transitions to the CONNECTED
+	 * Once connected, the bell announces itself to the door (See
+	 * BellBeacon.h) and the state machine transitions to the CONNECTED
 	 * state.
 	 * 
 	 * The CONNECTING state is entered after the DISCONNECTED state.
@@ -126,6 +248,10 @@ class Bell {
 	 * new ring messages. If a new ring message is received,
 	 * the state machine transitions to the RINGING state.
 	 * 
+	 * If pre-ring is enabled and the door has been detected, the
+	 * state machine transitions to the RINGING state right away,
+	 * without waiting for the ring message (See PreRing.h).
+	 * 
 	 * If the WiFi connection is lost during this state, the
 	 * state machine transitions back to the DISCONNECTED state.
 	 * 
@@ -142,11 +268,81 @@ class Bell {
 	 * and enables the LED. Once the ring tone has finished playing,
 	 * the state machine transitions to the CONNECTED state.
 	 * 
+	 * Ring messages received in the RINGING state are passed on to
+	 * the buzzer, which pre-empts or coalesces them depending on
+	 * their ring class (see Buzzer::ring()).
+	 * 
+	 * If the ring message carries a start time, the ring tone is only
+	 * started at that time (See SyncClock.h).
+	 * 
+	 * If the ring has been started by a pre-ring, the first ring
+	 * message merely confirms it. If no ring message is received
+	 * within the pre-ring window, the ring tone is stopped and the
+	 * state machine transitions back to the CONNECTED state.
+	 * 
 	 * @returns RINGING, if the ring tone is still playing.
 	 * 	    CONNECTED, if the ring tone has finished playing.
 	 */
 	bell_state ringing();
 
+	/**
+	 * @brief Schedules the start of the ring tone
+	 * 
+	 * Fails if the bell isn't synced, or the start time has already
+	 * passed or lies more than SYNC_MAX_WAIT_MS ahead.
+	 * 
+	 * @param cls The ring class
+	 * @param at The start of the ring tone in common time (us)
+	 * @returns true If the ring tone has been scheduled,
+	 * 	    false If it should be started right away
+	 */
+	bool schedule_start(ring_class cls, uint32_t at);
+
+	/**
+	 * @brief Starts the scheduled ring tone and reports its start error
+	 * 
+	 * Run by start_task on the first ms at or after the start time.
+	 */
+	void start_scheduled();
+
+	/**
+	 * @brief Scheduler callback, starts the scheduled ring tone
+	 * @param arg Pointer to the Bell object
+	 */
+	static void on_start(void *arg);
+
+	/**
+	 * @brief Scheduler callback, wakes the loop once the pre-ring window has passed
+	 * 
+	 * The callback does nothing itself, as the window is tracked by
+	 * prering_deadline, which is polled in ringing().
+	 * 
+	 * @param arg Pointer to the Bell object
+	 */
+	static void on_prering_timeout(void *arg);
+
+	/**
+	 * @brief Returns if a ring has been received on any path
+	 * 
+	 * Polls the RingReceiver and, if enabled, the MeshRing. As the
+	 * door rings over both paths, a ring with the same press counter
+	 * received over the other path within MESH_DEDUP_WINDOW_MS is
+	 * dropped as a duplicate. Rings without a press counter (ex. of a
+	 * door without the mesh) are never considered duplicates.
+	 * 
+	 * @param cls Set to the ring class of the received ring
+	 * @returns true If a new ring has been received
+	 */
+	bool ring_received(ring_class *cls);
+
+	/**
+	 * @brief Exit hook of the RINGING state
+	 * 
+	 * Turns the LED off, once the ring tone has finished or a
+	 * pre-ring has been cancelled.
+	 */
+	void exit_ringing();
+
 	/**
 	 * @brief Handles the ERROR state
 	 * 
@@ -204,6 +400,14 @@ public:
 	 * of the Bell class. It is the entry point of the class
 	 * and must be continuously called in the main loop of
 	 * the program.
+	 * 
+	 * Before running the state machine, all components that are
+	 * due are run through the Scheduler. The main loop should call
+	 * Scheduler::idle() after each run() to sleep until the next
+	 * component is due.
+	 * 
+	 * Each run() is profiled as an iteration of the main loop
+	 * (See LoopProfiler.h).
 	*/
 	void run();
 };
\ No newline at end of file
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file BellBeacon.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief BellBeacon class
+ */
+
+#pragma once
+
+#include <ESP8266WiFi.h>
+#include <ESPAsyncUDP.h>
+
+#ifndef BELL_BEACON_HEARD_LEN
+#define BELL_BEACON_HEARD_LEN 8 // Beacons of other bells kept until taken through heard()
+#endif
+
+/**
+ * @brief BellBeacon class
+ * 
+ * The BellBeacon announces the bell to the door, which keeps a
+ * directory of all bells (See BellDirectory.h), so bells no longer
+ * have to follow the IP of the door.
+ * 
+ * As the door is powered off between presses, it can't listen for
+ * periodic announcements. Instead, it broadcasts a query after a
+ * ring, which the BellBeacon answers with a beacon containing the
+ * port of the RingReceiver. The IP is taken from the source address
+ * of the beacon. In addition, a beacon is broadcast whenever the bell
+ * has joined the network, which is useful for debugging.
+ * 
+ * Queries are handled from within the UDP receive callback, so the
+ * main loop isn't woken up.
+ * 
+ * The primary bell (See USE_BELL_AP) also needs to know the other bells,
+ * to relay the rings of the door to them. Once it has sent a query of
+ * its own through query(), the beacons of other bells, be it answers or
+ * announcements, are kept until taken through heard() (See RingRelay.h).
+ */
+class BellBeacon {
+private:
+	uint16_t discovery_port;
+	uint16_t ring_port;
+	AsyncUDP udp;
+	bool listening = false;
+	bool collecting = false;
+
+	// Beacons of other bells, not yet taken through heard()
+	volatile uint8_t n_heard = 0;
+	uint32_t heard_ip[BELL_BEACON_HEARD_LEN];
+	uint16_t heard_port[BELL_BEACON_HEARD_LEN];
+
+	/**
+	 * @brief Keeps the beacon of another bell, see heard()
+	 */
+	void keep(IPAddress ip, uint16_t port);
+
+	/**
+	 * @brief UDP receive callback, answers queries of the door
+	 * @param arg Pointer to the BellBeacon object
+	 * @param packet The received packet
+	 */
+	static void on_packet(void *arg, AsyncUDPPacket &packet);
+
+public:
+	/**
+	 * @brief Default constructor
+	 * 
+	 * The default constructor only serves to allow the class 
+	 * to be declared without immidiately initializing it. This
+	 * spares us from having to allocate the object on the heap via
+	 * a pointer, which we generally want to avoid on embedded 
+	 * systems.
+	 */
+	BellBeacon();
+
+	/**
+	 * @brief Constructor
+	 * @param discovery_port The UDP port queries and beacons are sent to
+	 * @param ring_port The port of the RingReceiver, which is announced
+	 */
+	BellBeacon(uint16_t discovery_port, uint16_t ring_port);
+
+	/**
+	 * @brief Starts listening for queries
+	 * 
+	 * As the receive callback refers to this object, begin() must
+	 * be called on the final (ie. not copied) object.
+	 * 
+	 * @returns true If the UDP port could be opened
+	 */
+	bool begin();
+
+	/**
+	 * @brief Broadcasts a beacon
+	 * 
+	 * Should be called once the bell has joined the network.
+	 */
+	void announce();
+
+	/**
+	 * @brief Broadcasts a query, other bells answer with their beacons
+	 * 
+	 * From then on, beacons of other bells are kept until taken
+	 * through heard(). Should be called once the bell has joined
+	 * the network.
+	 */
+	void query();
+
+	/**
+	 * @brief Takes the oldest beacon heard from another bell
+	 * 
+	 * @param ip Set to the IP of the bell
+	 * @param port Set to the port of its RingReceiver
+	 * @returns false If no beacon has been heard since the last call
+	 */
+	bool heard(IPAddress *ip, uint16_t *port);
+};
@@ -25,6 +25,7 @@
 #pragma once
 
 #include <WString.h>
+#include <ESP8266WiFi.h>
 
 /**
  * @brief The BellCFG class.
@@ -43,6 +44,31 @@ public:
 	String gateway = "";
 	String subnet = "";
 	uint16_t port = 0;
+	WiFiSleepType_t sleep_mode = WIFI_NONE_SLEEP;
+	uint8_t listen_interval = 0;
+	bool mesh = false;		///< Receive and relay rings over ESP-NOW (See MeshRing.h)
+	String mesh_door_mac = "";	///< Station MAC of the door, rings of other origins are dropped
+	bool sync = false;		///< Start scheduled rings at their start time (See SyncClock.h)
+	bool sync_master = false;	///< Provide the common time
+	uint16_t sync_port = 0;		///< UDP port for time requests of the door
+	uint16_t discovery_port = 0;	///< UDP port the bell announces itself on (0 = disabled, See BellBeacon.h)
+	uint16_t metrics_port = 0;	///< TCP port of the /metrics endpoint (0 = disabled, See MetricsServer.h)
+
+	// Bell hosted access point (See DoorAP.h and RingRelay.h)
+	bool door_ap = false;		///< Host the access point for the door and relay its rings
+	String ap_ssid = "";
+	String ap_psk = "";
+	String ap_ip = "";
+	uint8_t ap_channel = 0;
+	String relay_door_ip = "";	///< IP of the door on the shared network, bells are assumed to follow it until discovered
+	uint8_t relay_n_bells = 0;	///< Bells assumed to follow the door, including this one (See RingRelay.h)
+	unsigned long relay_timeout_ms = 0;
+	String relay_ip = "";		///< IP of the bell relaying rings to this one ("" = none)
+
+	// Pre-ring (See PreRing.h), requires door_ap
+	bool prering = false;
+	String door_mac = "";
+	unsigned long prering_window_ms = 0;	///< Time to wait for the ring message before cancelling
 
 	/**
 	 * @brief Checks if the configuration is valid
@@ -26,15 +26,38 @@
 
 #include <stddef.h>
 
+#include <Clock.h>
+#include <ring_msg.h>
+#include <Scheduler.h>
+
 #include <bell/melodies.h>
+#include <bell/SamplePlayer.h>
 
 /**
  * @brief Buzzer class
  * 
  * The Buzzer class is used to aynchronously play a
  * ring tone melody on a buzzer.
+ * 
+ * Optionally, a recorded chime can be played instead of
+ * the melody (see SamplePlayer). If the sample file is
+ * unavailable, the Buzzer falls back to the melody.
+ * 
+ * Each ring class (see ring_msg.h) has its own melody. A ring
+ * of a higher priority class pre-empts the current ring tone at
+ * the next note boundary, while repeated rings of the same class
+ * are coalesced according to the configured coalesce_policy.
+ * Rings of a lower priority class are dropped.
  */
 class Buzzer {
+public:
+	/// How repeated rings of the same class are handled while ringing
+	enum coalesce_policy {
+		COALESCE_DROP,	  ///< Drop the repeat, the current ring tone continues
+		COALESCE_RESTART, ///< Restart the ring tone at the next note boundary
+		COALESCE_QUEUE	  ///< Play the ring tone once more after the current one (repeats are merged)
+	};
+
 private:
 	/// State machine states
 	enum bzr_stat {
@@ -44,12 +67,45 @@ private:
 	};
 
 	uint8_t pin;
-	note_t *melody;
-        size_t melody_len;
+	const note_t *melody[N_RING_CLASSES];
+	size_t melody_len[N_RING_CLASSES];
 	size_t i_tone;
 
+	ring_class cur_class;
+	ring_class pending_class;
+	bool preempt = false;
+	bool queued = false;
+	coalesce_policy coalesce = COALESCE_DROP;
+
+	SamplePlayer sample;
+	bool has_sample = false;
+
 	bzr_stat stat;
-	unsigned long tstamp;
+	Deadline deadline;
+	unsigned long first_note_us = 0;
+	sched_task_t task;
+
+	/**
+	 * @brief Starts playing the ring tone of the given class from the beginning
+	 * 
+	 * Ring tones of the normal class are played from the sample
+	 * file if available.
+	 * 
+	 * @param cls The ring class to play
+	 */
+	void start(ring_class cls);
+
+	/**
+	 * @brief Schedules the next update
+	 * @param ms Time until the next update in ms
+	 */
+	void next_in(unsigned long ms);
+
+	/**
+	 * @brief Scheduler callback, updates the Buzzer
+	 * @param arg Pointer to the Buzzer object
+	 */
+	static void on_task(void *arg);
 
 public:
 	/**
@@ -69,20 +125,66 @@ public:
 	 * The constructor initializes the Buzzer class with a given
 	 * pin and melody. See melodies.h for available melodies.
 	 * 
+	 * The melody is used for all ring classes, until a different
+	 * melody is assigned with setMelody().
+	 * 
 	 * @param pin The pin to use for the buzzer
-	 * @param melody The melody to play
+	 * @param melody The melody to play (See setMelody() on whether it is copied)
 	 * @param melody_len The length of the melody
+	 * @param sample_file Path of a sample file on LittleFS to play instead of the melody (NULL = melody only)
+	 * @param sample_rate The sample rate of the sample file in Hz
+	 */
+	Buzzer(uint8_t pin, const note_t mel[], size_t melody_len,
+	       const char *sample_file = NULL, uint16_t sample_rate = 8000);
+
+	/**
+	 * @brief Sets the melody of a ring class
+	 * 
+	 * The melody is copied to the heap, unless BELL_STATIC_ALLOC is
+	 * set, in which case it must remain valid (ex. from melodies.h).
+	 * 
+	 * @param cls The ring class
+	 * @param mel The melody to play for rings of this class
+	 * @param len The length of the melody
 	 */
-	Buzzer(uint8_t pin, const note_t mel[], size_t melody_len);
+	void setMelody(ring_class cls, const note_t mel[], size_t len);
+
+	/**
+	 * @brief Sets how repeated rings of the same class are handled
+	 * 
+	 * See coalesce_policy for available policies (default: COALESCE_DROP).
+	 */
+	void setCoalescePolicy(coalesce_policy policy);
 
 	/**
 	 * @brief Tells the Buzzer to start playing the ring tone
 	 * 
 	 * The following method tells the Buzzer to start playing
-	 * the ring tone. It will put the state machine into the
-	 * RINGING state.
+	 * the ring tone of the given ring class. It will put the
+	 * state machine into the RINGING state.
+	 * 
+	 * If a sample file has been provided and is available, the
+	 * sample is played for normal rings, otherwise the melody
+	 * is played.
+	 * 
+	 * If the Buzzer is already ringing, a ring of a higher priority
+	 * class takes over at the next note boundary, a ring of the same
+	 * class is handled according to the coalesce policy, and a ring
+	 * of a lower priority class is dropped.
+	 * 
+	 * @param cls The ring class (default: RING_CLASS_NORMAL)
+	 * @returns true If a ring tone has been started, and firstNoteAt() thus refers to this ring,
+	 * 	    false If it pre-empts, is coalesced with or dropped in favor of the ring tone already playing
+	 */
+	bool ring(ring_class cls = RING_CLASS_NORMAL);
+
+	/**
+	 * @brief Stops the ring tone immediately
+	 * 
+	 * Puts the state machine back into the IDLE state. Any
+	 * pending pre-emption or queued ring tone is discarded.
 	 */
-	void ring();
+	void stop();
 
 	/**
 	 * @brief Check if Buzzer is (still) playing ring tone
@@ -104,7 +206,9 @@ public:
 	 * 
 	 * The following method updates the Buzzer state machine.
 	 * 
-	 * It must be called periodically!
+	 * The Buzzer schedules its own updates through the Scheduler
+	 * for every note (or sample buffer refill), so there is no
+	 * need to call this method from the main loop.
 	 * 
 	 * In the IDLE state, the update method does nothing
 	 * and simply waits for the ring() method to be called.
@@ -115,4 +219,28 @@ public:
 	 * 
 	 */
 	void update();
+
+	/**
+	 * @brief Returns when the first note of the last ring tone was played
+	 * 
+	 * The first note is played from within ring(), unless the ring is
+	 * pre-empting or coalesced with a ring tone that is already playing.
+	 * 
+	 * @returns The time of the first note in microseconds (see micros())
+	 */
+	unsigned long firstNoteAt();
+
+	/**
+	 * @brief Returns the number of sample buffer underruns
+	 * 
+	 * See SamplePlayer::underruns()
+	 */
+	uint32_t sampleUnderruns();
+
+	/**
+	 * @brief Returns the flash read rate of the sample player in bytes per second
+	 * 
+	 * See SamplePlayer::readRate()
+	 */
+	uint32_t sampleReadRate();
 };
\ No newline at end of file
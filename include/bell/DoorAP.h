@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file DoorAP.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a class for hosting an access point for the door
+ */
+
+#pragma once
+
+#include <ESP8266WiFi.h>
+
+/**
+ * @brief DoorAP class
+ * 
+ * If USE_BELL_AP is enabled, the door doesn't join the shared network,
+ * where association may be slow when busy, but a hidden access point
+ * hosted by the primary bell. The DoorAP class runs that access point
+ * alongside the station connection of the bell.
+ * 
+ * As the ESP8266 only has a single radio, the access point always runs
+ * on the channel of the station connection. The configured channel must
+ * therefore match the channel of the shared network, or the access point
+ * will move once the station has connected. Only a single client (the
+ * door) is admitted.
+ * 
+ * @attention While the access point is running, the radio can't sleep,
+ * so the sleep mode of the bell has no effect.
+ */
+class DoorAP {
+private:
+	String ssid;
+	String psk;
+	IPAddress ip;
+	uint8_t channel;
+	bool active = false;
+
+public:
+	/**
+	 * @brief Default constructor
+	 * 
+	 * The default constructor only serves to allow the class 
+	 * to be declared without immidiately initializing it. This
+	 * spares us from having to allocate the object on the heap via
+	 * a pointer, which we generally want to avoid on embedded 
+	 * systems.
+	 */
+	DoorAP();
+
+	/**
+	 * @brief Constructor
+	 * @param ssid The SSID of the access point (hidden)
+	 * @param psk The PSK of the access point
+	 * @param ip The IP address of the bell on the access point
+	 * @param channel The channel of the access point
+	 */
+	DoorAP(const String ssid, const String psk, const IPAddress ip, uint8_t channel);
+
+	/**
+	 * @brief Starts the access point
+	 * 
+	 * Must be called before the station connects.
+	 * 
+	 * @returns true If the access point has been started
+	 */
+	bool begin();
+
+	/**
+	 * @brief Returns true if the access point is running
+	 */
+	bool running();
+};
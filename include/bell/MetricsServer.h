@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file MetricsServer.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a Prometheus style /metrics endpoint
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <ESPAsyncTCP.h>
+
+#include <QuantileSketch.h>
+
+#ifndef BELL_METRICS_MAX
+#define BELL_METRICS_MAX 40 // Metrics that can be registered
+#endif
+
+#ifndef BELL_METRICS_BUF_LEN
+#define BELL_METRICS_BUF_LEN 1536 // Bytes, the response is rendered in pages of this size
+#endif
+
+#define BELL_METRICS_LABELS_LEN 192 // Bytes, labels of a single info metric
+
+/**
+ * @brief Reads the value of a metric
+ * @param arg The argument passed on registration
+ * @returns The current value of the metric
+ */
+typedef uint32_t (*metric_fn_t)(void *arg);
+
+/**
+ * @brief Formats the labels of an info metric
+ * @param buf Buffer to write the labels to (ex. a="1",b="2")
+ * @param len Size of the buffer
+ * @param arg The argument passed on registration
+ * @returns false If there is nothing to report
+ */
+typedef bool (*metric_info_fn_t)(char *buf, size_t len, void *arg);
+
+/**
+ * @brief MetricsServer class
+ * 
+ * The MetricsServer serves the counters and gauges of the bell in
+ * the Prometheus text format on a TCP port of its own, so it doesn't
+ * interfere with the RingReceiver. Any client may scrape the bell.
+ * 
+ * Metrics are registered once through counter() and gauge(), and are
+ * read through a callback or directly from a variable. Quantiles of
+ * a QuantileSketch are served as a summary. Free heap, heap
+ * fragmentation, RSSI, uptime and the scrapes served are always served.
+ * 
+ * To avoid heap allocation (and with it fragmentation) on every scrape,
+ * the response is rendered into a static buffer and sent in chunks from
+ * the ack callback. The TCP stack copies each chunk, as the connection
+ * may be closed before all of it has been acknowledged, after which the
+ * buffer is reused for the next client. Responses larger than the buffer
+ * are rendered page by page, the next page is rendered once the previous
+ * one has been acknowledged, so at most a page is held by the TCP stack.
+ * Metrics are never split across pages.
+ * Only a single scrape is served at a time, further clients are closed
+ * right away. Rendering takes well below a millisecond, so a scrape
+ * doesn't noticeably delay a ring.
+ * 
+ * If USE_EVENT_TRACE is set, the event trace is served under /trace in
+ * the same way, one dump line per item (See EventTrace.h). Recording is
+ * held while the trace is being served.
+ * 
+ * As the callbacks of the AsyncServer are static, the class is a singleton.
+ */
+class MetricsServer {
+private:
+	/// Registered metric
+	struct metric_t {
+		const char *name;
+		const char *help;
+		bool counter;	///< Counter or gauge
+		bool sign;	///< Value is signed
+		metric_fn_t fn;	///< NULL for summaries and info metrics, arg then points to the quantile_sketch_t
+		metric_info_fn_t info;	///< Set for info metrics
+		void *arg;
+	};
+
+	inline static AsyncServer *server;
+	inline static AsyncClient *client;
+
+	inline static metric_t metrics[BELL_METRICS_MAX];
+	inline static uint8_t n_metrics;
+
+	inline static char buf[BELL_METRICS_BUF_LEN];
+	inline static char labels[BELL_METRICS_LABELS_LEN];
+	inline static size_t len;
+	inline static size_t sent;
+	inline static size_t acked;
+	inline static uint16_t next;	///< Next item to render, built-in metrics first
+	inline static bool responding;
+	inline static bool tracing;	///< Serving the event trace rather than the metrics
+	inline static uint32_t n_scrapes;
+	inline static uint32_t n_truncated;	///< Metrics larger than the buffer, sent truncated
+
+	/**
+	 * @brief Adds a metric to the registry
+	 */
+	static void add(const char *name, const char *help, bool counter, bool sign, metric_fn_t fn, void *arg,
+			metric_info_fn_t info = NULL);
+
+	/**
+	 * @brief Reads a metric registered by its address
+	 * @param arg Pointer to the uint32_t value
+	 */
+	static uint32_t read_u32(void *arg);
+
+	/**
+	 * @brief Appends formatted text to the response, truncates if full
+	 */
+	static void append(const char *fmt, ...);
+
+	/**
+	 * @brief Appends a single metric to the response
+	 */
+	static void append_metric(const char *name, const char *help, bool counter, bool sign, uint32_t val);
+
+	/**
+	 * @brief Appends p50, p95, p99 and the count of a sketch to the response
+	 */
+	static void append_summary(const char *name, const char *help, const quantile_sketch_t &s);
+
+	/**
+	 * @brief Appends a built-in or registered metric, or a line of the event trace to the response
+	 * @param i Index of the item, built-in metrics first
+	 */
+	static void append_item(uint16_t i);
+
+	/**
+	 * @brief Returns the number of built-in and registered metrics, or lines of the event trace
+	 */
+	static uint16_t n_items();
+
+	/**
+	 * @brief Returns true if the request line asks for a path
+	 */
+	static bool requested(const char *req, size_t n, const char *path);
+
+	/**
+	 * @brief Starts a response
+	 * @param found False renders a 404 response instead
+	 * @param trace Serves the event trace rather than the metrics
+	 */
+	static void render(bool found, bool trace = false);
+
+	/**
+	 * @brief Renders the next page of the response into the static buffer
+	 * 
+	 * Metrics are rendered until the next one doesn't fit. A single
+	 * metric larger than the buffer is sent truncated, which is logged
+	 * and counted in doorbell_metrics_truncated_total.
+	 * 
+	 * @returns false If the response has been rendered completely
+	 */
+	static bool render_page();
+
+	/**
+	 * @brief Hands as much of the response to the TCP stack as fits
+	 * 
+	 * Renders the next page once the current one has been acknowledged,
+	 * and closes the connection once all of the response has been.
+	 */
+	static void send_more();
+
+	// Callbacks
+
+	/**
+	 * @brief Callback for new connections
+	 * 
+	 * Closes the connection if a scrape is already being served.
+	 */
+	static void on_new_client(void *arg, AsyncClient *new_client);
+
+	/**
+	 * @brief Callback for data received from the client
+	 * 
+	 * Renders the metrics if the request is a GET of /metrics,
+	 * otherwise a 404 response. Further data is ignored.
+	 */
+	static void on_data(void *arg, AsyncClient *c, void *data, size_t n);
+
+	/**
+	 * @brief Callback for acknowledged data, sends the next chunk
+	 */
+	static void on_ack(void *arg, AsyncClient *c, size_t n, uint32_t time);
+
+	/**
+	 * @brief Callback for client disconnection, frees the server for the next scrape
+	 */
+	static void on_disconnect(void *arg, AsyncClient *c);
+
+	/**
+	 * @brief Callback on client timeout, closes the connection
+	 */
+	static void on_timeout(void *arg, AsyncClient *c, uint32_t time);
+
+public:
+	/**
+	 * @brief Starts serving metrics
+	 * @param port The TCP port to listen on
+	 */
+	static void begin(uint16_t port);
+
+	/**
+	 * @brief Registers a counter read from a variable
+	 * 
+	 * The name must follow the Prometheus conventions (ex. a _total suffix).
+	 * Name and help must remain valid, ie. should be string literals.
+	 * 
+	 * @param name Name of the metric
+	 * @param help Description of the metric
+	 * @param value Pointer to the value, must remain valid
+	 */
+	static void counter(const char *name, const char *help, const uint32_t *value);
+
+	/**
+	 * @brief Registers a counter read through a callback
+	 * 
+	 * See counter() above.
+	 * 
+	 * @param fn Callback returning the value
+	 * @param arg Argument passed to the callback
+	 */
+	static void counter(const char *name, const char *help, metric_fn_t fn, void *arg);
+
+	/**
+	 * @brief Registers a gauge read from a variable
+	 * 
+	 * See counter().
+	 */
+	static void gauge(const char *name, const char *help, const uint32_t *value);
+
+	/**
+	 * @brief Registers a gauge read through a callback
+	 * 
+	 * See counter().
+	 * 
+	 * @param sign The value returned by the callback is a signed int32_t
+	 */
+	static void gauge(const char *name, const char *help, metric_fn_t fn, void *arg, bool sign = false);
+
+	/**
+	 * @brief Registers a summary of the p50, p95 and p99 of a sketch
+	 * 
+	 * See counter() and QuantileSketch.h.
+	 * 
+	 * @param sketch Pointer to the sketch, must remain valid
+	 */
+	static void summary(const char *name, const char *help, const quantile_sketch_t *sketch);
+
+	/**
+	 * @brief Registers an info metric
+	 * 
+	 * Info metrics carry their data in labels and always have the
+	 * value 1 (ex. name{reason="2",epc1="0x40201234"} 1). See counter().
+	 * 
+	 * @param fn Callback formatting the labels
+	 * @param arg Argument passed to the callback
+	 */
+	static void info(const char *name, const char *help, metric_info_fn_t fn, void *arg);
+};
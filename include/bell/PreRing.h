@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file PreRing.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a class for detecting the door before its ring arrives
+ */
+
+#pragma once
+
+#include <ESP8266WiFi.h>
+
+/**
+ * @brief PreRing class
+ * 
+ * As the door is powered off between presses, it only ever shows up on
+ * the network to ring. By the time the ring message arrives, the door
+ * has already spent most of its time associating and connecting. The
+ * PreRing class detects the door as soon as it sends its first frames,
+ * so the bell can start ringing right away, with the ring message then
+ * merely confirming the ring (See Bell::ringing()).
+ * 
+ * Sniffing frames in promiscuous mode isn't possible while the ESP8266
+ * is connected as a station. Instead, the PreRing relies on the probe
+ * request and station connected events of the SDK's access point,
+ * filtered by the MAC address of the door. It therefore only works on
+ * the bell hosting the access point for the door (See DoorAP.h), which
+ * the door probes for and associates with on every press.
+ */
+class PreRing {
+private:
+	uint8_t door_mac[6];
+	volatile bool seen = false;
+	volatile unsigned long seen_us;
+
+	WiFiEventHandler probe_handler;
+	WiFiEventHandler sta_handler;
+
+	/**
+	 * @brief Handles a frame sent by a station
+	 * 
+	 * Flags the door as seen and wakes the main loop if the
+	 * frame has been sent by the door.
+	 * 
+	 * @param mac MAC address of the sending station
+	 */
+	void on_frame(const uint8_t mac[6]);
+
+public:
+	/**
+	 * @brief Default constructor
+	 * 
+	 * The default constructor only serves to allow the class 
+	 * to be declared without immidiately initializing it. This
+	 * spares us from having to allocate the object on the heap via
+	 * a pointer, which we generally want to avoid on embedded 
+	 * systems.
+	 */
+	PreRing();
+
+	/**
+	 * @brief Constructor
+	 * @param door_mac The MAC address of the door (ex. "AA:BB:CC:DD:EE:FF")
+	 */
+	PreRing(const String door_mac);
+
+	/**
+	 * @brief Registers the WiFi event handlers
+	 * 
+	 * As the handlers refer to this object, begin() must be
+	 * called once the object has been assigned to its final
+	 * location.
+	 */
+	void begin();
+
+	/**
+	 * @brief Returns true if the door has been seen since the last call
+	 * 
+	 * Calling triggered() resets the return value to false,
+	 * similarly to RingReceiver::received().
+	 */
+	bool triggered();
+
+	/**
+	 * @brief Returns when the door has last been seen
+	 * 
+	 * @returns The time in microseconds (see micros())
+	 */
+	unsigned long triggeredAt();
+};
@@ -26,6 +26,36 @@
 
 #include <ESPAsyncTCP.h>
 
+#include <CrashLog.h>
+#include <ring_msg.h>
+
+/**
+ * @brief Connection statistics of the RingReceiver
+ */
+struct ring_rx_stats_t {
+	uint32_t rings;		///< Ring messages received
+	uint32_t rejected;	///< Connections closed, as not from the door or another client was connected
+	uint32_t invalid;	///< Invalid packets received
+	uint32_t timeouts;	///< Client timeouts
+	uint32_t errors;	///< Client errors
+	uint32_t crashes;	///< Crashes reported by the door (See RING_TLV_CRASH in ring_msg.h)
+};
+
+/**
+ * @brief Contents of a parsed ring message
+ */
+struct ring_rx_msg_t {
+	ring_class cls;
+	bool has_start_at;
+	uint32_t start_at;	///< See RING_TLV_START_AT
+	bool has_trace;
+	ring_trace_t trace;	///< See RING_TLV_TRACE
+	bool has_seq;
+	uint16_t seq;		///< See RING_TLV_SEQ
+	bool has_crash;
+	crash_record_t crash;	///< See RING_TLV_CRASH
+};
+
 /**
  * @brief RingReceiver class
  * 
@@ -46,8 +76,22 @@ private:
 	inline static AsyncClient *client;
 
 	inline static IPAddress door_ip;
+	inline static IPAddress relay_ip;
 	inline static bool running;
 	inline static bool recv;
+	inline static ring_class recv_class;
+	inline static unsigned long recv_us;
+	inline static bool recv_has_start_at;
+	inline static uint32_t recv_start_at;
+	inline static ring_rx_stats_t stat;
+	inline static bool has_door_crash;
+	inline static crash_record_t door_crash;
+	inline static unsigned long arrived_us;		///< Packet passed to on_data()
+	inline static unsigned long parsed_us;		///< Packet handled
+	inline static bool recv_has_trace;
+	inline static ring_trace_t recv_trace;
+	inline static bool recv_has_seq;
+	inline static uint16_t recv_seq;
 
 	inline static RingReceiver *instance;
 
@@ -77,8 +121,7 @@ private:
 	 * @brief Callback for data received from client
 	 * 
 	 * This callback is called when data is received from the client.
-	 * If the data is a ring message, the received() function will return true.
-	 * If the data is invalid, the connection is closed and ignored.
+	 * The data is handled by handle(), after which the connection is closed.
 	 */
 	static void on_data(void* arg, AsyncClient* client, void *data, size_t len);
 	
@@ -107,6 +150,19 @@ private:
 	 */
 	static void on_error(void* arg, AsyncClient* client, int8_t error);
 
+	/**
+	 * @brief Handles a packet received from the door
+	 * 
+	 * If the packet is a ring message, the received() function will return
+	 * true. TLVs following the ring message are parsed (See ring_msg.h).
+	 * 
+	 * If multiple ring messages are received before received() is polled,
+	 * the highest priority ring class is kept.
+	 * 
+	 * @returns false If the packet is invalid
+	 */
+	static bool handle(const uint8_t *buf, size_t len);
+
 public:
 	/**
 	 * @brief Gets or creates the singleton instance
@@ -115,6 +171,22 @@ public:
 	 * If the instance does not exist, it is created.
 	 */
 	static RingReceiver *get_instance();
+
+	/**
+	 * @brief Parses a ring message
+	 * 
+	 * Validates the packet and extracts the ring class and known TLVs
+	 * (See ring_msg.h), without touching the state of the receiver.
+	 * 
+	 * Called by handle(), and only public so the parser can be
+	 * benchmarked without a connection (See Bench.h).
+	 * 
+	 * @param buf The packet
+	 * @param len The length of the packet
+	 * @param msg Set to the contents of the ring message
+	 * @returns false If the packet is invalid
+	 */
+	static bool parse(const uint8_t *buf, size_t len, ring_rx_msg_t *msg);
 	
 	/**
 	 * @brief Starts the ring receiver
@@ -138,8 +210,72 @@ public:
 	 * 
 	 * Poll this function to check if a ring message has been received.
 	 * 
+	 * @param cls Set to the ring class of the received message (optional)
 	 * @returns true if a new ring message has been received,
 	 *  	    false if no new ring message has been received
 	 */
-	bool received();
+	bool received(ring_class *cls = NULL);
+
+	/**
+	 * @brief Accepts ring messages from a second address
+	 * 
+	 * Used by bells to accept rings relayed by the bell that hosts the
+	 * access point for the door (See USE_BELL_AP in config.h).
+	 * 
+	 * @param relay_ip_addr The IP address of the relaying bell
+	 */
+	void allow(String relay_ip_addr);
+
+	/**
+	 * @brief Returns the scheduled start of the last ring message
+	 * 
+	 * See RING_TLV_START_AT in ring_msg.h and SyncClock.h.
+	 * 
+	 * @param start_at Set to the start of the ring tone in common time (us)
+	 * @returns true If the last ring message carried a start time
+	 */
+	bool startAt(uint32_t *start_at);
+
+	/**
+	 * @brief Returns when the last ring message was received
+	 * 
+	 * @returns The time of reception in microseconds (see micros())
+	 */
+	unsigned long receivedAt();
+
+	/**
+	 * @brief Returns the trace context of the last ring message
+	 * 
+	 * See RING_TLV_TRACE in ring_msg.h.
+	 * 
+	 * @param trace Set to the trace context and phase timings of the door
+	 * @param arrived Set to when the packet arrived in microseconds (see micros())
+	 * @param parsed Set to when the packet had been parsed in microseconds
+	 * @returns false If the last ring message didn't carry a trace context
+	 */
+	bool trace(ring_trace_t *trace, unsigned long *arrived, unsigned long *parsed);
+
+	/**
+	 * @brief Returns the press counter of the last ring message
+	 * 
+	 * See RING_TLV_SEQ in ring_msg.h.
+	 * 
+	 * @param seq Set to the press counter of the door
+	 * @returns false If the last ring message didn't carry a press counter
+	 */
+	bool seq(uint16_t *seq);
+
+	/**
+	 * @brief Returns the last crash reported by the door
+	 * 
+	 * @returns The crash record, or NULL if the door hasn't reported a crash since boot
+	 */
+	const crash_record_t *doorCrash();
+
+	/**
+	 * @brief Returns the connection statistics
+	 * 
+	 * The counters are never reset.
+	 */
+	const ring_rx_stats_t &stats();
 };
\ No newline at end of file
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file RingRelay.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a class for relaying rings to the other bells
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <RingTX.h>
+#include <Scheduler.h>
+#include <ring_msg.h>
+
+#define RING_RELAY_POLL_MS 10 // Poll interval while relaying, connects are handled right away
+
+#ifndef RING_RELAY_MAX_BELLS
+#define RING_RELAY_MAX_BELLS 8 // Bells rings can be relayed to, excluding the relaying bell
+#endif
+
+#ifndef RING_RELAY_MAX_FAILS
+#define RING_RELAY_MAX_FAILS 3 // Drop discovered bells failing this many relays in a row
+#endif
+
+/**
+ * @brief RingRelay class
+ * 
+ * If USE_BELL_AP is enabled, the door only rings the primary bell
+ * through its access point (See DoorAP). The primary bell then relays
+ * the ring to the other bells over the shared network.
+ * 
+ * Similarly to the BellDirectory of the door, the bells are learned
+ * from their beacons (See BellBeacon.h), so they don't need to follow
+ * the IP of the door. Until the first beacon has been heard, the bells
+ * are assumed to follow the IP of the door, whereby the relaying bell
+ * skips itself. Discovered bells that fail RING_RELAY_MAX_FAILS relays
+ * in a row are dropped, as they are likely to have moved, in which
+ * case they are learned again from the beacon they send on rejoining.
+ * 
+ * Similarly to the RingSender, a RingTX instance is created for each
+ * bell. Rings are relayed with their ring class, and a ring received
+ * while the previous one is still being relayed to a bell is not
+ * relayed to that bell again.
+ */
+class RingRelay {
+private:
+	uint8_t n_tx = 0;
+	RingTX *tx = NULL;
+	uint32_t tx_ip[RING_RELAY_MAX_BELLS];
+	uint16_t tx_port[RING_RELAY_MAX_BELLS];
+	uint8_t tx_fails[RING_RELAY_MAX_BELLS];	///< Failed relays in a row
+	bool assumed = false;	///< Bells are assumed to follow the door, none has been discovered yet
+	IPAddress own_ip;
+	unsigned long timeout_ms = 0;
+	bool relaying = false;
+	sched_task_t task;
+
+	/**
+	 * @brief Adds a bell to relay rings to
+	 * @returns false If RING_RELAY_MAX_BELLS bells have already been added
+	 */
+	bool add(IPAddress ip, uint16_t port);
+
+	/**
+	 * @brief Removes a bell, see add()
+	 * @param i Index of the bell
+	 */
+	void remove(uint8_t i);
+
+	/**
+	 * @brief Scheduler callback, updates the RingRelay
+	 * @param arg Pointer to the RingRelay object
+	 */
+	static void on_task(void *arg);
+
+public:
+	/**
+	 * @brief Default constructor
+	 * 
+	 * The default constructor only serves to allow the class 
+	 * to be declared without immidiately initializing it. This
+	 * spares us from having to allocate the object on the heap via
+	 * a pointer, which we generally want to avoid on embedded 
+	 * systems.
+	 */
+	RingRelay();
+
+	/**
+	 * @brief Constructor
+	 * @param door_ip The IP address of the door on the shared network, bells are assumed to follow it
+	 * @param own_ip The IP address of this bell, which is skipped
+	 * @param port The port of the bell receivers, until discovered
+	 * @param n_bells The number of bells assumed to follow the door, including this one
+	 * @param timeout_ms The timeout for each bell
+	 */
+	RingRelay(IPAddress door_ip, IPAddress own_ip, unsigned int port, uint8_t n_bells,
+		  unsigned long timeout_ms);
+
+	/**
+	 * @brief Destructor
+	 * 
+	 * The destructor frees any RingTX instances that have been
+	 * created.
+	 */
+	~RingRelay();
+
+	/**
+	 * @brief = operator overload
+	 * 
+	 * The = operator overload is used to create a deep copy
+	 * of the RingRelay instance.
+	 */
+	RingRelay& operator=(const RingRelay& other);
+
+	/**
+	 * @brief Relays a ring to all other bells
+	 * 
+	 * If the received ring carried a start time (See SyncClock.h),
+	 * it is passed on, so all bells start together. The trace context
+	 * of the door is passed on with the timings of the door, so the
+	 * bells can join it with their own (See RingReceiver::trace()).
+	 * 
+	 * @param cls The ring class of the received ring
+	 * @param start_at The scheduled start of the ring tone (NULL = none)
+	 * @param seq The press counter of the door (NULL = none, See MeshRing.h)
+	 * @param trace The trace context of the door (NULL = none, See ring_msg.h)
+	 */
+	void send(ring_class cls, const uint32_t *start_at = NULL, const uint16_t *seq = NULL,
+		  const ring_trace_t *trace = NULL);
+
+	/**
+	 * @brief Learns a bell from its beacon (See BellBeacon::heard())
+	 * 
+	 * The first bell learned replaces the bells assumed to follow
+	 * the door. Must not be called while busy(), as the RingTX
+	 * instances are still in use, the bell is ignored then.
+	 * 
+	 * @param ip The IP address of the bell
+	 * @param port The port of its RingReceiver
+	 */
+	void learn(IPAddress ip, uint16_t port);
+
+	/**
+	 * @brief Returns true while a ring is being relayed
+	 */
+	bool busy();
+
+	/**
+	 * @brief Updates the RingTX instances
+	 * 
+	 * While relaying, the RingRelay schedules its own updates
+	 * through the Scheduler, so there is no need to call this
+	 * method from the main loop.
+	 */
+	void update();
+};
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file SamplePlayer.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a class for streaming recorded chimes from LittleFS
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include <config.h> // BELL_SAMPLE_BUF_LEN, must be the same in every translation unit
+
+/**
+ * @brief SamplePlayer class
+ *
+ * The SamplePlayer class streams a recorded chime from LittleFS to the
+ * buzzer pin. Samples are expected to be stored as raw, unsigned 8-bit
+ * mono PCM (ex. 8 kHz), without any header.
+ *
+ * Samples are output through the sigma-delta modulator of the ESP8266,
+ * which is fed by a timer1 interrupt running at the sample rate. Since
+ * reading from flash is too slow (and not allowed) from within an interrupt,
+ * the file is streamed through a double buffer: The interrupt plays one
+ * buffer, while the update() method refills the other one from flash.
+ *
+ * If the interrupt reaches the end of a buffer before the other one has
+ * been refilled, an underrun is counted and the last sample is held until
+ * the buffer is ready.
+ *
+ * @attention timer1 is shared with tone() and analogWrite(). The SamplePlayer
+ * only claims it while a sample is playing and releases it afterwards.
+ * As there is only one timer1, only one sample can be played at a time.
+ */
+class SamplePlayer {
+private:
+	// State shared with the interrupt routine
+	inline static uint8_t buf[2][BELL_SAMPLE_BUF_LEN];
+	inline static volatile size_t buf_len[2];
+	inline static volatile uint8_t cur;
+	inline static volatile size_t pos;
+	inline static volatile bool eof;
+	inline static volatile bool done;
+	inline static volatile uint32_t n_underruns;
+
+	uint8_t pin;
+	String path;
+	uint16_t rate;
+	bool mounted = false;
+	bool active = false;
+	File file;
+
+	uint32_t bytes_read = 0;
+	uint32_t read_us = 0;
+	uint32_t start_us = 0;
+
+	/**
+	 * @brief Timer1 interrupt routine
+	 *
+	 * Outputs the next sample to the sigma-delta modulator and
+	 * swaps buffers once the current buffer has been played.
+	 *
+	 * Placed in IRAM as flash may not be accessible while
+	 * the update() method reads from LittleFS.
+	 */
+	static void IRAM_ATTR isr();
+
+	/**
+	 * @brief Fills one of the two buffers from the sample file
+	 * @param i Index of the buffer to fill
+	 */
+	void fill(uint8_t i);
+
+public:
+	/**
+	 * @brief Default constructor
+	 *
+	 * The default constructor only serves to allow the class
+	 * to be declared without immidiately initializing it. This
+	 * spares us from having to allocate the object on the heap via
+	 * a pointer, which we generally want to avoid on embedded
+	 * systems.
+	 */
+	SamplePlayer();
+
+	/**
+	 * @brief Constructor
+	 *
+	 * The constructor mounts LittleFS. Missing or unformatted
+	 * filesystems are not formatted, in which case play() will
+	 * simply fail.
+	 *
+	 * @param pin The pin the buzzer is connected to
+	 * @param path Path of the sample file on LittleFS
+	 * @param rate The sample rate in Hz
+	 */
+	SamplePlayer(uint8_t pin, const String path, uint16_t rate);
+
+	/**
+	 * @brief Starts playing the sample file
+	 *
+	 * The following method opens the sample file, fills the first
+	 * buffer and starts the timer. The time until the first sample
+	 * is output is therefore bounded by a single buffer read, see
+	 * startLatency().
+	 *
+	 * @returns true If playback has been started,
+	 * 	    false If the sample file is not available
+	 */
+	bool play();
+
+	/**
+	 * @brief Returns if a sample is (still) being played
+	 */
+	bool playing();
+
+	/**
+	 * @brief Refills the buffers
+	 *
+	 * The update() method must be called at least every refillInterval()
+	 * while a sample is playing, in order to refill the buffers. It
+	 * also stops playback once the end of the file has been played.
+	 */
+	void update();
+
+	/**
+	 * @brief Returns how often update() should be called while playing, in ms
+	 * 
+	 * Refilling twice per buffer leaves the time of half a buffer as
+	 * headroom against underruns.
+	 */
+	uint16_t refillInterval();
+
+	/**
+	 * @brief Stops playback and releases timer1 and the buzzer pin
+	 * 
+	 * Called by update() once the sample has been played, but
+	 * may also be called to abort playback early.
+	 */
+	void stop();
+
+	/**
+	 * @brief Returns the number of buffer underruns
+	 *
+	 * The counter is never reset, and thus covers all played samples.
+	 */
+	uint32_t underruns();
+
+	/**
+	 * @brief Returns the average flash read rate in bytes per second
+	 */
+	uint32_t readRate();
+
+	/**
+	 * @brief Returns the time it took from play() to the first sample in microseconds
+	 */
+	uint32_t startLatency();
+};
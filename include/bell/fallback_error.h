@@ -28,6 +28,7 @@
 
 #include <log.h>
 #include <config.h>
+#include <CrashLog.h>
 
 /**
  * @brief Bell Fallback error
@@ -46,6 +47,7 @@
 inline void FALLBACK_ERROR()
 {
 	log_msg("FALLBACK_ERROR", "Entered fallback error mode, something went horribly wrong!");
+	CrashLog::fault(CRASH_REASON_FALLBACK);
 
 	pinMode(BELL_LED, OUTPUT);
 	pinMode(BELL_BUZZER, OUTPUT);
@@ -40,6 +40,21 @@ static const note_t DEFAULT_CHIME[] = {
         NOTE_D7, NOTE_FS7, NOTE_A7
 };
 
+static const note_t URGENT_CHIME[] = {
+        NOTE_A7, NOTE_D7, NOTE_A7, NOTE_D7,
+        NOTE_A7, NOTE_D7, NOTE_A7, NOTE_D7,
+        NOTE_PAUSE, NOTE_PAUSE,
+        NOTE_A7, NOTE_D7, NOTE_A7, NOTE_D7,
+        NOTE_A7, NOTE_D7, NOTE_A7, NOTE_D7,
+        NOTE_PAUSE, NOTE_PAUSE,
+        NOTE_A7, NOTE_D7, NOTE_A7, NOTE_D7,
+        NOTE_A7, NOTE_D7, NOTE_A7, NOTE_D7
+};
+
+static const note_t TEST_CHIME[] = {
+        NOTE_A5, NOTE_A5, NOTE_PAUSE, NOTE_A6, NOTE_A6
+};
+
 static const note_t DEBUG_CHIME[] = {
         NOTE_A4, NOTE_A4, NOTE_A4,
         NOTE_PAUSE, NOTE_PAUSE, NOTE_PAUSE,
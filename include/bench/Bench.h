@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file Bench.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a registry of microbenchmarks
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#ifndef BENCH_MAX_CASES
+#define BENCH_MAX_CASES 16 // Benchmarks that can be registered
+#endif
+
+#ifndef BENCH_MAX_ITERATIONS
+#define BENCH_MAX_ITERATIONS 256 // Upper bound of the iterations per benchmark
+#endif
+
+/// Benchmarked function, called once per iteration
+typedef void (*bench_fn_t)(void *arg);
+
+/**
+ * @brief Results of a benchmark
+ */
+struct bench_result_t {
+	uint32_t iterations;
+	uint32_t min;		///< Cycles (ns on hosts without a cycle counter)
+	uint32_t median;
+	uint32_t max;
+	uint32_t allocs;	///< Heap allocations over all iterations
+};
+
+/**
+ * @brief Bench class
+ *
+ * The Bench class runs registered hot-path functions a given number of
+ * times and reports the minimum, median and maximum time per call, as
+ * well as the heap allocations per call.
+ *
+ * Times are measured in CPU cycles, through ESP.getCycleCount() on the
+ * device and rdtsc on x86 hosts (std::chrono::steady_clock in ns elsewhere).
+ * The time of an empty call is measured first and subtracted.
+ *
+ * Heap allocations are counted by wrapping malloc(), calloc() and realloc()
+ * at link time (-Wl,--wrap=malloc, see the nodemcuv2_bench environment).
+ * Without the wrap, and on host builds, zero allocations are reported.
+ *
+ * Results are printed as CSV lines prefixed with "BENCH," so they can be
+ * extracted from the serial output (stdout on host builds):
+ *
+ * 	BENCH,name,iterations,min,median,max,allocs_per_call
+ *
+ * As there is only one registry, the class is implemented with
+ * static members only.
+ */
+class Bench {
+private:
+	struct bench_case_t {
+		const char *name;
+		bench_fn_t fn;
+		void *arg;
+	};
+
+	inline static bench_case_t cases[BENCH_MAX_CASES];
+	inline static uint8_t n_cases = 0;
+	inline static uint32_t samples[BENCH_MAX_ITERATIONS];
+
+	/**
+	 * @brief Empty benchmark, used to measure the overhead of a call
+	 */
+	static void nop(void *arg);
+
+	/**
+	 * @brief Runs a single benchmark
+	 * @param overhead Cycles subtracted from every sample
+	 */
+	static bench_result_t measure(bench_fn_t fn, void *arg, uint32_t iterations, uint32_t overhead);
+
+public:
+	inline static volatile uint32_t n_allocs = 0; ///< Counted by the malloc wrappers
+
+	/**
+	 * @brief Returns the current cycle count
+	 */
+	static uint32_t cycles();
+
+	/**
+	 * @brief Registers a benchmark
+	 *
+	 * @param name Name of the benchmark, must outlive the registry (ex. a string literal)
+	 * @param fn Function to benchmark
+	 * @param arg Argument passed to fn
+	 */
+	static void add(const char *name, bench_fn_t fn, void *arg = NULL);
+
+	/**
+	 * @brief Runs all registered benchmarks and prints their results
+	 * @param iterations Calls per benchmark, capped at BENCH_MAX_ITERATIONS
+	 */
+	static void run(uint32_t iterations);
+};
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file pure_cases.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides the benchmarks that don't depend on the hardware
+ */
+
+/* The cases below only run code without side effects on the hardware,
+ * so they are registered by the bench firmware (See Main_Bench.cpp) as
+ * well as by the host runner (See Main_BenchHost.cpp). Numbers of the
+ * host don't carry over to the ESP8266, but show regressions right away.
+ */
+
+#pragma once
+
+#include <QuantileSketch.h>
+#include <ring_msg.h>
+
+#include <bench/Bench.h>
+
+static uint8_t bench_tlv_pkt[RING_MSG_MAX_LEN];
+static size_t bench_tlv_len;
+static quantile_sketch_t bench_sketch;
+static volatile uintptr_t bench_sink; // Keeps the results of inlined cases from being optimized out
+
+/**
+ * @brief Validates a ring message and looks up its TLVs, as RingReceiver::parse() does
+ */
+static void bench_ring_tlv(void *arg)
+{
+	ring_class cls;
+	uint8_t vlen;
+
+	if (!ring_msg_tlvs_valid(bench_tlv_pkt, bench_tlv_len) || !ring_msg_class(bench_tlv_pkt[0], &cls))
+		return;
+
+	bench_sink += cls;
+	bench_sink += (uintptr_t)ring_msg_tlv(bench_tlv_pkt, bench_tlv_len, RING_TLV_START_AT, &vlen);
+	bench_sink += (uintptr_t)ring_msg_tlv(bench_tlv_pkt, bench_tlv_len, RING_TLV_TRACE, &vlen);
+	bench_sink += (uintptr_t)ring_msg_tlv(bench_tlv_pkt, bench_tlv_len, RING_TLV_SEQ, &vlen);
+	bench_sink += (uintptr_t)ring_msg_tlv(bench_tlv_pkt, bench_tlv_len, RING_TLV_CRASH, &vlen);
+}
+
+/**
+ * @brief Adds a latency to a sketch, spread over the buckets
+ */
+static void bench_sketch_add(void *arg)
+{
+	static uint32_t v;
+
+	v = (v + 7919) % 100000;
+	QuantileSketch::add(bench_sketch, v);
+}
+
+/**
+ * @brief Registers the benchmarks that don't depend on the hardware
+ */
+static void bench_add_pure_cases()
+{
+	// A ring message as sent by a synced door
+	uint32_t start_at = 0;
+	ring_trace_t trace = {};
+	uint16_t seq = 0;
+
+	bench_tlv_pkt[0] = RING_MSG;
+	bench_tlv_len = 1;
+	ring_msg_add_tlv(bench_tlv_pkt, &bench_tlv_len, RING_TLV_START_AT, &start_at, sizeof(start_at));
+	ring_msg_add_tlv(bench_tlv_pkt, &bench_tlv_len, RING_TLV_TRACE, &trace, sizeof(trace));
+	ring_msg_add_tlv(bench_tlv_pkt, &bench_tlv_len, RING_TLV_SEQ, &seq, sizeof(seq));
+
+	Bench::add("ring_msg_tlv", &bench_ring_tlv);
+	Bench::add("QuantileSketch::add", &bench_sketch_add);
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file Clock.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a wrap-safe monotonic clock and deadlines
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/// Monotonic time in ms since boot
+typedef uint64_t clock_ms_t;
+
+#ifndef ARDUINO
+/// Time source of host builds, returns the time since boot in us
+typedef uint64_t (*clock_source_t)();
+#endif
+
+/**
+ * @brief Clock class
+ * 
+ * millis() wraps around after ~49.7 days, which breaks any comparison of
+ * the form millis() >= tstamp. As bells are expected to run for months,
+ * all timing in the firmware is based on this 64-bit monotonic clock
+ * instead, which won't wrap for several hundred million years.
+ * 
+ * The clock is derived from micros64() of the ESP8266 core, which
+ * extends the 32-bit system timer by itself, so it needn't be polled
+ * regularly.
+ * 
+ * On host builds (ex. the native tests), the time is instead taken from
+ * a source set through source(), so tests can move time along at will.
+ * 
+ * Similarly to the Scheduler, the Clock is implemented with static
+ * members only.
+ */
+class Clock {
+#ifndef ARDUINO
+private:
+	inline static clock_source_t src = NULL;
+
+#endif
+public:
+	/**
+	 * @brief Returns the time since boot in ms
+	 */
+	static clock_ms_t now();
+
+	/**
+	 * @brief Returns the time since boot in us
+	 */
+	static uint64_t nowUs();
+
+#ifndef ARDUINO
+	/**
+	 * @brief Sets the time source of host builds
+	 * @param fn Returns the time since boot in us, the clock stands at 0 if NULL
+	 */
+	static void source(clock_source_t fn);
+#endif
+};
+
+/**
+ * @brief A point in time something is due at
+ * 
+ * Deadlines replace the "tstamp = millis() + interval" pattern. A
+ * default constructed deadline is expired right away.
+ */
+class Deadline {
+private:
+	clock_ms_t at = 0;
+
+public:
+	/**
+	 * @brief Sets the deadline to a given time from now
+	 * @param ms Time from now in ms
+	 */
+	void in(clock_ms_t ms);
+
+	/**
+	 * @brief Moves the deadline further by a given time
+	 * 
+	 * Unlike in(), the deadline is advanced from its previous value,
+	 * so periodic deadlines don't drift. If the deadline has fallen
+	 * behind by a full period (ex. after a long stall), it is set
+	 * from now instead.
+	 * 
+	 * @param ms Period in ms
+	 */
+	void advance(clock_ms_t ms);
+
+	/**
+	 * @brief Returns true if the deadline has passed
+	 */
+	bool expired() const;
+
+	/**
+	 * @brief Returns the time remaining until the deadline in ms
+	 * 
+	 * @returns The remaining time, 0 if the deadline has passed
+	 */
+	clock_ms_t remaining() const;
+
+	/**
+	 * @brief Returns the time of the deadline (see Clock::now())
+	 */
+	clock_ms_t time() const;
+};
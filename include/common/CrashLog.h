@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file CrashLog.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a crash record that persists across resets
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#define CRASH_N_STATES 4	// State machine states kept in the record
+#define CRASH_STACK_WORDS 4	// Code addresses found on the stack kept in the record
+
+#define CRASH_REASON_FALLBACK 0x80 // FALLBACK_ERROR(), the other reasons are the REASON_* of the SDK
+#define CRASH_REASON_HEAP 0x81 // Deliberate reboot under memory pressure (See HeapMonitor.h)
+
+/**
+ * @brief Crash record
+ * 
+ * Packed, as it is also sent to the bells (See RING_TLV_CRASH in ring_msg.h).
+ */
+struct __attribute__((packed)) crash_record_t {
+	uint8_t reason;				///< Reset reason (REASON_* of user_interface.h or CRASH_REASON_FALLBACK)
+	uint8_t exccause;			///< Exception cause
+	uint8_t comp;				///< Component running in the main loop (See LoopProfiler.h)
+	uint8_t states[CRASH_N_STATES];		///< Last states of the main state machine, most recent first
+	uint32_t epc1;				///< Program counter of the exception
+	uint32_t excvaddr;			///< Address that caused the exception
+	uint32_t uptime_ms;			///< Time since boot
+	uint32_t stack[CRASH_STACK_WORDS];	///< Code addresses on the stack, most recent first (0 = none)
+};
+
+/**
+ * @brief Saves a crash record
+ * 
+ * Called from the crash handler, see CrashLog::begin().
+ * 
+ * @param rec The crash record
+ */
+typedef void (*crash_save_t)(const crash_record_t &rec);
+
+/**
+ * @brief CrashLog class
+ * 
+ * Exceptions and watchdog resets usually leave no trace, as the log is
+ * lost with the reset. The CrashLog captures a compact crash record from
+ * within the crash handler of the ESP8266 core, including the exception
+ * cause and address, the last states of the main state machine and a
+ * short excerpt of the code addresses found on the stack (which can be
+ * decoded with addr2line). Calls of FALLBACK_ERROR() are recorded as well.
+ * 
+ * The record is kept in the RTC memory, which survives resets, and is
+ * picked up on the next boot. Hardware watchdog resets don't run the
+ * crash handler, so only their reset reason is recorded. Brownouts can't
+ * be told apart from a regular power-on.
+ * 
+ * As the door loses power right after a crash, the RTC memory doesn't
+ * help there. The door therefore passes a save callback, which writes
+ * the record to flash (See DoorStore.h).
+ * 
+ * Similarly to the Scheduler, the CrashLog only exists once and is
+ * therefore implemented with static members only.
+ */
+class CrashLog {
+private:
+	inline static crash_record_t cur;	///< Record being built while running
+	inline static crash_record_t prev;	///< Record of the last reset
+	inline static bool crashed;
+	inline static crash_save_t save;
+
+	/**
+	 * @brief Stores the current record in RTC memory and passes it to the save callback
+	 */
+	static void store();
+
+public:
+	/**
+	 * @brief Picks up the record of the last reset and installs the crash handler
+	 * 
+	 * Should be called as early as possible.
+	 * 
+	 * @param save_cb Called with the record from within the crash handler (optional)
+	 */
+	static void begin(crash_save_t save_cb = NULL);
+
+	/**
+	 * @brief Records a state transition of the main state machine
+	 */
+	static void state(uint8_t s);
+
+	/**
+	 * @brief Records a fatal error that is handled without a reset
+	 * 
+	 * @param reason The reason to record (ex. CRASH_REASON_FALLBACK)
+	 */
+	static void fault(uint8_t reason);
+
+	/**
+	 * @brief Fills in and stores the crash record
+	 * 
+	 * Called by custom_crash_callback() of the ESP8266 core,
+	 * must not be called otherwise.
+	 */
+	static void capture(uint32_t reason, uint32_t exccause, uint32_t epc1, uint32_t excvaddr,
+			    uint32_t stack, uint32_t stack_end);
+
+	/**
+	 * @brief Returns the record of the last reset
+	 * 
+	 * @returns The record, or NULL if the last reset wasn't caused by a crash
+	 */
+	static const crash_record_t *last();
+
+	/**
+	 * @brief Returns a one line description of a crash record
+	 */
+	static String describe(const crash_record_t &rec);
+};
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file EspNow.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief EspNow class
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#define ESPNOW_MAX_HANDLERS 4
+
+/**
+ * @brief Handler for received ESP-NOW frames
+ * @param mac The MAC of the sender
+ * @param data The frame, starting with its magic byte
+ * @param len The length of the frame
+ */
+typedef void (*espnow_frame_handler_t)(const uint8_t *mac, const uint8_t *data, uint8_t len);
+
+/**
+ * @brief Handler for completed ESP-NOW transmissions
+ * @param ok true If the frame has been transmitted
+ */
+typedef void (*espnow_sent_handler_t)(bool ok);
+
+/**
+ * @brief EspNow class
+ * 
+ * The SDK only accepts a single receive and a single send callback for
+ * ESP-NOW. The EspNow class owns them, broadcasts frames on behalf of
+ * its users (See MeshRing.h and SyncClock.h), and dispatches received
+ * frames by their first byte (magic) to the handler registered for it.
+ * 
+ * All frames are broadcast on the channel of the station connection.
+ * 
+ * As the ESP-NOW callbacks don't take a user argument, the EspNow
+ * class is implemented with static members only.
+ */
+class EspNow {
+private:
+	inline static bool running;
+	inline static uint8_t n_handlers;
+	inline static uint8_t magic[ESPNOW_MAX_HANDLERS];
+	inline static espnow_frame_handler_t handlers[ESPNOW_MAX_HANDLERS];
+	inline static espnow_sent_handler_t sent_handler;
+	inline static unsigned long tx_at;	///< Last broadcast() call (see micros())
+	inline static uint32_t tx_us;		///< Average transmission latency
+
+	/**
+	 * @brief ESP-NOW receive callback, dispatches frames by their magic byte
+	 */
+	static void on_recv(uint8_t *mac, uint8_t *data, uint8_t len);
+
+	/**
+	 * @brief ESP-NOW send callback
+	 */
+	static void on_sent(uint8_t *mac, uint8_t status);
+
+public:
+	/**
+	 * @brief Starts ESP-NOW
+	 * 
+	 * Must be called once the WiFi mode has been set (ie. after
+	 * WiFiHandler::connect()). Further calls do nothing.
+	 * 
+	 * @returns true If ESP-NOW is running
+	 */
+	static bool begin();
+
+	/**
+	 * @brief Re-adds the broadcast peer on the current channel
+	 * 
+	 * The channel of the station is only known once it has connected,
+	 * so this must be called after every (re)connect. Does nothing if
+	 * ESP-NOW hasn't been started.
+	 */
+	static void rejoin();
+
+	/**
+	 * @brief Registers a handler for received frames
+	 * 
+	 * @param magic The first byte of the frames to handle
+	 * @param handler The handler, called from within the SDK callback
+	 * @returns true If the handler has been registered
+	 */
+	static bool onFrame(uint8_t magic, espnow_frame_handler_t handler);
+
+	/**
+	 * @brief Registers the handler for completed transmissions
+	 * 
+	 * Only a single handler is supported, it is called for
+	 * every frame sent.
+	 */
+	static void onSent(espnow_sent_handler_t handler);
+
+	/**
+	 * @brief Broadcasts a frame
+	 * 
+	 * @param data The frame, starting with its magic byte
+	 * @param len The length of the frame (max. 250 bytes)
+	 * @returns true If the frame has been queued for transmission
+	 */
+	static bool broadcast(const void *data, uint8_t len);
+
+	/**
+	 * @brief Returns the average transmission latency in us
+	 * 
+	 * The time from broadcast() to the transmission being complete,
+	 * which includes waiting for the channel and the air time.
+	 * Receivers of a time stamped frame add it to the time stamp.
+	 */
+	static uint32_t txLatency();
+};
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file EventTrace.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a ring buffer of timestamped events
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#include <config.h>
+
+#ifndef EVENT_TRACE_LEN
+#define EVENT_TRACE_LEN 256 // Events kept, 8 bytes each
+#endif
+
+/// Event types, see the EVT() calls for the meaning of the arguments
+enum evt_type : uint8_t {
+	EVT_STATE,	///< State transition (a: new state)
+	EVT_CONNECT,	///< RingTX connecting (a: host ID of the bell)
+	EVT_CONNECTED,	///< RingTX connected (a: host ID)
+	EVT_SENT,	///< RingTX handed the ring message to TCP (a: host ID, b: message)
+	EVT_ACK,	///< RingTX ring message acknowledged by TCP (a: host ID)
+	EVT_TX_FAIL,	///< RingTX timed out (a: host ID)
+	EVT_RX,		///< Ring message parsed (a: ring class, b: length)
+	EVT_RX_INVALID,	///< Invalid packet received (b: length)
+	EVT_NOTE,	///< Note played (a: note index or 0xFF for samples, b: frequency, 0 = silence)
+	EVT_LED,	///< LED edges (a: 1 = set, 0 = clear, b: GPIO mask)
+	EVT_TRACE,	///< Trace point of a host build (a: trace_point, b: level, See trace.h)
+	EVT_N
+};
+
+/// Recorded event
+struct evt_t {
+	uint32_t us;	///< See micros(), Clock::nowUs() on host builds
+	evt_type type;
+	uint8_t a;
+	uint16_t b;
+};
+
+/// Returns the name of a state of the main state machine
+typedef const char *(*evt_state_name_fn_t)(uint8_t state, void *arg);
+
+/**
+ * @brief EventTrace class
+ *
+ * The EventTrace records timestamped events (state transitions, connects,
+ * acks, parsed messages, notes and LED edges) into a fixed ring buffer in
+ * RAM, overwriting the oldest events once full. Recording an event only
+ * takes a few stores, so it can be left in while measuring latencies.
+ *
+ * Events are recorded through the EVT() macro, which compiles to nothing
+ * unless USE_EVENT_TRACE is set in config.h. Apart from begin(), the
+ * class is only compiled in if USE_EVENT_TRACE is set. Recording isn't interrupt
+ * safe, events must therefore not be recorded from ISRs.
+ *
+ * The trace is dumped as text lines (See line()), which the door prints
+ * over serial before powering off, and bells serve over TCP (See
+ * MetricsServer.h). tools/evtrace2chrome.py converts the dumps of several
+ * devices into a single Chrome trace, which can be opened in Perfetto
+ * (ui.perfetto.dev) or chrome://tracing.
+ *
+ * On host builds (ARDUINO undefined), events are timestamped through the
+ * Clock and the dump is printed to stdout, so the trace can be tested
+ * natively (See test/test_event_trace).
+ *
+ * Similarly to the Scheduler, the EventTrace only exists once and is
+ * therefore implemented with static members only.
+ */
+class EventTrace {
+private:
+	inline static const char *device = "";
+	inline static evt_state_name_fn_t state_name = NULL;
+	inline static void *state_arg = NULL;
+	inline static uint8_t n_states = 0;
+
+	inline static uint16_t head;	///< Next slot to write
+	inline static uint16_t n;	///< Events in the buffer
+	inline static uint32_t n_lost;	///< Events overwritten
+	inline static bool held;
+
+public:
+	/**
+	 * @brief Names the device and its states in the dump
+	 *
+	 * @param dev Name of the device (ex. "door"), must remain valid
+	 * @param n_states Number of states of the main state machine
+	 * @param fn Callback returning the name of a state
+	 * @param arg Argument passed to the callback
+	 */
+	static void begin(const char *dev, uint8_t n_states, evt_state_name_fn_t fn, void *arg);
+
+	/**
+	 * @brief Records an event, use EVT() instead
+	 */
+	static void record(evt_type type, uint8_t a, uint16_t b);
+
+	/**
+	 * @brief Stops recording, so the trace can be dumped consistently
+	 * @param hold False resumes recording
+	 */
+	static void hold(bool hold);
+
+	/**
+	 * @brief Returns the number of lines of the dump
+	 */
+	static uint16_t lines();
+
+	/**
+	 * @brief Formats a line of the dump
+	 *
+	 * The dump consists of the following CSV lines:
+	 * 	EVT_BEGIN,<device>,<events>,<lost events>
+	 * 	EVT_STATE,<state>,<name>	(once per state)
+	 * 	EVT,<us>,<type>,<a>,<b>		(once per event, oldest first)
+	 * 	EVT_END
+	 *
+	 * @param i Index of the line
+	 * @param buf Buffer to write the line to, including the newline
+	 * @param len Size of the buffer
+	 */
+	static void line(uint16_t i, char *buf, size_t len);
+
+	/**
+	 * @brief Prints the dump over serial (stdout on host builds)
+	 */
+	static void dump();
+};
+
+#ifdef USE_EVENT_TRACE
+#define EVT(TYPE, A, B) EventTrace::record(TYPE, A, B)
+#else
+#define EVT(TYPE, A, B)
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file HeapMonitor.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a class for tracking heap and stack usage
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <Scheduler.h>
+
+/**
+ * @brief Heap and stack statistics
+ */
+struct heap_stats_t {
+	uint32_t free;			///< Free heap at the last sample
+	uint32_t free_min;		///< Lowest free heap seen
+	uint32_t max_block;		///< Largest free block at the last sample
+	uint32_t max_block_min;		///< Smallest largest free block seen
+	uint32_t frag;			///< Fragmentation at the last sample in %
+	uint32_t frag_max;		///< Highest fragmentation seen in %
+	uint32_t stack_free_min;	///< Stack high-water mark, the least free stack of the main loop seen
+	uint32_t samples;		///< Samples taken
+	uint32_t alerts;		///< Times the fragmentation crossed the alert threshold
+};
+
+/**
+ * @brief HeapMonitor class
+ *
+ * Long-running devices slowly fragment the heap, as Strings and
+ * TCP clients of varying sizes are allocated and freed. Eventually,
+ * the largest free block is too small for AsyncTCP, and connections
+ * fail although plenty of heap is left.
+ *
+ * The HeapMonitor samples the free heap, the largest free block, the
+ * fragmentation and the free stack of the main loop through the
+ * Scheduler, and keeps the extremes seen since boot.
+ *
+ * If the fragmentation crosses the alert threshold, an alert is logged
+ * and counted. The alert re-arms once the fragmentation has fallen
+ * 10 points below the threshold. If the largest free block falls below
+ * the minimum block size, pressure() returns true, upon which the
+ * device should reboot at a convenient time (ie. between rings).
+ *
+ * Similarly to the Scheduler, the HeapMonitor only exists once and is
+ * therefore implemented with static members only.
+ */
+class HeapMonitor {
+private:
+	inline static heap_stats_t stat;
+	inline static uint16_t interval_ms;
+	inline static uint8_t frag_alert;
+	inline static uint32_t min_block;
+	inline static bool alerted;
+	inline static sched_task_t task;
+
+	/**
+	 * @brief Scheduler callback, takes a sample and reschedules itself
+	 */
+	static void on_sample(void *arg);
+
+public:
+	/**
+	 * @brief Starts sampling
+	 *
+	 * @param interval_ms Time between samples
+	 * @param frag_alert Fragmentation in % above which an alert is raised
+	 * @param min_block Largest free block in bytes below which pressure() returns true
+	 */
+	static void begin(uint16_t interval_ms, uint8_t frag_alert, uint32_t min_block);
+
+	/**
+	 * @brief Takes a sample right away
+	 */
+	static void sample();
+
+	/**
+	 * @brief Returns if the heap is under pressure
+	 *
+	 * @returns true If the largest free block has fallen below the
+	 * 	    minimum block size in the last sample
+	 */
+	static bool pressure();
+
+	/**
+	 * @brief Returns the heap and stack statistics
+	 */
+	static const heap_stats_t &stats();
+};
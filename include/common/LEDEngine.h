@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file LEDEngine.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a timer driven engine to play LED patterns
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <Ticker.h>
+
+#include <Clock.h>
+#include <LEDPattern.h>
+
+#ifndef LED_ENGINE_MAX_LEDS
+#define LED_ENGINE_MAX_LEDS 4
+#endif
+
+// Edges due within this window are written together
+#define LED_ENGINE_BATCH_MS 2
+
+/// Called once a pattern has played its requested number of repetitions
+typedef void (*led_callback_t)(void *arg);
+
+/**
+ * @brief LEDEngine class
+ * 
+ * The LEDEngine plays LED patterns (see LEDPattern.h) on up to
+ * LED_ENGINE_MAX_LEDS LEDs, driven by a single SDK timer. Rather
+ * than polling the LEDs in every loop iteration, the timer is armed
+ * for the next edge of all LEDs, leaving the CPU idle in between.
+ * 
+ * Edges of different LEDs that are due at (roughly) the same time
+ * are batched into a single write of the GPIO set/clear registers,
+ * which also keeps alternating LEDs in phase.
+ * 
+ * Similarly to the RingReceiver, the LEDEngine only exists once
+ * and is therefore implemented with static members only. LEDs are
+ * addressed through channels returned by attach().
+ * 
+ * @attention Callbacks are invoked from the timer context, keep them short!
+ */
+class LEDEngine {
+private:
+	struct channel {
+		uint8_t pin;
+		bool used;
+		bool running;
+		bool pwm;
+		const led_step_t *steps;
+		uint8_t n_steps;
+		uint8_t step;
+		uint16_t count;
+		uint16_t reps;
+		uint16_t interval;
+		Deadline deadline;
+		led_callback_t cb;
+		void *cb_arg;
+	};
+
+	inline static channel ch[LED_ENGINE_MAX_LEDS];
+	inline static Ticker ticker;
+
+	/**
+	 * @brief Returns the duration of the current step of a channel
+	 */
+	static uint16_t duration(channel &c);
+
+	/**
+	 * @brief Sets the level of a channel
+	 * 
+	 * Fully on and off levels are only collected in the set/clear
+	 * masks and written by flush(), other levels are output via PWM
+	 * right away.
+	 */
+	static void level(channel &c, uint8_t lvl, uint32_t *set, uint32_t *clr);
+
+	/**
+	 * @brief Writes the collected set/clear masks to the GPIO registers
+	 */
+	static void flush(uint32_t set, uint32_t clr);
+
+	/**
+	 * @brief Arms the timer for the next edge of all running channels
+	 */
+	static void arm();
+
+	/**
+	 * @brief Timer callback, advances all channels that are due
+	 */
+	static void tick();
+
+public:
+	/**
+	 * @brief Attaches an LED to the engine
+	 * 
+	 * If the pin has already been attached, its channel is returned.
+	 * 
+	 * @param pin The pin the LED is connected to
+	 * @returns The channel of the LED, or -1 if all channels are in use
+	 */
+	static int8_t attach(uint8_t pin);
+
+	/**
+	 * @brief Sets a constant level, stopping any pattern on the channel
+	 * @param c The channel
+	 * @param lvl The brightness level
+	 */
+	static void set(int8_t c, uint8_t lvl);
+
+	/**
+	 * @brief Plays a pattern on a channel
+	 * 
+	 * The first step is applied immediately. Once the pattern has been played
+	 * count times, the LED is turned off and the callback is invoked.
+	 * 
+	 * @param c The channel
+	 * @param p The pattern to play
+	 * @param interval Duration of steps that don't specify one, in ms
+	 * @param count Number of repetitions (0 = forever)
+	 * @param cb Callback invoked once all repetitions have been played (optional)
+	 * @param arg Argument passed to the callback
+	 */
+	static void play(int8_t c, const led_pattern_t &p, uint16_t interval,
+			 uint16_t count = 0, led_callback_t cb = NULL, void *arg = NULL);
+
+	/**
+	 * @brief Sets the duration of steps that don't specify one
+	 * 
+	 * Takes effect with the next step.
+	 */
+	static void setInterval(int8_t c, uint16_t interval);
+
+	/**
+	 * @brief Returns how many times the pattern has been played on a channel
+	 */
+	static uint16_t repetitions(int8_t c);
+};
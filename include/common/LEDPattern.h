@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file LEDPattern.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides LED pattern tables for the LEDEngine
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#define LED_LEVEL_OFF 0
+#define LED_LEVEL_ON 255
+
+/**
+ * @brief A single step of an LED pattern
+ * 
+ * Each step sets the LED to a brightness level and holds it for the given
+ * duration. Levels between LED_LEVEL_OFF and LED_LEVEL_ON are output via PWM.
+ * A duration of 0 uses the blink interval of the LED, which allows the same
+ * table to be played at different speeds.
+ */
+struct led_step_t {
+	uint8_t level;	///< Brightness (0 = off, 255 = fully on)
+	uint16_t ms;	///< Duration in ms (0 = blink interval of the LED)
+};
+
+/**
+ * @brief An LED pattern
+ * 
+ * A pattern is a table of steps which is played from start to end,
+ * repeatedly, until the requested number of repetitions has been played.
+ */
+struct led_pattern_t {
+	const led_step_t *steps;
+	uint8_t n_steps;
+};
+
+#define LED_PATTERN(STEPS) { STEPS, sizeof(STEPS) / sizeof(led_step_t) }
+
+/// ON then OFF
+static const led_step_t LED_STEPS_BLINK[] = {
+	{ LED_LEVEL_ON, 0 }, { LED_LEVEL_OFF, 0 }
+};
+
+/// OFF then ON, for alternating blinks between two LEDs
+static const led_step_t LED_STEPS_BLINK_INV[] = {
+	{ LED_LEVEL_OFF, 0 }, { LED_LEVEL_ON, 0 }
+};
+
+/// Two short blinks followed by a pause
+static const led_step_t LED_STEPS_DOUBLE_BLINK[] = {
+	{ LED_LEVEL_ON, 100 }, { LED_LEVEL_OFF, 100 },
+	{ LED_LEVEL_ON, 100 }, { LED_LEVEL_OFF, 700 }
+};
+
+/// Slowly fades in and out
+static const led_step_t LED_STEPS_BREATHE[] = {
+	{ 0, 80 },   { 2, 80 },   { 8, 80 },   { 18, 80 },
+	{ 32, 80 },  { 50, 80 },  { 72, 80 },  { 98, 80 },
+	{ 128, 80 }, { 162, 80 }, { 200, 80 }, { 255, 160 },
+	{ 200, 80 }, { 162, 80 }, { 128, 80 }, { 98, 80 },
+	{ 72, 80 },  { 50, 80 },  { 32, 80 },  { 18, 80 },
+	{ 8, 80 },   { 2, 80 },   { 0, 400 }
+};
+
+static const led_pattern_t LED_PATTERN_BLINK = LED_PATTERN(LED_STEPS_BLINK);
+static const led_pattern_t LED_PATTERN_BLINK_INV = LED_PATTERN(LED_STEPS_BLINK_INV);
+static const led_pattern_t LED_PATTERN_DOUBLE_BLINK = LED_PATTERN(LED_STEPS_DOUBLE_BLINK);
+static const led_pattern_t LED_PATTERN_BREATHE = LED_PATTERN(LED_STEPS_BREATHE);
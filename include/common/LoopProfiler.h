@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file LoopProfiler.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a main loop profiler and stall watchdog
+ */
+
+#pragma once
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stddef.h>
+
+#define IRAM_ATTR // Not needed on host builds
+#endif
+
+#include <QuantileSketch.h>
+
+/// Components the time of the main loop is attributed to
+enum prof_component : uint8_t {
+	PROF_MAIN,		///< State machine of the Bell or Door and its tasks
+	PROF_WIFI,		///< WiFiHandler
+	PROF_BUZZER,		///< Buzzer, including sample refills
+	PROF_LED,		///< LEDEngine
+	PROF_RING_SENDER,	///< RingSender
+	PROF_NET,		///< Discovery, relaying, mesh and time sync
+	PROF_OTHER,		///< Tasks that haven't been assigned a component
+	PROF_N
+};
+
+/**
+ * @brief Loop profiler statistics
+ */
+struct prof_stats_t {
+	uint32_t iterations;		///< Main loop iterations
+	uint32_t loop_us;		///< Duration of the last iteration
+	uint32_t loop_max_us;		///< Longest iteration
+	uint32_t gap_max_us;		///< Longest time between iterations, beyond the planned idle time
+	uint32_t comp_us[PROF_N];	///< Time spent per component (wraps)
+	uint32_t comp_max_us[PROF_N];	///< Longest single run per component
+	uint32_t log_us;		///< Time spent writing log messages, included in the above (wraps)
+	uint32_t stalls;		///< Iterations that tripped the stall watchdog
+};
+
+/**
+ * @brief Context captured by the stall watchdog
+ */
+struct prof_stall_t {
+	prof_component comp;	///< Component running when the watchdog tripped
+	uint8_t state;		///< State of the main state machine
+	uint32_t at_ms;		///< Time the watchdog tripped (see millis())
+	uint32_t dur_ms;	///< Duration of the stalled iteration
+};
+
+/// Marks the start of a profiled section, see LoopProfiler::enter()
+struct prof_mark_t {
+	prof_component prev;
+	uint32_t start_us;
+};
+
+#ifndef ARDUINO
+/// Called with the planned idle time of host builds, see LoopProfiler::onIdle()
+typedef void (*prof_idle_hook_t)(uint32_t ms);
+#endif
+
+/**
+ * @brief LoopProfiler class
+ * 
+ * When a chime stutters or a ring is delayed, the main loop was most
+ * likely blocked, be it by a component, logging over Serial or the SDK.
+ * The LoopProfiler records the duration of each iteration of the main
+ * loop (ie. Bell::run() or Door::run()), as well as the time between
+ * iterations beyond the time the Scheduler planned to idle, which is
+ * time taken by the SDK (WiFi, TCP callbacks, timers).
+ * 
+ * The Scheduler attributes the run time of each task to the component
+ * it belongs to (see sched_task_t), the state machines attribute their
+ * own time to PROF_MAIN. Nested sections count towards both components.
+ * 
+ * The stall watchdog trips if an iteration takes longer than the stall
+ * threshold. As a blocked loop doesn't run any SDK timers, it is driven
+ * by the timer0 interrupt, which is armed at the start of each iteration.
+ * The component and state the loop was stuck in are captured from within
+ * the interrupt, and logged once the iteration has finished. The hardware
+ * watchdog still resets the device if the loop never returns.
+ * 
+ * On host builds (ex. the native tests), nothing is profiled. Sections
+ * are ignored, and the planned idle time is only passed on to the hook
+ * set through onIdle(), so tests can move time along at will.
+ * 
+ * Similarly to the Scheduler, the LoopProfiler only exists once and is
+ * therefore implemented with static members only.
+ * 
+ * @attention timer0 must not be used elsewhere
+ */
+class LoopProfiler {
+private:
+	inline static prof_stats_t stat;
+	inline static quantile_sketch_t loop_sketch;
+	inline static prof_stall_t stall;
+
+	inline static uint32_t stall_us;
+	inline static bool running;
+	inline static uint32_t end_us;
+	inline static uint32_t idle_us;
+
+	// State shared with the interrupt routine
+	inline static volatile bool busy;
+	inline static volatile bool tripped;
+	inline static volatile uint32_t iter_us;
+	inline static volatile uint8_t iter_state;
+	inline static volatile prof_component cur = PROF_OTHER;
+
+	/**
+	 * @brief Timer0 interrupt routine, checks for a stalled iteration
+	 * 
+	 * Re-arms itself if the iteration has been running for less than
+	 * the stall threshold.
+	 */
+	static void IRAM_ATTR on_check();
+
+	/**
+	 * @brief Arms timer0 to fire in the given time
+	 */
+	static void IRAM_ATTR arm(uint32_t us);
+
+#ifndef ARDUINO
+	inline static prof_idle_hook_t idle_hook = NULL;
+
+#endif
+public:
+	/**
+	 * @brief Starts the stall watchdog
+	 * 
+	 * Profiling works without, but no stalls are detected.
+	 * 
+	 * @param stall_ms Iterations taking longer than this are reported as stalls
+	 */
+	static void begin(uint16_t stall_ms);
+
+	/**
+	 * @brief Marks the start of a main loop iteration
+	 * @param state The current state of the main state machine
+	 */
+	static void loopStart(uint8_t state);
+
+	/**
+	 * @brief Marks the end of a main loop iteration
+	 * 
+	 * Logs the captured context if the iteration has stalled.
+	 */
+	static void loopEnd();
+
+	/**
+	 * @brief Marks the start of a section of the given component
+	 * 
+	 * @param c The component
+	 * @returns The mark to be passed to leave()
+	 */
+	static prof_mark_t enter(prof_component c);
+
+	/**
+	 * @brief Marks the end of a section, and attributes its time to the component
+	 * @param m The mark returned by enter()
+	 */
+	static void leave(const prof_mark_t &m);
+
+	/**
+	 * @brief Tells the profiler how long the loop is about to idle
+	 * 
+	 * Called by Scheduler::idle().
+	 * 
+	 * @param ms The planned idle time in ms
+	 */
+	static void idling(uint32_t ms);
+
+	/**
+	 * @brief Accounts time spent writing a log message
+	 * 
+	 * Called by log_msg().
+	 */
+	static void logged(uint32_t us);
+
+	/**
+	 * @brief Logs the time spent per component
+	 */
+	static void report();
+
+	/**
+	 * @brief Returns the component currently running
+	 */
+	static prof_component current();
+
+	/**
+	 * @brief Returns the name of a component
+	 */
+	static const char *name(prof_component c);
+
+	/**
+	 * @brief Returns the profiler statistics
+	 */
+	static const prof_stats_t &stats();
+
+	/**
+	 * @brief Returns the distribution of the iteration durations in us
+	 */
+	static const quantile_sketch_t &loopSketch();
+
+	/**
+	 * @brief Returns the context of the last stall
+	 * 
+	 * Only valid if stats().stalls > 0.
+	 */
+	static const prof_stall_t &lastStall();
+
+#ifndef ARDUINO
+	/**
+	 * @brief Sets the hook of host builds that is passed the planned idle time
+	 * @param fn Called by idling(), nothing is called if NULL
+	 */
+	static void onIdle(prof_idle_hook_t fn);
+#endif
+};
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file MeshRing.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief MeshRing class
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <config.h> // MESH_DUP_CACHE_LEN, must be the same in every translation unit
+
+#include <Clock.h>
+#include <ring_msg.h>
+#include <Scheduler.h>
+
+#define MESH_MAGIC 0xAB
+
+/**
+ * @brief Ring frame broadcast over ESP-NOW
+ */
+struct __attribute__((packed)) mesh_frame_t {
+	uint8_t magic;		///< MESH_MAGIC
+	uint8_t msg;		///< Ring message (See ring_msg.h)
+	uint8_t origin[6];	///< Station MAC of the door
+	uint16_t seq;		///< Press counter of the door
+	uint8_t hops;		///< Number of times the frame has been forwarded
+	uint32_t relay_us;	///< Time the frame spent in relays, summed over all hops
+};
+
+/**
+ * @brief Mesh statistics of a bell
+ */
+struct mesh_stats_t {
+	uint32_t rx;		///< Rings received (duplicates excluded)
+	uint32_t dups;		///< Duplicate frames suppressed
+	uint32_t foreign;	///< Frames of another origin than the door, dropped
+	uint32_t fwd;		///< Frames forwarded
+	uint32_t fwd_dropped;	///< Frames not forwarded, as a forward was still pending
+	uint32_t lost;		///< Rings missed, derived from gaps in the sequence numbers
+	uint32_t hop_us_avg;	///< Average time from receiving a frame to it being forwarded
+	uint32_t hop_us_max;	///< Maximum time from receiving a frame to it being forwarded
+	uint8_t last_hops;	///< Hops of the last received ring
+	uint32_t last_relay_us;	///< Relay time of the last received ring
+};
+
+/**
+ * @brief MeshRing class
+ * 
+ * Bells outside of the radio range of the door (or the access point)
+ * can be reached through nearer bells, by flooding rings over ESP-NOW.
+ * The door broadcasts a ring frame alongside the TCP ring messages,
+ * which every bell that hears it forwards once, until MESH_MAX_HOPS
+ * has been reached. Frames are identified by the MAC of the door and
+ * the press counter, so rings already seen are suppressed as duplicates.
+ * Bells only accept frames originating from their door, which must also
+ * be the sender of frames that haven't been forwarded yet.
+ * 
+ * To avoid neighbouring bells forwarding in the same instant, forwards
+ * are delayed by a random jitter of up to MESH_FORWARD_JITTER_MS.
+ * 
+ * Each relay adds the time a frame spent with it to the frame, so the
+ * receiving bell knows the total relay time of the ring, and measures
+ * its own per-hop latency (receive to transmission complete). The
+ * delivery ratio is derived from gaps in the press counter of the door.
+ * 
+ * ESP-NOW runs on the channel of the station connection (See EspNow.h).
+ * Since the access point doesn't buffer ESP-NOW frames for sleeping
+ * stations, bells relaying rings must keep the radio awake (WIFI_NONE_SLEEP).
+ * 
+ * As the ESP-NOW callbacks don't take a user argument, the MeshRing
+ * is implemented with static members only.
+ */
+class MeshRing {
+private:
+	/// Identifies a ring across all relays
+	struct mesh_id_t {
+		uint8_t origin[6];
+		uint16_t seq;
+	};
+
+	inline static bool running;
+	inline static uint8_t door[6];
+
+	inline static mesh_id_t cache[MESH_DUP_CACHE_LEN];
+	inline static uint8_t cache_len;
+	inline static uint8_t cache_pos;
+
+	inline static volatile bool recv;
+	inline static ring_class recv_class;
+	inline static unsigned long recv_us;
+	inline static uint16_t recv_seq;
+
+	inline static bool have_seq;
+	inline static uint16_t last_seq;
+
+	inline static mesh_frame_t fwd;
+	inline static bool fwd_pending;
+	inline static bool fwd_sending;
+	inline static unsigned long fwd_rx_us;
+	inline static sched_task_t fwd_task;
+
+	inline static mesh_stats_t stat;
+
+	/**
+	 * @brief Checks if a ring has already been seen and remembers it otherwise
+	 * @returns true If the ring is a duplicate
+	 */
+	static bool seen(const mesh_frame_t *frame);
+
+	/**
+	 * @brief Handler for received ring frames (See EspNow.h)
+	 * 
+	 * Drops frames of other origins, suppresses duplicates, hands
+	 * new rings to received() and schedules them to be forwarded.
+	 */
+	static void on_recv(const uint8_t *mac, const uint8_t *data, uint8_t len);
+
+	/**
+	 * @brief Handler for completed transmissions, measures the per-hop latency of forwards
+	 */
+	static void on_sent(bool ok);
+
+	/**
+	 * @brief Scheduler callback, forwards the pending frame
+	 * @param arg Unused
+	 */
+	static void on_forward(void *arg);
+
+public:
+	/**
+	 * @brief Starts ESP-NOW
+	 * 
+	 * Must be called once the WiFi mode has been set (ie. after
+	 * WiFiHandler::connect()).
+	 * 
+	 * @param relay If true, rings are received and forwarded (bells),
+	 * 		otherwise rings are only sent (door)
+	 * @param door_mac Station MAC of the door (ex. "AA:BB:CC:DD:EE:FF"), rings
+	 * 		   of any other origin are dropped (Only used if relay is true)
+	 * @returns true If ESP-NOW has been started
+	 */
+	static bool begin(bool relay, const char *door_mac = NULL);
+
+	/**
+	 * @brief Broadcasts a ring
+	 * 
+	 * @param msg The ring message (See ring_msg.h)
+	 * @param seq The press counter of the door
+	 * @returns true If the frame has been queued for transmission
+	 */
+	static bool send(uint8_t msg, uint16_t seq);
+
+	/**
+	 * @brief Returns if a ring has been received
+	 * 
+	 * Calling the function will reset the return value to false,
+	 * see RingReceiver::received().
+	 * 
+	 * @param cls Set to the ring class of the received ring (optional)
+	 * @returns true if a new ring has been received
+	 */
+	static bool received(ring_class *cls = NULL);
+
+	/**
+	 * @brief Returns when the last ring was received
+	 * 
+	 * @returns The time of reception in microseconds (see micros())
+	 */
+	static unsigned long receivedAt();
+
+	/**
+	 * @brief Returns the press counter of the last received ring
+	 */
+	static uint16_t receivedSeq();
+
+	/**
+	 * @brief Returns the mesh statistics
+	 */
+	static const mesh_stats_t &stats();
+
+	/**
+	 * @brief Returns the delivery ratio of rings in permille
+	 * 
+	 * Rings received over the rings sent by the door, as far as
+	 * they can be derived from the press counter.
+	 */
+	static uint16_t deliveryRatio();
+};
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file QuantileSketch.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a fixed-size streaming quantile estimator
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#define SKETCH_SUB_BITS 2				 // Buckets per power of two = 2^SKETCH_SUB_BITS
+#define SKETCH_SUB (1 << SKETCH_SUB_BITS)
+#define SKETCH_N_BUCKETS ((32 - SKETCH_SUB_BITS) * SKETCH_SUB + SKETCH_SUB) // Covers all uint32_t values
+
+/**
+ * @brief Log-bucket histogram of a stream of values
+ * 
+ * Plain data, so it can be kept in the DoorStore or sent over the network.
+ * A zeroed sketch is empty.
+ */
+struct quantile_sketch_t {
+	uint16_t counts[SKETCH_N_BUCKETS];	///< Values per bucket, halved on saturation
+	uint32_t n;				///< Values added, never halved
+	uint32_t max;				///< Largest value added
+};
+
+/**
+ * @brief QuantileSketch class
+ * 
+ * Raw samples can't be kept on an ESP8266, yet averages and maxima
+ * hide the tail we care about. The QuantileSketch estimates quantiles
+ * (ex. p50/p95/p99) of a stream of values (ex. latencies in us) in a
+ * fixed amount of memory.
+ * 
+ * Values are counted in log-spaced buckets: Each power of two is split
+ * into SKETCH_SUB buckets, so the estimated quantile is off by less
+ * than 1/SKETCH_SUB of the value (12.5% with the bucket midpoint), no
+ * matter its magnitude. Adding a value is O(1) and doesn't allocate,
+ * so it may be done from within the callbacks of the asynchronous
+ * components.
+ * 
+ * Unlike P² estimators, sketches can be merged by adding their
+ * buckets, so sketches of different devices (ex. reported by the door
+ * and measured by the bells) or periods can be combined.
+ * 
+ * Once a bucket saturates, all buckets are halved, which keeps the
+ * quantiles intact while giving recent values more weight. Halving
+ * rounds up, so buckets holding a few outliers aren't emptied.
+ * 
+ * The QuantileSketch class only holds static functions operating on
+ * quantile_sketch_t records.
+ */
+class QuantileSketch {
+private:
+	/**
+	 * @brief Returns the bucket of a value
+	 */
+	static uint8_t bucket(uint32_t v);
+
+	/**
+	 * @brief Returns the smallest value of a bucket
+	 */
+	static uint32_t lower(uint8_t i);
+
+	/**
+	 * @brief Halves all buckets
+	 */
+	static void halve(quantile_sketch_t &s);
+
+public:
+	/**
+	 * @brief Adds a value to the sketch
+	 * 
+	 * @param s The sketch
+	 * @param v The value
+	 */
+	static void add(quantile_sketch_t &s, uint32_t v);
+
+	/**
+	 * @brief Merges a sketch into another
+	 * 
+	 * Buckets are added, saturating at UINT16_MAX, while the
+	 * number of values and the largest value are combined.
+	 * 
+	 * @param dst The sketch to merge into
+	 * @param src The sketch to merge
+	 */
+	static void merge(quantile_sketch_t &dst, const quantile_sketch_t &src);
+
+	/**
+	 * @brief Estimates a quantile
+	 * 
+	 * @param s The sketch
+	 * @param permille The quantile in permille (ex. 990 for p99)
+	 * @returns The midpoint of the bucket the quantile falls in,
+	 * 	    capped to the largest value (0 if empty)
+	 */
+	static uint32_t quantile(const quantile_sketch_t &s, uint16_t permille);
+
+	/**
+	 * @brief Empties the sketch
+	 */
+	static void reset(quantile_sketch_t &s);
+};
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file RingTX.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief RingTX class
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncTCP.h>
+
+#include <Clock.h>
+#include <ring_msg.h>
+#include <Scheduler.h>
+
+#define RING_TX_MAX_TLVS 2 // TLVs that can be added through addTLV()
+
+/**
+ * @brief RingTX class
+ * 
+ * The RingTX class is used to transmitt a ring message
+ * to a single bell usign the AsyncTCP library. It further
+ * checks if the transmission was successful or not.
+ * 
+ * This class is instanced for every bell by the RingSender class
+ * of the door, as well as by the RingRelay class of a bell that
+ * hosts the access point for the door (See USE_BELL_AP).
+ */
+class RingTX {
+public:
+	/// State machine states
+	enum ring_stat {
+		UNINITIALIZED,	///< Only initialized with default constructor
+		AWAITING,	///< Awaiting send() call
+		CONNECTING,	///< Establishing TCP connection to bell
+		SENDING,	///< Sending ring message
+		SUCCESS,	///< Ring message successfully sent
+		FAIL		///< Failed to send ring message (timeout)
+	};
+
+private:
+	String ip;
+	uint8_t host = 0;	///< Last octet of the IP, identifies the bell in the event trace
+	unsigned int port;
+	uint8_t msg;
+	bool has_start_at = false;
+	uint32_t start_at;
+	uint8_t tlv_type[RING_TX_MAX_TLVS];
+	uint8_t tlv_len[RING_TX_MAX_TLVS];
+	const void *tlv_val[RING_TX_MAX_TLVS];
+	uint8_t n_tlvs = 0;
+	bool has_trace = false;
+	bool fill_trace = false;	///< Fill in the timings of the trace (See setTrace())
+	ring_trace_t trace;
+	bool has_seq = false;
+	uint16_t seq;
+	unsigned long con_us;
+	uint8_t buf[RING_MSG_MAX_LEN];	///< Message being sent, must remain valid until acknowledged
+	size_t tx_len = 0;		///< Length of the message handed to the TCP stack
+	size_t acked = 0;		///< Bytes acknowledged by the bell since send()
+	AsyncClient client;
+	unsigned long timeout;
+	Deadline deadline;
+	clock_ms_t start;
+	clock_ms_t lat_ms = 0;
+	clock_ms_t ack_ms = 0;
+	sched_task_t *notify_task = NULL;
+	
+	ring_stat stat = UNINITIALIZED;
+
+	/**
+	 * @brief Callback for established connections
+	 * 
+	 * Notifies the task passed to send(), so the connection
+	 * is handled without waiting for the next poll.
+	 */
+	static void on_connect(void *arg, AsyncClient *client);
+
+	/**
+	 * @brief Callback for acknowledged data
+	 * 
+	 * Counts the acknowledged bytes (See delivered()), takes the
+	 * time once all of the ring message has been acknowledged
+	 * (See ackLatency()) and records the ack in the event trace.
+	 */
+	static void on_ack(void *arg, AsyncClient *client, size_t len, uint32_t time);
+
+	/**
+	 * @brief Sends a TCP packet of the ring message
+	*/
+	bool txRingMSG();
+
+	/**
+	 * @brief Handles CONNECTING state
+	 * 
+	 * The following function handles the CONNECTING state.
+	 * 
+	 * If a connection to the bell is established, the SENDING
+	 * state is returned.
+	 * 
+	 * If the connection attempt times out, the FAIL state is
+	 * returned.
+	 * 
+	 * @return ring_stat The next state:
+	 * 	- CONNECTING: Attempting to connect to bell
+	 * 	- SENDING: Connection established
+	 * 	- FAIL: Connection attempt timed out
+	 */
+	ring_stat con();
+	
+	/**
+	 * @brief Handles SENDING state
+	 * 
+	 * The following function handles the SENDING state.
+	 * 
+	 * If the ring message was acknowledged, the SUCCESS
+	 * state is returned.
+	 * 
+	 * If the ring message did not receive an ACK before the
+	 * timeout, the FAIL state is returned.
+	 * 
+	 * @return ring_stat The next state:
+	 * 	- SENDING: Awaiting ACK
+	 * 	- SUCCESS: Ring message successfully acknowledged
+	 * 	- FAIL: Ring message timed out
+	 */
+	ring_stat sen();
+
+public:
+	/**
+	 * @brief Default constructor
+	 * 
+	 * The default constructor only serves to allow the class 
+	 * to be declared without immidiately initializing it. This
+	 * spares us from having to allocate the object on the heap via
+	 * a pointer, which we generally want to avoid on embedded 
+	 * systems.
+	 */
+	RingTX();
+
+	/**
+	 * @brief Constructor
+	 * @param dest_ip The IP address of the bell to ring
+	 * @param port The port of the bell to ring
+	 * @param timeout The timeout in ms for the connection and transmission to succeed
+	 * @param msg The ring message to send (See ring_msg.h)
+	 */
+	RingTX(String dest_ip, unsigned int port, unsigned long timeout_ms, uint8_t msg = RING_MSG);
+
+	/**
+	 * @brief Sends the ring message
+	 * 
+	 * The following function starts starts the transmission
+	 * sequence of the ring message. It puts the state machine
+	 * into the CONNECTING state.
+	 * 
+	 * The success of the transmission can be checked by calling
+	 * the status() function.
+	 * 
+	 * @param notify Task to notify once the connection has been established (optional)
+	 */
+	void send(sched_task_t *notify = NULL);
+
+	/**
+	 * @brief Sets the ring message sent by the next send() call
+	 * @param msg The ring message to send (See ring_msg.h)
+	 */
+	void setMessage(uint8_t msg);
+
+	/**
+	 * @brief Schedules the start of the ring tone for the next send() call
+	 * 
+	 * Adds a RING_TLV_START_AT TLV to the ring message (See SyncClock.h).
+	 * 
+	 * @param start_at The start of the ring tone in common time (us)
+	 */
+	void setStartAt(uint32_t start_at);
+
+	/**
+	 * @brief Removes the start time set by setStartAt(), the ring tone starts on reception
+	 */
+	void clearStartAt();
+
+	/**
+	 * @brief Adds a TLV to the ring message of the next send() calls
+	 * 
+	 * A TLV of the same type is replaced. The value isn't copied, and
+	 * must remain valid until the ring message has been acknowledged.
+	 * 
+	 * @param type The type of the TLV (See ring_msg.h)
+	 * @param val The value
+	 * @param len The length of the value
+	 * @returns false If RING_TX_MAX_TLVS TLVs have already been added
+	 */
+	bool addTLV(uint8_t type, const void *val, uint8_t len);
+
+	/**
+	 * @brief Adds a RING_TLV_TRACE TLV to the ring message of the next send() calls
+	 * 
+	 * The connect, send and total timings are filled in when sending (See ring_msg.h),
+	 * unless the trace is passed on as is (ex. relayed from the door).
+	 * 
+	 * @param t The trace context of the press, copied
+	 * @param fill False keeps the timings of t
+	 */
+	void setTrace(const ring_trace_t &t, bool fill = true);
+
+	/**
+	 * @brief Removes the trace context set by setTrace()
+	 */
+	void clearTrace();
+
+	/**
+	 * @brief Adds a RING_TLV_SEQ TLV to the ring message of the next send() calls
+	 * 
+	 * Lets bells that also receive the ring over ESP-NOW drop the
+	 * duplicate (See MeshRing.h).
+	 * 
+	 * @param seq The press counter of the door
+	 */
+	void setSeq(uint16_t seq);
+
+	/**
+	 * @brief Removes the press counter set by setSeq()
+	 */
+	void clearSeq();
+
+	/**
+	 * @brief Sets the timeout for the next send() call
+	 * @param timeout_ms The timeout in ms for the connection and transmission to succeed (0 = No timeout)
+	 */
+	void setTimeout(unsigned long timeout_ms);
+
+	/**
+	 * @brief Returns the time it took to deliver the ring message
+	 * 
+	 * Measured from the send() call until the ring message has been
+	 * sent, including establishing the connection.
+	 * 
+	 * @returns The latency in ms, only valid in the SUCCESS state
+	 */
+	clock_ms_t latency();
+
+	/**
+	 * @brief Returns true once the bell has acknowledged the ring message
+	 * 
+	 * The SUCCESS state only means that the TCP stack accepted the ring
+	 * message for sending. The message has reached the bell once all of
+	 * it has been acknowledged on the TCP level, which may take until
+	 * after the state machine has settled.
+	 * 
+	 * @returns true If the whole ring message of the last send() call has been acknowledged
+	 */
+	bool delivered();
+
+	/**
+	 * @brief Returns the time it took until the bell acknowledged the ring message
+	 * 
+	 * Measured from the send() call until all of the ring message has been
+	 * acknowledged on the TCP level, including establishing the connection.
+	 * 
+	 * @returns The latency in ms, only valid once delivered()
+	 */
+	clock_ms_t ackLatency();
+
+	/**
+	 * @brief Returns the current state of the state machine
+	 * 
+	 * The following function returns the current state of the
+	 * state machine. It is used to check the success of the
+	 * transmission.
+	 * 
+	 * The following states are possible:
+	 * 	- UNINITIALIZED: Only initialized with default constructor
+	 * 	- AWAITING: Awaiting send() call
+	 * 	- CONNECTING: Establishing TCP connection to bell
+	 * 	- SENDING: Sending ring message
+	 * 	- SUCCESS: Ring message successfully sent
+	 * 	- FAIL: Failed to send ring message (timeout)
+	 * 
+	 * @return ring_stat The current state of the state machine
+	 */
+	ring_stat status();
+
+	/**
+	 * @brief Updates the RingTX state machine
+	 * 
+	 * The following function updates the RingTX state machine.
+	 * Ensure that this function is called continuously!
+	 *  
+	 */
+	void update();
+};
\ No newline at end of file
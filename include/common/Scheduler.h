@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file Scheduler.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a deadline driven scheduler for the main loop
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include <Clock.h>
+#include <LoopProfiler.h>
+
+#define SCHED_TICK_MS 10	// Granularity of the timer wheel
+#define SCHED_WHEEL_SLOTS 32	// Slots of the timer wheel (horizon of SCHED_TICK_MS * SCHED_WHEEL_SLOTS)
+#define SCHED_IDLE_MAX_MS 1000	// Maximum time to idle if nothing is scheduled
+#define SCHED_IDLE_POLL_MS 5	// Interval in which idle() checks for wake() calls
+
+/// Task callback
+typedef void (*sched_callback_t)(void *arg);
+
+/**
+ * @brief A task that can be scheduled by the Scheduler
+ * 
+ * Tasks are owned by the component that schedules them
+ * (usually as a member), the Scheduler only links them
+ * into its timer wheel. A task must therefore not be
+ * copied or destroyed while it is scheduled.
+ */
+struct sched_task_t {
+	sched_callback_t cb = NULL;
+	void *arg = NULL;
+	clock_ms_t deadline = 0;
+	bool scheduled = false;
+	sched_task_t *next = NULL;
+	prof_component prof = PROF_OTHER;	///< Component the run time is attributed to (See LoopProfiler.h)
+};
+
+/**
+ * @brief Scheduler class
+ * 
+ * Rather than updating every component on every loop iteration, components
+ * schedule a task for the next point in time they need to be run at (ex.
+ * the next note of a melody, or a timeout). Tasks are kept in a hashed
+ * timer wheel, so only the slots that have become due need to be visited.
+ * 
+ * The main loop runs the due tasks through run(), and then idles until the
+ * next deadline through idle(). Event sources (ex. network callbacks) call
+ * wake() (or notify() for a specific task) to end the idle period early.
+ * 
+ * As all tasks are dispatched from run(), the Scheduler is also the place to
+ * measure the scheduling latency, that is the time between the deadline
+ * of a task and it being run, and to attribute the run time of each task
+ * to its component (See LoopProfiler.h).
+ * 
+ * Similarly to the RingReceiver, the Scheduler only exists once and is
+ * therefore implemented with static members only.
+ * 
+ * @attention wake() and notify() may be called from SDK callbacks, but no
+ * Scheduler function may be called from an interrupt.
+ */
+class Scheduler {
+private:
+	inline static sched_task_t *wheel[SCHED_WHEEL_SLOTS];
+	inline static clock_ms_t cursor;
+	inline static volatile bool woken;
+
+	inline static unsigned long lat_max;
+	inline static unsigned long lat_avg; // Scaled by 16
+
+	/**
+	 * @brief Returns the wheel slot of a deadline
+	 */
+	static uint8_t slot(clock_ms_t deadline);
+
+	/**
+	 * @brief Unlinks a task from its wheel slot
+	 */
+	static void unlink(sched_task_t *t);
+
+public:
+	/**
+	 * @brief Schedules a task
+	 * 
+	 * If the task is already scheduled, it is rescheduled.
+	 * 
+	 * @param t The task to schedule
+	 * @param delay_ms Time from now until the task is due, in ms (0 = next run())
+	 * @param cb The function to run once the task is due
+	 * @param arg Argument passed to the callback
+	 */
+	static void schedule(sched_task_t *t, unsigned long delay_ms, sched_callback_t cb, void *arg);
+
+	/**
+	 * @brief Makes an already initialized task due immediately and wakes the loop
+	 * 
+	 * Use this from event sources to run a component as soon as possible.
+	 * The task must have been scheduled at least once before, so that its
+	 * callback is known.
+	 */
+	static void notify(sched_task_t *t);
+
+	/**
+	 * @brief Removes a task from the scheduler
+	 */
+	static void cancel(sched_task_t *t);
+
+	/**
+	 * @brief Returns true if the task is scheduled
+	 */
+	static bool scheduled(sched_task_t *t);
+
+	/**
+	 * @brief Ends the current (or next) idle period early
+	 * 
+	 * Call this whenever an event occurs that the main state
+	 * machines may need to react to.
+	 */
+	static void wake();
+
+	/**
+	 * @brief Runs all due tasks
+	 * 
+	 * Must be called from the main loop.
+	 * 
+	 * @returns The number of tasks that have been run
+	 */
+	static uint8_t run();
+
+	/**
+	 * @brief Idles until the next task is due or wake() is called
+	 * 
+	 * Idling is done through esp_delay(), which lets the SDK handle
+	 * WiFi and timers, and allows the modem to sleep. On host builds,
+	 * idle() returns right away, the planned idle time is still passed
+	 * to LoopProfiler::idling().
+	 */
+	static void idle();
+
+	/**
+	 * @brief Returns the maximum scheduling latency in ms
+	 */
+	static unsigned long latencyMax();
+
+	/**
+	 * @brief Returns the average scheduling latency in ms
+	 * 
+	 * The average is exponentially weighted, favoring recent tasks.
+	 */
+	static unsigned long latencyAvg();
+};
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file StateMachine.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides a table driven state machine template
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <log.h>
+
+/**
+ * @brief Allowed next state of a state table entry (ex. SM_TO(CONNECTED) | SM_TO(ERROR))
+ */
+#define SM_TO(STATE) (1UL << (STATE))
+
+/**
+ * @brief StateMachine class template
+ *
+ * The main state machines of the Door and Bell are described by a
+ * constant table with one entry per state, holding the member function
+ * running the state and optional hooks called when entering and leaving
+ * the state. As with the hand written state machines before, each state
+ * function returns the next state.
+ *
+ * States are dispatched through member function pointers from the table,
+ * which is indexed by the state, so no virtual calls or searches are
+ * involved. The table must list the states in the order of the enum,
+ * which can be checked at compile time with ordered().
+ *
+ * Each entry further lists the states that may follow it. Transitions
+ * to any other state are logged and refused, so a state function
+ * returning a wrong state is caught on its first occurrence rather than
+ * derailing the device.
+ *
+ * The state machine keeps the number of entries and the dwell time of
+ * each state, as well as the total number of transitions, so the time
+ * spent in each state can be reported with report().
+ *
+ * The owner is passed on every step rather than being stored, so the
+ * state machine (and its owner) can be copied freely.
+ *
+ * @tparam T The class owning the state machine
+ * @tparam S The state enum, starting at 0 without gaps
+ * @tparam N The number of states, at most 32
+ */
+template <typename T, typename S, uint8_t N>
+class StateMachine {
+	static_assert(N <= 32, "Allowed next states are kept in a 32 bit mask");
+
+public:
+	/// Entry of the state table
+	struct state_t {
+		S id;			///< The state, must match the index in the table
+		S (T::*run)();		///< Runs the state and returns the next one (NULL = stay)
+		void (T::*enter)();	///< Called when entering the state (NULL = none)
+		void (T::*exit)();	///< Called when leaving the state (NULL = none)
+		const char *name;
+		uint32_t next;		///< States that may follow, see SM_TO() (0 = final state)
+	};
+
+	/// Statistics of a state
+	struct stats_t {
+		uint32_t entries;	///< Times the state has been entered
+		uint32_t last_us;	///< Duration of the last visit
+		uint32_t max_us;	///< Longest visit
+		uint64_t total_us;	///< Time spent in the state over all visits
+	};
+
+private:
+	const state_t *table = NULL;
+	S cur = S();
+	uint32_t entered_us = 0;
+	uint32_t n_transitions = 0;
+	stats_t stat[N] = {};
+
+public:
+	/**
+	 * @brief Returns true if the table lists all states in the order of the enum
+	 *
+	 * Meant for a static_assert on the table.
+	 */
+	static constexpr bool ordered(const state_t (&t)[N])
+	{
+		for (uint8_t i = 0; i < N; i++) {
+			if ((uint8_t)t[i].id != i)
+				return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Default constructor
+	 *
+	 * The default constructor only serves to allow the class
+	 * to be declared without immidiately initializing it.
+	 */
+	StateMachine() {}
+
+	/**
+	 * @brief Constructor
+	 *
+	 * The enter hook of the initial state is not called.
+	 *
+	 * @param t The state table, must remain valid
+	 * @param initial The initial state
+	 */
+	StateMachine(const state_t (&t)[N], S initial) : table(t), cur(initial)
+	{
+		entered_us = micros();
+		stat[cur].entries = 1;
+	}
+
+	/**
+	 * @brief Runs the current state
+	 *
+	 * If the state function returns another state, the exit hook
+	 * of the current and the enter hook of the next state are
+	 * called, and the dwell time of the current state is recorded
+	 * (See transition()).
+	 *
+	 * @param owner The object owning the state machine
+	 * @returns true If the state has changed
+	 */
+	bool step(T *owner)
+	{
+		const state_t &st = table[cur];
+
+		if (st.run == NULL)
+			return false;
+
+		S next = (owner->*st.run)();
+
+		if (next == cur)
+			return false;
+
+		return transition(owner, next);
+	}
+
+	/**
+	 * @brief Transitions to a state, calling the hooks
+	 *
+	 * The transition is refused if the next state isn't listed as
+	 * allowed by the entry of the current state.
+	 *
+	 * @param owner The object owning the state machine
+	 * @param next The next state
+	 * @returns false If the transition isn't allowed
+	 */
+	bool transition(T *owner, S next)
+	{
+		if (!(table[cur].next & SM_TO(next))) {
+			log_msg("StateMachine::transition", "Transition from " + String(table[cur].name) + " to " +
+				String(table[next].name) + " not allowed, staying in " + String(table[cur].name));
+			return false;
+		}
+
+		uint32_t now = micros();
+		uint32_t d = now - entered_us;
+
+		stats_t &s = stat[cur];
+		s.last_us = d;
+		s.total_us += d;
+		if (d > s.max_us)
+			s.max_us = d;
+
+		if (table[cur].exit != NULL)
+			(owner->*table[cur].exit)();
+
+		cur = next;
+		entered_us = now;
+		stat[cur].entries++;
+		n_transitions++;
+
+		if (table[cur].enter != NULL)
+			(owner->*table[cur].enter)();
+
+		return true;
+	}
+
+	/**
+	 * @brief Returns the current state
+	 */
+	S state() const
+	{
+		return cur;
+	}
+
+	/**
+	 * @brief Returns the name of a state
+	 */
+	const char *name(S s) const
+	{
+		return table[s].name;
+	}
+
+	/**
+	 * @brief Returns the time spent in the current state so far in microseconds
+	 */
+	uint32_t dwell() const
+	{
+		return micros() - entered_us;
+	}
+
+	/**
+	 * @brief Returns the statistics of a state
+	 *
+	 * The current visit is only accounted once the state is left.
+	 */
+	const stats_t &stats(S s) const
+	{
+		return stat[s];
+	}
+
+	/**
+	 * @brief Returns the number of transitions since construction
+	 */
+	uint32_t transitions() const
+	{
+		return n_transitions;
+	}
+
+	/**
+	 * @brief Logs the statistics of all visited states
+	 * @param category The log category
+	 */
+	void report(const String &category) const
+	{
+		log_msg(category, "State machine: " + String(n_transitions) + " transitions, in " +
+			String(table[cur].name) + " for " + String(dwell() / 1000) + "ms");
+
+		for (uint8_t i = 0; i < N; i++) {
+			const stats_t &s = stat[i];
+
+			if (s.entries == 0)
+				continue;
+
+			log_msg(category, String(table[i].name) + ": " + String(s.entries) + " entries, " +
+				String((uint32_t)(s.total_us / 1000)) + "ms total, last: " + String(s.last_us) +
+				"us, max: " + String(s.max_us) + "us");
+		}
+	}
+};
@@ -26,12 +26,18 @@
 
 #include <inttypes.h>
 
+#include <LEDEngine.h>
+
 /**
  * @brief StatusLED class
  * 
  * The StatusLED class provides a simple "asynchronous" interface for controlling status LEDs.
- * LEDs can be set to blink, be on or off. In order to work "asynchronously", the class
- * requires the user to continously the update() method.
+ * LEDs can be set to blink, be on or off, or to play any pattern from LEDPattern.h.
+ * 
+ * The LEDs are driven by the LEDEngine in the background, so unlike
+ * most other classes, the StatusLED does not need to be updated
+ * continously. Instead, a callback can be provided to be notified
+ * once the LED has blinked a given number of times.
  */
 class StatusLED {
 public:
@@ -40,16 +46,15 @@ public:
                 OFF,      ///< Constantly off
                 ON,       ///< Constantly on
                 BLINK,    ///< First ON then OFF
-                BLINK_INV ///< First OFF then ON
+                BLINK_INV,///< First OFF then ON
+                PATTERN   ///< Playing a pattern set by pattern()
         };
 
 private:
         uint8_t pin;
-        bool stat;
+        int8_t chn = -1;
         led_mode mod;
         unsigned long blink_interval;
-        unsigned long tstamp;
-        unsigned int blks;
 public:
         /**
 	 * @brief Default constructor
@@ -66,7 +71,7 @@ public:
          * @brief Constructor
          * 
          * The constructor initializes the StatusLED object with the
-         * given pin and blink interval.
+         * given pin and blink interval, and attaches it to the LEDEngine.
          * 
          * The blink interval defines the time between two consecutive
          * LED state changes if the LED is set to blink.
@@ -93,34 +98,46 @@ public:
          * 
          * The BLINK_INV mode is useful for alternating blinks between two LEDs.
          * 
+         * In the blink modes, the LED can be limited to blink a given number
+         * of times, after which it turns off and invokes the callback. This
+         * spares the caller from polling blinks().
+         * 
          * @param mode The LEDs mode
+         * @param count Number of blinks in the blink modes (0 = blink forever)
+         * @param cb Callback invoked after count blinks (optional, see LEDEngine)
+         * @param arg Argument passed to the callback
+         */
+        void mode(led_mode m, uint16_t count = 0, led_callback_t cb = NULL, void *arg = NULL);
+
+        /**
+         * @brief Plays a pattern on the LED
+         * 
+         * See LEDPattern.h for available patterns. Puts the LED into the
+         * PATTERN mode.
+         * 
+         * @param p The pattern to play
+         * @param count Number of repetitions (0 = forever)
+         * @param cb Callback invoked after count repetitions (optional, see LEDEngine)
+         * @param arg Argument passed to the callback
          */
-        void mode(led_mode m);
+        void pattern(const led_pattern_t &p, uint16_t count = 0, led_callback_t cb = NULL, void *arg = NULL);
 
         /**
          * @brief Gets the LEDs mode
          * @returns The LEDs mode
          */
         led_mode getMode();
-        
-        /**
-         * @brief Updates the LEDs state
-         * 
-         * The update() method must be called continously in order to
-         * update the LEDs state. This is necessary to make the LEDs
-         * blink "asynchronously".
-         */        
-        void update();
 
         /**
          * @brief Counts how many times the LED has blinked
          * 
          * The blinkCount() method returns the number of times the LED has
-         * blinked since it was set to blink.
+         * blinked since it was set to blink. In the PATTERN mode, the
+         * number of played repetitions is returned.
          * 
          * @returns The number of times the LED has blinked
          */
         unsigned int blinks();
 };
 
-typedef StatusLED BellLED_t;
\ No newline at end of file
+typedef StatusLED BellLED_t;
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file SyncClock.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief SyncClock class
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <ESP8266WiFi.h>
+#include <ESPAsyncUDP.h>
+
+#include <Clock.h>
+#include <Scheduler.h>
+
+#define SYNC_MAGIC 0xAC
+
+#define SYNC_BEACON 0x01	///< Time of the master, broadcast over ESP-NOW
+#define SYNC_REPORT 0x02	///< Start error of a bell, broadcast over ESP-NOW
+#define SYNC_QUERY 0x03		///< Time request of the door, over UDP
+#define SYNC_ANSWER 0x04	///< Answer of a bell to a time request, over UDP
+
+/// Sync beacon
+struct __attribute__((packed)) sync_beacon_t {
+	uint8_t magic;		///< SYNC_MAGIC
+	uint8_t type;		///< SYNC_BEACON
+	uint64_t time_us;	///< Common time when the beacon was sent
+	uint16_t tx_us;		///< Transmission latency of the master (See EspNow::txLatency())
+};
+
+/// Start report
+struct __attribute__((packed)) sync_report_t {
+	uint8_t magic;		///< SYNC_MAGIC
+	uint8_t type;		///< SYNC_REPORT
+	uint32_t start_at;	///< Scheduled start of the ring tone (common time, us)
+	int32_t err_us;		///< Actual start of the ring tone minus the scheduled start
+	uint32_t time_us;	///< Common time of the sender when the report was sent (lower 32 bits)
+	uint16_t tx_us;		///< Transmission latency of the sender (See EspNow::txLatency())
+};
+
+/**
+ * @brief Sync statistics of a bell
+ */
+struct sync_stats_t {
+	uint32_t skew_us;	///< Spread of the starts of the last scheduled ring across bells
+	uint32_t skew_peak_us;	///< Largest skew seen so far
+	uint32_t peer_us;	///< Largest clock offset to another bell, measured at the last scheduled ring
+	int32_t offset_us;	///< Common time of this bell minus the master's, before the last beacon was taken over
+};
+
+/// Time request and answer
+struct __attribute__((packed)) sync_query_t {
+	uint8_t magic;		///< SYNC_MAGIC
+	uint8_t type;		///< SYNC_QUERY or SYNC_ANSWER
+	uint32_t t_req;		///< Local time of the door when sending the request (echoed)
+	uint64_t time_us;	///< Common time when the answer was sent (answers only)
+};
+
+/**
+ * @brief SyncClock class
+ * 
+ * Bells start their ring tone whenever their ring message arrives, so
+ * bells in neighbouring rooms play out of phase after slow connects.
+ * To start them together, the door schedules the start of the ring tone
+ * SYNC_START_MARGIN_MS into the future of a common time base, which
+ * is kept by the SyncClock.
+ * 
+ * The common time is the time of a master bell, which broadcasts it in
+ * a sync beacon over ESP-NOW every SYNC_INTERVAL_MS. As an ESP-NOW
+ * broadcast reaches all bells at virtually the same instant, bells can
+ * take over the time of the beacon, once corrected by the time the master
+ * took to get it on air (See EspNow::txLatency()). Before taking it over,
+ * bells note how far their own time was off (sync_stats_t::offset_us).
+ * Bells consider themselves synced for SYNC_VALID_MS after the last beacon.
+ * 
+ * The door is only powered briefly and can't wait for a beacon. Instead,
+ * it requests the common time from the bells in its directory over UDP,
+ * and takes over the first answer, corrected by half its round trip time.
+ * An error of the door only shifts the start of all bells alike, while
+ * the skew between bells only depends on the beacons.
+ * 
+ * After starting a scheduled ring tone, each bell broadcasts how far its
+ * first note was off the scheduled start, along with its common time.
+ * Reports of other bells are moved into the own time by the offset between
+ * both clocks, so the spread of all reports is the actual skew between
+ * bells, rather than the spread of the errors each bell sees (See skew()).
+ * 
+ * As the ESP-NOW callbacks don't take a user argument, the SyncClock
+ * is implemented with static members only.
+ * 
+ * @attention Bells need to keep the radio awake to receive beacons,
+ * see MeshRing.h.
+ */
+class SyncClock {
+private:
+	inline static bool running;
+	inline static bool master;
+	inline static bool have_time;
+	inline static int64_t offset;		///< Common time minus local time in us
+	inline static Deadline valid;
+
+	inline static AsyncUDP udp;
+	inline static uint16_t port;
+	inline static bool listening;
+
+	inline static sched_task_t beacon_task;
+	inline static Deadline beacon_deadline;
+
+	inline static uint32_t rtt_us;
+
+	inline static uint32_t skew_start_at;
+	inline static int32_t skew_min;
+	inline static int32_t skew_max;
+	inline static uint8_t skew_n;
+
+	inline static sync_stats_t stat;
+
+	/**
+	 * @brief Opens the UDP port for time requests and answers
+	 */
+	static bool listen();
+
+	/**
+	 * @brief Handler for received sync frames (See EspNow.h)
+	 */
+	static void on_frame(const uint8_t *mac, const uint8_t *data, uint8_t len);
+
+	/**
+	 * @brief UDP receive callback, answers time requests and takes over answers
+	 */
+	static void on_packet(void *arg, AsyncUDPPacket &packet);
+
+	/**
+	 * @brief Scheduler callback, broadcasts a sync beacon (master only)
+	 */
+	static void on_beacon(void *arg);
+
+	/**
+	 * @brief Records the start error of a bell
+	 * 
+	 * @param start_at The scheduled start of the ring tone (common time, us)
+	 * @param err_us Actual start minus the scheduled start, in the time of this bell
+	 * @param peer_us Clock offset of the reporting bell to this one (0 = own report)
+	 */
+	static void record(uint32_t start_at, int32_t err_us, int32_t peer_us);
+
+public:
+	/**
+	 * @brief Starts the SyncClock on a bell
+	 * 
+	 * Must be called once the WiFi mode has been set (ie. after
+	 * WiFiHandler::connect()).
+	 * 
+	 * @param master If true, this bell provides the common time
+	 * @param port The UDP port for time requests of the door
+	 * @returns true If the SyncClock has been started
+	 */
+	static bool begin(bool master, uint16_t port);
+
+	/**
+	 * @brief Requests the common time from the given bells (door only)
+	 * 
+	 * The first answer is taken over, see synced().
+	 * 
+	 * @param ips The IP addresses of the bells
+	 * @param n The number of bells
+	 * @param port The UDP port of the bells
+	 */
+	static void query(const uint32_t *ips, uint8_t n, uint16_t port);
+
+	/**
+	 * @brief Returns true if the common time is known
+	 */
+	static bool synced();
+
+	/**
+	 * @brief Returns the common time in us
+	 * 
+	 * Only meaningful if synced().
+	 */
+	static uint64_t now();
+
+	/**
+	 * @brief Converts a local time stamp (see micros()) to common time
+	 * 
+	 * @param local_us The local time stamp in us
+	 * @returns The lower 32 bits of the common time in us
+	 */
+	static uint32_t common(unsigned long local_us);
+
+	/**
+	 * @brief Reports the start error of the ring tone to all bells
+	 * 
+	 * @param start_at The scheduled start of the ring tone (common time, us)
+	 * @param err_us Actual start minus the scheduled start in us
+	 */
+	static void report(uint32_t start_at, int32_t err_us);
+
+	/**
+	 * @brief Returns the skew between bells of the last scheduled ring in us
+	 * 
+	 * The spread of the start errors reported by all bells, including this one.
+	 * 
+	 * @param n Set to the number of bells that have reported (optional)
+	 */
+	static uint32_t skew(uint8_t *n = NULL);
+
+	/**
+	 * @brief Returns the largest skew between bells seen so far in us
+	 */
+	static uint32_t skewPeak();
+
+	/**
+	 * @brief Returns the round trip time of the last time request in us (door only)
+	 */
+	static uint32_t rtt();
+
+	/**
+	 * @brief Returns the sync statistics
+	 */
+	static const sync_stats_t &stats();
+};
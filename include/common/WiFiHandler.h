@@ -26,6 +26,9 @@
 
 #include <ESP8266WiFi.h>
 
+#include <Clock.h>
+#include <Scheduler.h>
+
 #define NO_TIMEOUT 0
 
 /**
@@ -38,6 +41,13 @@
  * The ESP8266WiFi library is used for the actual WiFi
  * connection and the state machine simply wraps around
  * the WiFi object.
+ * 
+ * Rather than polling WiFi.status(), the state machine is
+ * driven by the station mode events of the SDK, so state
+ * changes are seen (and the main loop is woken) as soon
+ * as they occur. Only the connection timeout and actions
+ * that mustn't be run from within a WiFi event are handled
+ * through the Scheduler.
  */
 class WiFiHandler {
 public:
@@ -56,9 +66,70 @@ private:
 	IPAddress subnet;
 	uint16_t timeout_ms;
 	bool rejoin;
+	bool sleep_set = false;
+	WiFiSleepType_t sleep_type;
+	uint8_t listen_interval;
+	int32_t channel = 0;
 
 	wifi_stat stat = DISCONNECTED;
-	unsigned long timeout_tstamp;
+	Deadline timeout_deadline;
+	sched_task_t task;
+	volatile bool ip_mismatch = false;
+	volatile uint8_t n_retries = 0;
+	uint32_t n_reconnects = 0;
+
+	WiFiEventHandler connected_handler;
+	WiFiEventHandler got_ip_handler;
+	WiFiEventHandler disconnected_handler;
+
+	/**
+	 * @brief Scheduler callback, updates the state machine
+	 * @param arg Pointer to the WiFiHandler object
+	 */
+	static void on_task(void *arg);
+
+	/**
+	 * @brief Registers the WiFi event handlers
+	 * 
+	 * Handlers are only registered once. As they refer to this
+	 * object, they are registered on the first connect rather
+	 * than in the constructor, since the object is usually
+	 * copied after construction.
+	 */
+	void register_events();
+
+	/**
+	 * @brief Handles the association with the access point
+	 * 
+	 * Only logs the association, the connection is considered
+	 * established once an IP has been assigned.
+	 */
+	void on_connected(const WiFiEventStationModeConnected &evt);
+
+	/**
+	 * @brief Handles the assignment of an IP address
+	 * 
+	 * Sets the state machine to the CONNECTED state and wakes
+	 * the main loop. If the assigned IP doesn't match the
+	 * configured one, a reconnect is scheduled instead.
+	 */
+	void on_got_ip(const WiFiEventStationModeGotIP &evt);
+
+	/**
+	 * @brief Handles unexpected WiFi disconnects
+	 * 
+	 * Sets the state machine to the DISCONNECTED state and wakes
+	 * the main loop.
+	 * 
+	 * If the rejoin flag is set true, the WiFi object's
+	 * disconnect() method will not be called, and a
+	 * reconnect will be attempted automatically
+	 * 
+	 * If the rejoin flag is set false, the disconnect() function
+	 * is called from the next update(), which will not attempt
+	 * to automatically re-establish a connection.
+	 */
+	void on_disconnected(const WiFiEventStationModeDisconnected &evt);
 
 	/**
 	 * @brief Returns if the connection attempt has timed out
@@ -79,23 +150,6 @@ private:
 	 */
 	void _connect();
 
-	/**
-	 * @brief Reports unexpected WiFi disconnects
-	 * 
-	 * The following function reports unexpected WiFi
-	 * disconnects. Once called, the state machine is
-	 * set to the DISCONNECTED state.
-	 * 
-	 * If the rejoin flag is set true, the WiFi object's
-	 * will disconnect() method not not be called, and a
-	 * reconnect will be attempted automatically
-	 * 
-	 * If the rejoing flag is set false, the function redirects
-	 * to the disconnect() function, which will not attempt
-	 * to automatically re-establish a connection.
-	 */	
-	void unexpected_disconnect();
-
 public:
 	/**
 	 * @brief Default constructor
@@ -141,6 +195,38 @@ public:
 	 */
 	void connect();
 
+	/**
+	 * @brief Sets the WiFi power-save mode
+	 * 
+	 * The following function sets the sleep mode the WiFi is put
+	 * into while idling. It takes effect with the next connect().
+	 * If never called, the SDK default is kept.
+	 * 
+	 * Available modes are:
+	 * 	- WIFI_NONE_SLEEP	Radio always on (lowest latency, highest current)
+	 * 	- WIFI_MODEM_SLEEP	Radio sleeps between beacons, CPU keeps running
+	 * 	- WIFI_LIGHT_SLEEP	Radio and CPU sleep between beacons while idling
+	 * 
+	 * In the sleep modes, the radio wakes up every listen_interval
+	 * beacons to check for buffered traffic. A higher listen interval
+	 * therefore lowers the idle current, but increases the latency of
+	 * incoming packets by up to listen_interval beacon intervals.
+	 * 
+	 * @param type The sleep mode
+	 * @param listen_interval Number of beacon intervals between wake-ups (0 = DTIM of the AP)
+	 */
+	void setSleepMode(WiFiSleepType_t type, uint8_t listen_interval = 0);
+
+	/**
+	 * @brief Sets the channel of the WiFi network
+	 * 
+	 * If set, the channel isn't scanned for, which speeds up the
+	 * association. Takes effect with the next connect().
+	 * 
+	 * @param channel The channel of the access point (0 = scan)
+	 */
+	void setChannel(int32_t channel);
+
 	/**
 	 * @brief Disconnects from WiFi
 	 * 
@@ -152,11 +238,32 @@ public:
 	/**
 	 * @brief Updates the state machine
 	 * 
-	 * The following function updates the state machine
-	 * and must be called periodically.
+	 * The following function handles connection timeouts,
+	 * as well as reconnects and disconnects requested by
+	 * WiFi events. All other state changes are made by the
+	 * event handlers directly.
+	 * 
+	 * The method is run through the Scheduler when needed,
+	 * so there is no need to call it from the main loop.
 	 */
 	void update();
 
+	/**
+	 * @brief Returns the number of failed association attempts
+	 * 
+	 * Counts the disconnect events received while connecting
+	 * since the last connect() call.
+	 */
+	uint8_t retries();
+
+	/**
+	 * @brief Returns the number of times the connection has been re-established
+	 * 
+	 * Counts connections following an unexpected disconnect, the
+	 * counter is never reset.
+	 */
+	uint32_t reconnects();
+
 	/**
 	 * @brief Returns the current state of the state machine
 	 *
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file discovery_msg.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Defines the UDP messages used by the door to discover bells
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#define DISCOVERY_MAGIC 0xDB
+#define DISCOVERY_QUERY 0x01	///< Sent by the door (broadcast), asks all bells to announce themselves
+#define DISCOVERY_BEACON 0x02	///< Sent by a bell, in reply to a query or once it has joined the network
+
+/**
+ * @brief Discovery message
+ * 
+ * Queries and beacons share the same layout. The IP of a bell is
+ * taken from the source address of its beacon, so only the port of
+ * its RingReceiver is included. Queries leave the port at 0.
+ */
+struct __attribute__((packed)) discovery_msg_t {
+	uint8_t magic;	///< DISCOVERY_MAGIC
+	uint8_t type;	///< DISCOVERY_QUERY or DISCOVERY_BEACON
+	uint16_t port;	///< Port of the RingReceiver of the bell
+};
+
+/**
+ * @brief Checks if a received packet is a discovery message of the given type
+ * 
+ * @param data The received data
+ * @param len The length of the received data
+ * @param type The expected message type
+ * @returns true If the packet is a valid discovery message of the given type
+ */
+inline bool discovery_msg_valid(const uint8_t *data, size_t len, uint8_t type)
+{
+	const discovery_msg_t *msg = (const discovery_msg_t *)data;
+	return len == sizeof(discovery_msg_t) && msg->magic == DISCOVERY_MAGIC && msg->type == type;
+}
@@ -19,8 +19,164 @@
 /**
  * @file ring_msg.h
  * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Defines the messages sent from the door to the bells
  */
 
 #pragma once
 
-#define RING_MSG 0x01
\ No newline at end of file
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#define RING_MSG 0x01		///< Normal ring
+#define RING_MSG_URGENT 0x02	///< Urgent ring, pre-empts normal rings
+#define RING_MSG_TEST 0x03	///< Maintenance test ring
+
+/**
+ * @brief Ring classes
+ * 
+ * Each ring message maps to a ring class. Ring classes are
+ * ordered by priority, a ring of a higher priority class
+ * pre-empts a ring of a lower one.
+ */
+enum ring_class {
+	RING_CLASS_TEST,	///< Maintenance test (lowest priority)
+	RING_CLASS_NORMAL,	///< Normal ring
+	RING_CLASS_URGENT,	///< Urgent ring (highest priority)
+	N_RING_CLASSES
+};
+
+/**
+ * @brief Maps a ring message to its ring class
+ * 
+ * @param msg The received ring message
+ * @param cls Set to the ring class of the message
+ * @returns true If msg is a valid ring message,
+ * 	    false If msg is not a ring message
+ */
+inline bool ring_msg_class(uint8_t msg, ring_class *cls)
+{
+	switch (msg) {
+		case RING_MSG:		*cls = RING_CLASS_NORMAL;	return true;
+		case RING_MSG_URGENT:	*cls = RING_CLASS_URGENT;	return true;
+		case RING_MSG_TEST:	*cls = RING_CLASS_TEST;		return true;
+		default:						return false;
+	}
+}
+
+/**
+ * @brief Maps a ring class to its ring message
+ * 
+ * @param cls The ring class
+ * @returns The ring message of the class
+ */
+inline uint8_t ring_class_msg(ring_class cls)
+{
+	switch (cls) {
+		case RING_CLASS_URGENT:	return RING_MSG_URGENT;
+		case RING_CLASS_TEST:	return RING_MSG_TEST;
+		default:		return RING_MSG;
+	}
+}
+
+/////////////////////////////////////
+// OPTIONAL TLVs
+/////////////////////////////////////
+
+// The ring message may be followed by TLVs, each consisting of a
+// type byte, a length byte and the value. Bells skip unknown TLVs.
+
+#define RING_MSG_MAX_LEN 64	///< Ring message including all TLVs
+
+#define RING_TLV_START_AT 0x01	///< Scheduled start of the ring tone (uint32_t, common time in us, See SyncClock.h)
+#define RING_TLV_CRASH 0x02	///< Last crash of the door (crash_record_t, See CrashLog.h)
+#define RING_TLV_TRACE 0x03	///< Trace context of the press (ring_trace_t)
+#define RING_TLV_SEQ 0x04	///< Press counter of the door (uint16_t, See MeshRing.h)
+
+/**
+ * @brief Value of RING_TLV_TRACE
+ * 
+ * Carries the phase timings of the door to the bells, which join them
+ * with their own timings, so the latency of a press can be attributed
+ * end to end. The trace ID identifies the press, it is shared by all
+ * bells rung by it.
+ * 
+ * Time the door spends between associating and connecting (ie. syncing)
+ * is the remainder of total_ms.
+ */
+struct __attribute__((packed)) ring_trace_t {
+	uint32_t id;		///< Trace ID, random for every press
+	uint16_t boot_ms;	///< Power up -> firmware started
+	uint16_t assoc_ms;	///< Firmware started -> IP assigned
+	uint16_t connect_ms;	///< TCP connection to the bell, filled in by RingTX
+	uint16_t send_us;	///< Connected -> ring message handed to TCP, filled in by RingTX (saturates)
+	uint16_t total_ms;	///< Power up -> ring message handed to TCP, filled in by RingTX
+};
+
+/**
+ * @brief Appends a TLV to a ring message
+ * 
+ * @param buf The ring message buffer (RING_MSG_MAX_LEN bytes)
+ * @param len The current length of the message, advanced by the TLV
+ * @param type The type of the TLV
+ * @param val The value of the TLV
+ * @param vlen The length of the value
+ * @returns true If the TLV has been appended,
+ * 	    false If it doesn't fit into the buffer
+ */
+inline bool ring_msg_add_tlv(uint8_t *buf, size_t *len, uint8_t type, const void *val, uint8_t vlen)
+{
+	if (*len + 2 + vlen > RING_MSG_MAX_LEN)
+		return false;
+
+	buf[(*len)++] = type;
+	buf[(*len)++] = vlen;
+	memcpy(&buf[*len], val, vlen);
+	*len += vlen;
+
+	return true;
+}
+
+/**
+ * @brief Checks if the TLVs following a ring message are well formed
+ * 
+ * @param data The received ring message
+ * @param len The length of the received message
+ * @returns true If all TLVs lie within the message
+ */
+inline bool ring_msg_tlvs_valid(const uint8_t *data, size_t len)
+{
+	size_t i = 1; // Skip the ring message
+
+	while (i + 2 <= len)
+		i += 2 + data[i + 1];
+
+	return i == len;
+}
+
+/**
+ * @brief Finds a TLV following a ring message
+ * 
+ * The TLVs must have been checked with ring_msg_tlvs_valid().
+ * 
+ * @param data The received ring message
+ * @param len The length of the received message
+ * @param type The type of the TLV to find
+ * @param vlen Set to the length of the value
+ * @returns A pointer to the value, or NULL if the TLV isn't present
+ */
+inline const uint8_t *ring_msg_tlv(const uint8_t *data, size_t len, uint8_t type, uint8_t *vlen)
+{
+	size_t i = 1; // Skip the ring message
+
+	while (i + 2 <= len) {
+		if (data[i] == type) {
+			*vlen = data[i + 1];
+			return &data[i + 2];
+		}
+
+		i += 2 + data[i + 1];
+	}
+
+	return NULL;
+}
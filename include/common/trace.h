@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file trace.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides macros for timing the ring path with a logic analyzer
+ */
+
+/* Serial timestamps are too coarse, and printing them too slow,
+ * to measure sub-millisecond latencies. Instead, trace points
+ * toggle spare GPIOs, which can be timed with a logic analyzer.
+ *
+ * As with the power latch, tracing is implemented through macros,
+ * so a disabled trace point compiles to nothing, and an enabled one
+ * to a single write to the GPIO set or clear register.
+ *
+ * Tracing is enabled with USE_TRACE in config.h, where every trace
+ * point is mapped to a pin (TRACE_PIN_<POINT>). Unmapped points are
+ * compiled out. Points may share a pin, but as there is no locking,
+ * overlapping spans on a shared pin merge.
+ *
+ * On host builds (ARDUINO undefined), the mapped trace points are
+ * recorded into the EventTrace instead (EVT_TRACE), so the order of
+ * the same points can be checked natively (See test/test_trace).
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <EventTrace.h>
+#endif
+
+#include <config.h>
+
+#define TRACE_NO_PIN 0xFF
+
+// Door
+#ifndef TRACE_PIN_DOOR_BOOT
+#define TRACE_PIN_DOOR_BOOT TRACE_NO_PIN	// High from the power latch until WiFi is started
+#endif
+#ifndef TRACE_PIN_DOOR_WIFI
+#define TRACE_PIN_DOOR_WIFI TRACE_NO_PIN	// High from WiFi being started until an IP has been assigned
+#endif
+#ifndef TRACE_PIN_RING_TX
+#define TRACE_PIN_RING_TX TRACE_NO_PIN		// High from the connects to the bells until the first ring message is sent (or fails)
+#endif
+
+// Bell
+#ifndef TRACE_PIN_RING_RX
+#define TRACE_PIN_RING_RX TRACE_NO_PIN		// High while a ring message is handled by the RingReceiver
+#endif
+#ifndef TRACE_PIN_BELL_RING
+#define TRACE_PIN_BELL_RING TRACE_NO_PIN	// High while the bell is ringing
+#endif
+#ifndef TRACE_PIN_BUZZER_NOTE
+#define TRACE_PIN_BUZZER_NOTE TRACE_NO_PIN	// Pulsed when the first note (or sample) of a ring tone is played
+#endif
+
+/// Trace points, identify the points recorded on host builds (See EVT_TRACE)
+enum trace_point : uint8_t {
+	TP_DOOR_BOOT,
+	TP_DOOR_WIFI,
+	TP_RING_TX,
+	TP_RING_RX,
+	TP_BELL_RING,
+	TP_BUZZER_NOTE,
+	TP_N
+};
+
+/**
+ * @brief Sets or clears a trace pin
+ *
+ * Inlined with a constant pin, this compiles to a single write
+ * to GPOS or GPOC. GPIO16 isn't part of these registers and is
+ * therefore not supported. On host builds, the point is recorded
+ * into the EventTrace instead.
+ */
+static inline __attribute__((always_inline)) void trace_write(trace_point point, uint8_t pin, bool level)
+{
+#ifdef ARDUINO
+	if (pin >= 16)
+		return;
+
+	if (level)
+		GPOS = 1UL << pin;
+	else
+		GPOC = 1UL << pin;
+#else
+	if (pin != TRACE_NO_PIN)
+		EVT(EVT_TRACE, point, level);
+#endif
+}
+
+/**
+ * @brief Configures all mapped trace pins as low outputs
+ *
+ * Does nothing on host builds.
+ */
+static inline void trace_init()
+{
+#ifdef ARDUINO
+	const uint8_t pins[] = {
+		TRACE_PIN_DOOR_BOOT, TRACE_PIN_DOOR_WIFI, TRACE_PIN_RING_TX,
+		TRACE_PIN_RING_RX, TRACE_PIN_BELL_RING, TRACE_PIN_BUZZER_NOTE
+	};
+
+	for (uint8_t pin : pins) {
+		if (pin >= 16)
+			continue;
+
+		pinMode(pin, OUTPUT);
+		digitalWrite(pin, LOW);
+	}
+#endif
+}
+
+#ifdef USE_TRACE
+
+/**
+ * @brief Configures the trace pins, call once on boot
+ */
+#define TRACE_INIT() trace_init()
+
+/**
+ * @brief Sets the pin of a trace point (ex. TRACE_HIGH(RING_RX))
+ */
+#define TRACE_HIGH(POINT) trace_write(TP_##POINT, TRACE_PIN_##POINT, true)
+
+/**
+ * @brief Clears the pin of a trace point
+ */
+#define TRACE_LOW(POINT) trace_write(TP_##POINT, TRACE_PIN_##POINT, false)
+
+/**
+ * @brief Emits a short pulse on the pin of a trace point
+ *
+ * The pulse is only a few cycles wide, so the analyzer must
+ * sample at 10 MHz or more to catch it.
+ */
+#define TRACE_PULSE(POINT) do { TRACE_HIGH(POINT); TRACE_LOW(POINT); } while (0)
+
+#else
+
+#define TRACE_INIT()
+#define TRACE_HIGH(POINT)
+#define TRACE_LOW(POINT)
+#define TRACE_PULSE(POINT)
+
+#endif
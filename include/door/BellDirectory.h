@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file BellDirectory.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief BellDirectory class
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <ESP8266WiFi.h>
+#include <ESPAsyncUDP.h>
+
+#include <Scheduler.h>
+
+#include <door/DoorStore.h>
+
+/**
+ * @brief BellDirectory class
+ * 
+ * The door keeps a directory of all bells in the DoorStore, from which
+ * the RingSender creates its RingTX instances. This way, bells are no
+ * longer required to follow the IP of the door, and no lookups (ex. mDNS)
+ * are needed at ring time, which would delay the ring on every press.
+ * 
+ * The directory is refreshed after the ring has been sent, by broadcasting
+ * a discovery query and collecting the beacons of the bells (See BellBeacon.h)
+ * for DOOR_DISCOVERY_WINDOW_MS. To limit the time the door stays powered,
+ * the directory is only refreshed every DOOR_DISCOVERY_INTERVAL presses,
+ * or whenever a bell failed to ring, as it may have moved.
+ * 
+ * Newly discovered bells are added to the directory, while bells that
+ * haven't answered DOOR_DISCOVERY_MAX_MISSES refreshes in a row are dropped,
+ * along with their latency history. Refreshes without any answers are
+ * ignored, as discovery itself is likely unavailable (ex. broadcasts being
+ * filtered by the access point).
+ * 
+ * Until the first refresh, the directory is seeded with bells following
+ * the IP of the door, as done by previous firmware versions.
+ */
+class BellDirectory {
+private:
+	uint16_t port;
+	AsyncUDP udp;
+	bool listening = false;
+	bool active = false;
+	sched_task_t task;
+
+	// Beacons collected during the current refresh
+	volatile uint8_t n_found = 0;
+	uint32_t found_ip[DOOR_STORE_MAX_BELLS];
+	uint16_t found_port[DOOR_STORE_MAX_BELLS];
+
+	/**
+	 * @brief UDP receive callback, collects beacons
+	 * @param arg Pointer to the BellDirectory object
+	 * @param packet The received packet
+	 */
+	static void on_packet(void *arg, AsyncUDPPacket &packet);
+
+	/**
+	 * @brief Scheduler callback, ends the refresh once the window has passed
+	 * @param arg Pointer to the BellDirectory object
+	 */
+	static void on_task(void *arg);
+
+	/**
+	 * @brief Merges the collected beacons into the directory
+	 * 
+	 * Updates the DoorStore record, but doesn't save it.
+	 */
+	void merge();
+
+public:
+	/**
+	 * @brief Default constructor
+	 * 
+	 * The default constructor only serves to allow the class 
+	 * to be declared without immidiately initializing it. This
+	 * spares us from having to allocate the object on the heap via
+	 * a pointer, which we generally want to avoid on embedded 
+	 * systems.
+	 */
+	BellDirectory();
+
+	/**
+	 * @brief Constructor
+	 * @param port The UDP port queries and beacons are sent to
+	 */
+	BellDirectory(uint16_t port);
+
+	/**
+	 * @brief Seeds an empty directory with bells following the IP of the door
+	 * 
+	 * Does nothing if the directory already holds bells. Must be called
+	 * before the RingSender is constructed.
+	 * 
+	 * @param door_ip The IP address of the door
+	 * @param ring_port The port of the bell receivers
+	 * @param n_bells The number of bells following the door
+	 */
+	static void seed(IPAddress door_ip, uint16_t ring_port, uint8_t n_bells);
+
+	/**
+	 * @brief Refreshes the directory, if due
+	 * 
+	 * Broadcasts a discovery query, if the directory is due for a refresh
+	 * or if forced. Beacons are then collected in the background until
+	 * DOOR_DISCOVERY_WINDOW_MS have passed, see refreshing().
+	 * 
+	 * Must be called on the final (ie. not copied) object, while
+	 * connected to WiFi.
+	 * 
+	 * @param force Refresh even if not due (ex. because a bell failed)
+	 */
+	void refresh(bool force = false);
+
+	/**
+	 * @brief Returns true while beacons are being collected
+	 */
+	bool refreshing();
+};
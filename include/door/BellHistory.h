@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file BellHistory.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Derives per-bell timeouts from their latency history
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <door/DoorStore.h>
+
+/**
+ * @brief BellHistory class
+ * 
+ * A fixed timeout has to cover the slowest bell on its worst day, which
+ * keeps the door latched (and draining the battery) for the full timeout
+ * whenever a bell is powered off. Instead, the door keeps a compact
+ * latency history of each bell in the DoorStore, and derives the timeout
+ * of each RingTX from it.
+ * 
+ * Similarly to the TCP retransmission timeout, the history consists of
+ * an exponentially smoothed latency and its mean deviation. The timeout
+ * is set to cover the smoothed latency plus four deviations, or the
+ * decaying maximum latency, whichever is larger, plus a safety margin.
+ * This covers the far tail of the latency distribution, while still
+ * being a fraction of the fixed timeout.
+ * 
+ * Bells without a history are given the full timeout. Bells that failed
+ * on their last ring are only tried with a short budget, as they are
+ * likely powered off. To prevent a slow bell from being locked out for
+ * good, every DOOR_BELL_RELEARN_FAILS consecutive failures it is given
+ * the full timeout once more.
+ * 
+ * The BellHistory class only holds static functions operating on
+ * bell_hist_t records.
+ */
+class BellHistory {
+public:
+	/**
+	 * @brief Returns the timeout for the next ring of a bell
+	 * 
+	 * @param h The history of the bell
+	 * @param max_ms The fixed timeout, which is never exceeded
+	 * @returns The timeout in ms
+	 */
+	static unsigned long timeout(const bell_hist_t &h, unsigned long max_ms);
+
+	/**
+	 * @brief Records a successful ring
+	 * 
+	 * @param h The history of the bell
+	 * @param lat_ms The time it took to deliver the ring message in ms
+	 */
+	static void success(bell_hist_t &h, unsigned long lat_ms);
+
+	/**
+	 * @brief Records a failed ring
+	 * 
+	 * @param h The history of the bell
+	 */
+	static void fail(bell_hist_t &h);
+};
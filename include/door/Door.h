@@ -27,9 +27,13 @@
 
 #include <ESP8266WiFi.h>
 
+#include <Clock.h>
+#include <CrashLog.h>
+#include <StateMachine.h>
 #include <StatusLED.h>
 #include <WiFiHandler.h>
 
+#include <door/BellDirectory.h>
 #include <door/DoorCFG.h>
 #include <door/RingSender.h>
 
@@ -49,13 +53,21 @@ class Door {
 		INIT,		///< Initialization
 		CONNECTING,	///< Connecting to WiFi
 		CONNECTED,	///< Connected to WiFi
+		SYNCING,	///< Requesting the common time
 		RINGING,	///< Send ring message
 		ERROR,		///< Error occured
 		ERROR_HANDLING,	///< Error being handled
+		REFRESHING,	///< Refreshing the bell directory
 		POWER_OFF,	///< Power off
 		POWERED_OFF,	///< Wait for door to power off
+		N_DOOR_STATES
 	};
 
+	typedef StateMachine<Door, door_state, N_DOOR_STATES> door_sm_t;
+
+	/// State table, see StateMachine.h
+	static const door_sm_t::state_t states[N_DOOR_STATES];
+
 	// Possible errors
 	enum error_type {
 		UNINITIALIZED,	 ///< Class only initialized with default constructor
@@ -72,9 +84,38 @@ class Door {
 
 	WiFiHandler wifi_handler;
 	RingSender ring_sender;
+	BellDirectory directory;
 
-	door_state state;
+	door_sm_t sm;
 	error_type err;
+	volatile bool err_shown;
+	clock_ms_t con_ms = 0;
+	ring_trace_t trace = {};	///< Trace context sent with the ring message (See RING_TLV_TRACE in ring_msg.h)
+	bool rf_drift = false;
+	bool wifi_started = false;
+	int8_t rssi = 0;
+	Deadline sync_deadline;
+	sched_task_t sync_task;
+
+	/**
+	 * @brief Callback for when the error code has been blinked
+	 * 
+	 * Invoked by the LEDEngine once the status LEDs have
+	 * blinked the error code, see error().
+	 * 
+	 * @param arg Pointer to the Door object
+	 */
+	static void on_error_shown(void *arg);
+
+	/**
+	 * @brief Crash handler callback, saves the crash record to flash
+	 * 
+	 * The record is reported to the bells with the next ring (See
+	 * RING_TLV_CRASH in ring_msg.h).
+	 * 
+	 * @param rec The crash record
+	 */
+	static void on_crash(const crash_record_t &rec);
 	
 	/**
 	 * @brief Prints the boot message
@@ -123,11 +164,41 @@ class Door {
 	 * The connected() function handles the CONNECTED state.
 	 * The CONNECTED state sends a ring message to all bells
 	 * via the RingSender class and then returns the RINGING
-	 * state.
+	 * state. If enabled, the ring is also broadcast over
+	 * ESP-NOW (See MeshRing.h).
 	 * 
-	 * @returns RIGHTING, the next state of the state machine.
+	 * If synchronised starts are enabled, the common time is
+	 * requested from the bells first, and the SYNCING state is
+	 * returned instead.
+	 * 
+	 * @returns RIGHTING or SYNCING, the next state of the state machine.
 	 */
 	door_state connected();
+
+	/**
+	 * @brief Handles the SYNCING state
+	 * 
+	 * The syncing() function handles the SYNCING state.
+	 * Once the common time has been received, the start of the
+	 * ring tone is scheduled SYNC_START_MARGIN_MS ahead and the
+	 * ring message is sent (See SyncClock.h). If no bell answers
+	 * within SYNC_QUERY_TIMEOUT_MS, the ring message is sent
+	 * without a start time, so bells ring right away.
+	 * 
+	 * @returns SYNCING, if still waiting for the common time.
+	 * 	    RINGING, once the ring message has been sent.
+	 */
+	door_state syncing();
+
+	/**
+	 * @brief Scheduler callback, wakes the loop once the time request has timed out
+	 * 
+	 * The timeout itself is tracked by sync_deadline, which is polled
+	 * in syncing(), so the callback does nothing.
+	 * 
+	 * @param arg Pointer to the Door object
+	 */
+	static void on_sync_timeout(void *arg);
 	
 	/**
 	 * @brief Handles the RINGING state
@@ -135,8 +206,11 @@ class Door {
 	 * If the RingSender is still awaiting a response, the RIGHTING
 	 * state will be returned.
 	 * 
+	 * Once the RingSender is done, a refresh of the bell directory
+	 * is started in the background (See BellDirectory.h).
+	 * 
 	 * If all bells have been rang, the connected() function will
-	 * return the POWER_OFF state.
+	 * return the REFRESHING state.
 	 * 
 	 * If some bells have been rang, but not all, the connected()
 	 * function will return the ERROR state and set the error type
@@ -147,7 +221,7 @@ class Door {
 	 * 
 	 * @returns The next state of the state machine:
 	 * 	    RINGING, if the RingSender is still awaiting a response.
-	 * 	    POWER_OFF, if all bells have been rang.
+	 * 	    REFRESHING, if all bells have been rang.
 	 * 	    ERROR (PARTIAL_SUCCESS), if some bells have been rang, but not all.
 	 * 	    ERROR (FAIL), if no bells have been rang.
 	 */
@@ -171,19 +245,34 @@ class Door {
 	 * @brief Handles the ERROR_HANDLING state
 	 * 
 	 * The error_handling() function handles the ERROR_HANDLING state.
-	 * The ERROR_HANDLING state handles the error by blinking the LED
-	 * and waiting for the user to reset the device.
+	 * The ERROR_HANDLING state waits until the status LEDs have
+	 * blinked the error code. As the LEDs are driven by the LEDEngine,
+	 * the CPU idles in the meantime instead of polling the LEDs.
 	 * 
 	 * @returns ERROR_HANDLING, if the error is still being handled or is fatal.
-	 * 	    POWER_OFF, once the error has been handled.
+	 * 	    REFRESHING, once the error has been handled.
 	 */
 	door_state error_handling();
 
+	/**
+	 * @brief Handles the REFRESHING state
+	 * 
+	 * The refreshing() function handles the REFRESHING state.
+	 * The REFRESHING state waits until the BellDirectory has
+	 * collected the beacons of the bells, if a refresh has been
+	 * started. The ring LED is already off at this point.
+	 * 
+	 * @returns REFRESHING, if the directory is still being refreshed.
+	 * 	    POWER_OFF, once done.
+	 */
+	door_state refreshing();
+
 	/**
 	 * @brief Handles the POWER_OFF state
 	 * 
 	 * The power_off() function handles the POWER_OFF state.
-	 * The POWER_OFF state unlatches the power latch and returns
+	 * The POWER_OFF state saves what has been learned during this
+	 * boot to the DoorStore, unlatches the power latch and returns
 	 * the POWERED_OFF state.
 	 * 
 	 * Ideally the POWER_OFF state should never be reached, as the
@@ -226,6 +315,11 @@ public:
 	 * of the Bell class. It is the entry point of the class
 	 * and must be continuously called in the main loop of
 	 * the program.
+	 * 
+	 * Before running the state machine, all components that are
+	 * due are run through the Scheduler. The main loop should call
+	 * Scheduler::idle() after each run() to sleep until the next
+	 * component is due.
 	*/
 	void run();
 };
\ No newline at end of file
@@ -20,6 +20,8 @@
 
 #include <WString.h>
 
+#include <ring_msg.h>
+
 /**
  * @file DoorCFG.h
  * @author Patrick Pedersen, TU-DO Makerspace
@@ -39,12 +41,18 @@ public:
 	uint16_t con_timeout_s = 0;
 	uint8_t n_bells = 0;
 	String ssid = "";
+	int32_t wifi_channel = 0;	///< Channel of the network (0 = scan)
 	String psk = "";
 	String static_ip = "";
 	String gateway = "";
 	String subnet = "";
 	uint16_t port = 0;
+	uint16_t discovery_port = 0;	///< UDP port bells announce themselves on (See BellDirectory.h)
 	unsigned long bell_timeout_ms = 0;
+	uint8_t ring_msg = RING_MSG;
+	bool mesh = false;		///< Additionally send rings over ESP-NOW (See MeshRing.h)
+	bool sync = false;		///< Schedule the start of the ring tone on all bells (See SyncClock.h)
+	uint16_t sync_port = 0;		///< UDP port for time requests
 
 	bool checkValidity();
 };
\ No newline at end of file
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file DoorStore.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Provides persistent storage for the door across power cycles
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include <CrashLog.h>
+#include <QuantileSketch.h>
+
+#define DOOR_STORE_MAGIC 0x44425354 // "DBST"
+#define DOOR_STORE_VERSION 7	    // Increment whenever door_record_t changes
+#define DOOR_STORE_MAX_BELLS 9	    // Bells in the directory (See BellDirectory.h)
+
+/**
+ * @brief Latency history of a single bell (See BellHistory.h)
+ */
+struct bell_hist_t {
+	uint16_t srtt;		///< Smoothed latency in ms
+	uint16_t rttvar;	///< Smoothed mean deviation of the latency in ms
+	uint16_t max;		///< Slowly decaying maximum latency in ms
+	uint8_t samples;	///< Number of successful rings recorded (saturates)
+	uint8_t fails;		///< Consecutive failed rings, restarts at 1 after DOOR_BELL_RELEARN_FAILS
+};
+
+/**
+ * @brief Directory entry of a single bell (See BellDirectory.h)
+ */
+struct bell_entry_t {
+	uint32_t ip;		///< IPv4 address of the bell
+	uint16_t port;		///< Port of the RingReceiver of the bell
+	uint8_t missed;		///< Consecutive directory refreshes the bell didn't answer
+	bell_hist_t hist;	///< Latency history of the bell
+};
+
+/**
+ * @brief Record persisted by the door
+ * 
+ * As the door is powered off between presses, anything that it
+ * should learn over time has to be stored here.
+ */
+struct door_record_t {
+	uint32_t magic;
+	uint16_t version;
+
+	// RF calibration (See RFCal.h)
+	uint16_t boots_since_cal;	///< Boots since the last full RF calibration
+	bool recal;			///< Request a full RF calibration on the next boot
+	uint16_t con_ms_full;		///< Average time from boot to WiFi connection after a full calibration
+	uint16_t con_ms_reduced;	///< Average time from boot to WiFi connection after a reduced calibration
+
+	// Bell directory (See BellDirectory.h), indexed like the RingTX instances of the RingSender
+	uint8_t n_bells;		///< Entries in use
+	uint8_t presses_since_refresh;	///< Presses since the directory was last refreshed
+	bell_entry_t bells[DOOR_STORE_MAX_BELLS];
+
+	// WiFi link (See LinkTuner.h)
+	uint8_t link_level;	///< Current TX power/PHY mode level
+	uint8_t link_streak;	///< Clean presses since the level was last changed
+	int8_t link_rssi;	///< RSSI on the last press in dBm
+	uint8_t link_retries;	///< Association retries on the last press
+
+	// ESP-NOW mesh (See MeshRing.h)
+	uint16_t mesh_seq;	///< Press counter, identifies rings across relays
+
+	// Latency distribution across all bells (See QuantileSketch.h)
+	quantile_sketch_t ack_sketch;	///< Connect to ack of the ring message in ms (See RingTX::ackLatency())
+
+	// Last crash (See CrashLog.h), written from the crash handler
+	crash_record_t crash;
+	bool crash_pending;	///< Crash not yet reported to a bell
+
+	uint32_t crc; ///< CRC32 of all preceding bytes, must remain last
+};
+
+/**
+ * @brief DoorStore class
+ * 
+ * The DoorStore keeps a single door_record_t in the flash sector
+ * reserved for the EEPROM. Rather than going through the EEPROM
+ * library, the sector is accessed through the SDK's flash functions,
+ * which allows the record to be loaded from RF_PRE_INIT(), before
+ * any global constructors have been run.
+ * 
+ * If no valid record is found (ex. first boot, or the layout has
+ * changed with a new DOOR_STORE_VERSION), a zeroed record is used.
+ * 
+ * Since the door only exists once, the DoorStore is implemented
+ * with static members only.
+ * 
+ * @attention Saving erases a flash sector, which lasts for roughly
+ * 100.000 erase cycles. The record should therefore only be saved
+ * once per boot.
+ */
+class DoorStore {
+private:
+	inline static door_record_t rec;
+	inline static bool valid;
+
+	/**
+	 * @brief Returns the flash sector the record is stored in
+	 */
+	static uint32_t sector();
+
+	/**
+	 * @brief Returns the CRC32 of the current record
+	 */
+	static uint32_t crc();
+
+public:
+	/**
+	 * @brief Loads the record from flash
+	 * 
+	 * Safe to be called from RF_PRE_INIT().
+	 * 
+	 * @returns true If a valid record has been loaded,
+	 * 	    false If the record has been reset
+	 */
+	static bool load();
+
+	/**
+	 * @brief Writes the record to flash
+	 * 
+	 * @returns true If the record has been written successfully
+	 */
+	static bool save();
+
+	/**
+	 * @brief Returns true if the record was loaded from flash
+	 */
+	static bool loaded();
+
+	/**
+	 * @brief Returns the record
+	 * 
+	 * Changes are only persisted once save() is called.
+	 */
+	static door_record_t &record();
+};
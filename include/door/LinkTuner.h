@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file LinkTuner.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Selects the WiFi TX power and PHY mode of the door
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <ESP8266WiFi.h>
+
+/// A TX power and PHY mode combination
+struct link_level_t {
+	WiFiPhyMode_t phy;
+	float dbm;
+};
+
+/**
+ * @brief LinkTuner class
+ * 
+ * By default the door transmits at full power, regardless of how
+ * close it is to the access point. Both the TX power and the PHY
+ * mode affect the peak current, which on a weak battery may cause
+ * brownouts during association.
+ * 
+ * The LinkTuner walks a ladder of link levels, ordered from the most
+ * efficient (802.11n at low power) to the most robust (802.11b at full
+ * power). After DOOR_LINK_STEP_DOWN_AFTER clean presses in a row, it
+ * tries the next lower level, unless the RSSI measured on the last
+ * press is below DOOR_LINK_STEP_DOWN_RSSI. A press counts as clean if
+ * the association succeeded on the first attempt. Whether the bells
+ * rang isn't taken into account, as bells failing are more likely
+ * powered off than out of reach. Otherwise, the level is raised again,
+ * straight to the most robust one if WiFi couldn't be joined at all.
+ * 
+ * The current level, as well as the statistics of the last press,
+ * are kept in the DoorStore.
+ * 
+ * Since the door only exists once, the LinkTuner is implemented
+ * with static members only.
+ */
+class LinkTuner {
+public:
+	/// Outcome of a press
+	enum link_result {
+		LINK_CLEAN,	///< Association succeeded on first attempt
+		LINK_DEGRADED,	///< Association needed retries
+		LINK_NO_WIFI	///< WiFi couldn't be joined
+	};
+
+	/**
+	 * @brief Applies the stored link level
+	 * 
+	 * Must be called before connecting to WiFi.
+	 */
+	static void apply();
+
+	/**
+	 * @brief Records the outcome of the current press and selects the next level
+	 * 
+	 * Updates the DoorStore record, but doesn't save it.
+	 * 
+	 * @param result The outcome of the press
+	 * @param rssi The RSSI to the access point in dBm (0 = not connected)
+	 * @param retries The number of failed association attempts
+	 */
+	static void report(link_result result, int8_t rssi, uint8_t retries);
+};
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file RFCal.h
+ * @author Patrick Pedersen, TU-DO Makerspace
+ * @brief Selects the RF calibration performed on door boot
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#include <Clock.h>
+
+#define RF_CAL_OPTION_FULL 3 // Full RF calibration (~200ms)
+
+/**
+ * @brief RFCal class
+ * 
+ * Since the door is powered off between presses, it cold boots on
+ * every ring. By default, the SDK performs a full RF calibration on
+ * every cold boot, which delays any WiFi traffic. The calibration
+ * data is kept in flash by the SDK, so the RFCal class instead selects
+ * a reduced calibration (see DOOR_RF_CAL_OPTION) that reuses it.
+ * 
+ * A full calibration is forced if:
+ * 	- No DoorStore record exists (ex. first boot after flashing)
+ * 	- DOOR_RF_CAL_MAX_BOOTS boots have passed since the last full calibration
+ * 	- The last boot failed to connect to WiFi or to reach any bell,
+ * 	  in which case the stored data is suspected to be off, for
+ * 	  instance due to temperature drift
+ * 
+ * The time from boot to WiFi connection is averaged for both
+ * calibration types and logged, to show the time saved.
+ */
+class RFCal {
+private:
+	inline static bool full;
+
+public:
+	/**
+	 * @brief Selects the RF calibration for the current boot
+	 * 
+	 * Must be called from RF_PRE_INIT(). Loads the DoorStore.
+	 */
+	static void preInit();
+
+	/**
+	 * @brief Returns true if a full calibration has been performed on this boot
+	 */
+	static bool fullCal();
+
+	/**
+	 * @brief Records the outcome of the current boot
+	 * 
+	 * Updates the DoorStore record, but doesn't save it.
+	 * 
+	 * @param con_ms Time from boot to WiFi connection in ms (0 = not connected)
+	 * @param drift true if the RF calibration is suspected to be off
+	 */
+	static void report(clock_ms_t con_ms, bool drift);
+};
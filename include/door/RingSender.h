@@ -26,7 +26,10 @@
 
 #include <inttypes.h>
 
-#include <door/RingTX.h>
+#include <RingTX.h>
+#include <Scheduler.h>
+
+#define RING_SENDER_POLL_MS 10 // Poll interval while sending, connects are handled right away
 
 /**
  * @brief The RingSender class.
@@ -37,21 +40,10 @@
  * It does so by creating a RingTX instance for each bell, and
  * checking if the bell has responded.
  * 
- * @attention For convenience reasons, we do not parse a fixed
- * list of bell IP addresses to the RingReceiver, but instead rely
- * on bells to reserve ip addresses following the door's ip address.
- * 
- * ```
- * Ex.:
- * Door  IP: 192.168.0.30
- * Bell1 IP: 192.168.0.31
- * Bell2 IP: 192.168.0.32
- * ...
- * BellX IP: 192.168.0.30 + X 
- * ```
- * 
- * To add bells to our network, we simply only have to update
- * the doors N_BELLS configuration parameter in the config.h file.
+ * The bells are taken from the bell directory in the DoorStore,
+ * which is learned from the beacons of the bells (See BellDirectory.h),
+ * so no lookups are needed at ring time. The directory must therefore
+ * be set up before the RingSender is constructed.
  */
 class RingSender {
 public:
@@ -68,8 +60,23 @@ public:
 private:
 	uint8_t n_bells;
 	RingTX* tx;
+	unsigned long timeout_ms;
 
 	ring_stat stat;
+	sched_task_t task;
+
+	/**
+	 * @brief Records the outcome of each bell in its latency history
+	 * 
+	 * Updates the DoorStore record, but doesn't save it.
+	 */
+	void learn();
+
+	/**
+	 * @brief Scheduler callback, updates the RingSender
+	 * @param arg Pointer to the RingSender object
+	 */
+	static void on_task(void *arg);
 
 public:
 	/**
@@ -85,12 +92,13 @@ public:
 	
 	/**
 	 * @brief Constructor
-	 * @param door_ip The IP address of the door
-	 * @param port The port of the bell receivers
-	 * @param n_bells The number of bells to send the ring message to
-	 * @param timeout The timeout for the ring message
+	 * 
+	 * Creates a RingTX instance for each bell in the bell directory.
+	 * 
+	 * @param timeout_ms The upper bound for the timeout of each bell (See BellHistory.h)
+	 * @param msg The ring message to send (See ring_msg.h)
 	 */
-	RingSender(IPAddress door_ip, unsigned int port, uint8_t n_bells, unsigned long timeout_ms);
+	RingSender(unsigned long timeout_ms, uint8_t msg = RING_MSG);
 	
 	/**
 	 * @brief Destructor
@@ -121,6 +129,26 @@ public:
 	 */
 	uint8_t acks();
 
+	/**
+	 * @brief Number of bells that received the ring message
+	 * 
+	 * Unlike acks(), only counts bells that have acknowledged
+	 * the ring message on the TCP level (See RingTX::delivered()).
+	 * 
+	 * @returns The number of bells the ring message has been delivered to
+	 */
+	uint8_t delivered();
+
+	/**
+	 * @brief Adds the ack latencies of the bells to the latency sketch
+	 * 
+	 * Only bells the ring message has been delivered to are accounted
+	 * (See RingTX::ackLatency()). As acks may arrive after the ring has
+	 * been sent, this should be called as late as possible (ex. before
+	 * powering off). Updates the DoorStore record, but doesn't save it.
+	 */
+	void learnAcks();
+
 	/**
 	 * @brief Number of bells that failed to acknowledge
 	 * 
@@ -137,11 +165,43 @@ public:
 	 * 
 	 * The following function sends a ring message to all bells.
 	 * This is done by creating a RingTX instance for each bell.
+	 * The timeout of each bell is derived from its latency history.
 	 * 
 	 * This will put the RingSender into the SENDING state.
 	 */
 	void send();
 
+	/**
+	 * @brief Schedules the start of the ring tone on all bells
+	 * 
+	 * Must be called before send(), see RingTX::setStartAt().
+	 * 
+	 * @param start_at The start of the ring tone in common time (us)
+	 */
+	void setStartAt(uint32_t start_at);
+
+	/**
+	 * @brief Adds a TLV to the ring message sent to all bells
+	 * 
+	 * See RingTX::addTLV(), the value must remain valid until
+	 * the RingSender is done.
+	 */
+	void addTLV(uint8_t type, const void *val, uint8_t len);
+
+	/**
+	 * @brief Adds the trace context of the press to the ring message sent to all bells
+	 * 
+	 * Must be called before send(), see RingTX::setTrace().
+	 */
+	void setTrace(const ring_trace_t &t);
+
+	/**
+	 * @brief Adds the press counter to the ring message sent to all bells
+	 * 
+	 * Must be called before send(), see RingTX::setSeq().
+	 */
+	void setSeq(uint16_t seq);
+
 	/**
 	 * @brief Status of the RingSender
 	 * 
@@ -168,8 +228,10 @@ public:
 	 * @brief Updates the RingSender state machine
 	 * 
 	 * The following function updates the RingSender state machine.
-	 * Ensure that this function is called continuously!
-	 *  
+	 * 
+	 * While sending, the RingSender schedules its own updates through
+	 * the Scheduler, so there is no need to call this method from the
+	 * main loop.
 	 */
 	void update();
 };
\ No newline at end of file
@@ -27,6 +27,7 @@
 #include <ESP8266WiFi.h>
 
 #include <config.h>
+#include <CrashLog.h>
 
 #include <door/power_latch.h>
 
@@ -46,6 +47,7 @@
 inline void FALLBACK_ERROR()
 {
 	log_msg("FALLBACK_ERROR", "Entered fallback error mode, something went horribly wrong!");
+	CrashLog::fault(CRASH_REASON_FALLBACK);
 
 	pinMode(DOOR_POWER_LED, OUTPUT);
 	pinMode(DOOR_RING_LED, OUTPUT);
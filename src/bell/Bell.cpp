@@ -32,16 +32,35 @@
 #include <config.h>
 
 #include <log.h>
+#include <EspNow.h>
+#include <EventTrace.h>
+#include <HeapMonitor.h>
+#include <LoopProfiler.h>
 #include <StatusLED.h>
+#include <Scheduler.h>
+#include <trace.h>
 
 #include <bell/fallback_error.h>
 #include <bell/Bell.h>
 
+// State table, transitions are handled through the return values of the state functions
+constexpr Bell::bell_sm_t::state_t Bell::states[] = {
+	{ INIT,			&Bell::init,		NULL,	NULL,			"INIT",			SM_TO(DISCONNECTED) },
+	{ DISCONNECTED,		&Bell::disconnected,	NULL,	NULL,			"DISCONNECTED",		SM_TO(CONNECTING) },
+	{ CONNECTING,		&Bell::connecting,	NULL,	NULL,			"CONNECTING",		SM_TO(CONNECTED) },
+	{ CONNECTED,		&Bell::connected,	NULL,	NULL,			"CONNECTED",		SM_TO(RINGING) | SM_TO(DISCONNECTED) },
+	{ RINGING,		&Bell::ringing,		NULL,	&Bell::exit_ringing,	"RINGING",		SM_TO(CONNECTED) },
+	{ ERROR,		&Bell::error,		NULL,	NULL,			"ERROR",		SM_TO(ERROR_HANDLING) },
+	{ ERROR_HANDLING,	&Bell::error_handling,	NULL,	NULL,			"ERROR_HANDLING",	0 },
+};
+
 // Refer to header for documentation
 Bell::Bell()
 {
+	static_assert(bell_sm_t::ordered(states), "Bell state table must follow the order of bell_state");
+
 	err = UNINITIALIZED;
-	state = ERROR;
+	sm = bell_sm_t(states, ERROR);
 }
 
 // Refer to header for documentation
@@ -49,6 +68,9 @@ Bell::Bell(BellCFG bell_cfg) : cfg(bell_cfg)
 {
 	log_msg("Bell::Bell", "Initializing bell");
 
+	// Before anything can fail
+	CrashLog::begin();
+
 	if (!cfg.checkValidity()) {
 		if (cfg.led_pin == -1) {
 			 // We can't display error codes if LED pin isn't initialized!
@@ -58,12 +80,19 @@ Bell::Bell(BellCFG bell_cfg) : cfg(bell_cfg)
 		}
 
 		err = CFG_INVALID;
-		state = ERROR;
+		sm = bell_sm_t(states, ERROR);
 		return;
 	}
 
+	prering_task.prof = PROF_MAIN;
+	start_task.prof = PROF_MAIN;
+
 	led = StatusLED(cfg.led_pin);
-	buzzer = Buzzer(cfg.buzzer_pin, BELL_MELODY, MELODY_LEN(BELL_MELODY));
+	buzzer = Buzzer(cfg.buzzer_pin, BELL_MELODY, MELODY_LEN(BELL_MELODY),
+			BELL_SAMPLE_FILE, BELL_SAMPLE_RATE);
+	buzzer.setMelody(RING_CLASS_URGENT, BELL_URGENT_MELODY, MELODY_LEN(BELL_URGENT_MELODY));
+	buzzer.setMelody(RING_CLASS_TEST, BELL_TEST_MELODY, MELODY_LEN(BELL_TEST_MELODY));
+	buzzer.setCoalescePolicy(BELL_RING_COALESCE);
 
 	IPAddress ip, gateway, subnet;
 	ip.fromString(cfg.static_ip);
@@ -76,9 +105,29 @@ Bell::Bell(BellCFG bell_cfg) : cfg(bell_cfg)
 		0
 	);
 
+	// The radio can't sleep while hosting the access point,
+	// so the sleep mode only applies to other bells
+	if (cfg.door_ap) {
+		IPAddress ap_ip, door_ip;
+		ap_ip.fromString(cfg.ap_ip);
+		door_ip.fromString(cfg.relay_door_ip);
+
+		door_ap = DoorAP(cfg.ap_ssid, cfg.ap_psk, ap_ip, cfg.ap_channel);
+		relay = RingRelay(door_ip, ip, cfg.port, cfg.relay_n_bells, cfg.relay_timeout_ms);
+
+		if (cfg.prering)
+			pre_ring = PreRing(cfg.door_mac);
+	} else if (!cfg.mesh && !cfg.sync) {
+		// ESP-NOW frames must be heard at any time, see MeshRing.h
+		wifi_handler.setSleepMode(cfg.sleep_mode, cfg.listen_interval);
+	}
+
+	if (cfg.discovery_port != 0)
+		beacon = BellBeacon(cfg.discovery_port, cfg.port);
+
 	ring_receiver = RingReceiver::get_instance();
 
-	state = INIT;
+	sm = bell_sm_t(states, INIT);
 }
 
 // Refer to header for documentation
@@ -109,11 +158,184 @@ void Bell::bootMSG()
 Bell::bell_state Bell::init()
 {
 	bootMSG();
+	LoopProfiler::begin(LOOP_STALL_MS);
+	HeapMonitor::begin(HEAP_SAMPLE_MS, HEAP_FRAG_ALERT, HEAP_MIN_BLOCK);
+	EventTrace::begin("bell", N_BELL_STATES, [](uint8_t s, void *arg) { return states[s].name; }, NULL);
+	EVT(EVT_STATE, INIT, 0);
+
+	if (cfg.door_ap)
+		door_ap.begin(); // Before the station connects, see DoorAP.h
+
+	if (cfg.prering)
+		pre_ring.begin();
+
 	wifi_handler.connect();
 	ring_receiver->begin(cfg.port, cfg.door_ip);
+
+	if (cfg.mesh)
+		MeshRing::begin(true, cfg.mesh_door_mac.c_str());
+
+	if (cfg.sync)
+		SyncClock::begin(cfg.sync_master, cfg.sync_port);
+
+	if (cfg.relay_ip != "")
+		ring_receiver->allow(cfg.relay_ip);
+
+	if (cfg.discovery_port != 0)
+		beacon.begin();
+
+	if (cfg.metrics_port != 0) {
+		register_metrics();
+		MetricsServer::begin(cfg.metrics_port);
+	}
+
 	return DISCONNECTED;
 }
 
+// Refer to header for documentation
+void Bell::register_metrics()
+{
+	const ring_rx_stats_t &rx = ring_receiver->stats();
+
+	MetricsServer::counter("doorbell_rings_received_total", "Ring messages received over TCP", &rx.rings);
+	MetricsServer::counter("doorbell_clients_rejected_total", "Connections rejected, as not from the door or busy", &rx.rejected);
+	MetricsServer::counter("doorbell_packets_invalid_total", "Invalid packets received", &rx.invalid);
+	MetricsServer::counter("doorbell_client_timeouts_total", "Client timeouts", &rx.timeouts);
+	MetricsServer::counter("doorbell_client_errors_total", "Client errors", &rx.errors);
+	MetricsServer::counter("doorbell_door_crashes_total", "Crashes reported by the door", &rx.crashes);
+	MetricsServer::info("doorbell_crash_info", "Last crash of the bell", &own_crash_labels, NULL);
+	MetricsServer::info("doorbell_door_crash_info", "Last crash reported by the door", &door_crash_labels, ring_receiver);
+	MetricsServer::info("doorbell_ring_trace_info", "Phase timings of the last ring, door and bell", &trace_labels, &joined);
+	MetricsServer::counter("doorbell_wifi_reconnects_total", "Connections re-established after a disconnect",
+			       &wifi_reconnects, &wifi_handler);
+
+	const heap_stats_t &heap = HeapMonitor::stats();
+
+	MetricsServer::gauge("doorbell_heap_free_min_bytes", "Lowest free heap seen", &heap.free_min);
+	MetricsServer::gauge("doorbell_heap_max_block_min_bytes", "Smallest largest free heap block seen", &heap.max_block_min);
+	MetricsServer::gauge("doorbell_heap_fragmentation_max_percent", "Highest heap fragmentation seen", &heap.frag_max);
+	MetricsServer::gauge("doorbell_stack_free_min_bytes", "Stack high-water mark of the main loop", &heap.stack_free_min);
+	MetricsServer::counter("doorbell_heap_alerts_total", "Times the heap fragmentation crossed HEAP_FRAG_ALERT", &heap.alerts);
+
+	const prof_stats_t &prof = LoopProfiler::stats();
+
+	MetricsServer::summary("doorbell_loop_latency_us", "Duration of main loop iterations", &LoopProfiler::loopSketch());
+	MetricsServer::gauge("doorbell_loop_latency_max_us", "Longest main loop iteration", &prof.loop_max_us);
+	MetricsServer::gauge("doorbell_loop_gap_max_us", "Longest time between iterations beyond the planned idle time", &prof.gap_max_us);
+	MetricsServer::counter("doorbell_loop_stalls_total", "Iterations that tripped the stall watchdog", &prof.stalls);
+	MetricsServer::counter("doorbell_loop_wifi_us_total", "Loop time spent in the WiFiHandler", &prof.comp_us[PROF_WIFI]);
+	MetricsServer::counter("doorbell_loop_buzzer_us_total", "Loop time spent in the Buzzer", &prof.comp_us[PROF_BUZZER]);
+	MetricsServer::counter("doorbell_loop_led_us_total", "Time spent in the LEDEngine", &prof.comp_us[PROF_LED]);
+	MetricsServer::counter("doorbell_loop_log_us_total", "Time spent writing log messages", &prof.log_us);
+	MetricsServer::summary("doorbell_ring_latency_us", "Reception to first note", &ring_sketch);
+	MetricsServer::gauge("doorbell_ring_latency_max_us", "Longest reception to first note", &ring_latency_max_us);
+
+	if (cfg.mesh) {
+		const mesh_stats_t &m = MeshRing::stats();
+		MetricsServer::counter("doorbell_mesh_rings_total", "Rings received over ESP-NOW", &m.rx);
+		MetricsServer::counter("doorbell_mesh_duplicates_total", "Duplicate ESP-NOW frames suppressed", &m.dups);
+		MetricsServer::counter("doorbell_mesh_foreign_total", "ESP-NOW frames of other origins dropped", &m.foreign);
+		MetricsServer::counter("doorbell_mesh_forwarded_total", "ESP-NOW frames forwarded", &m.fwd);
+		MetricsServer::counter("doorbell_mesh_lost_total", "Rings missed over ESP-NOW", &m.lost);
+	}
+
+	if (cfg.sync) {
+		const sync_stats_t &s = SyncClock::stats();
+		MetricsServer::gauge("doorbell_sync_skew_us", "Spread of the start of the last scheduled ring across bells", &s.skew_us);
+		MetricsServer::gauge("doorbell_sync_skew_max_us", "Largest start skew across bells seen", &s.skew_peak_us);
+		MetricsServer::gauge("doorbell_sync_peer_offset_us", "Largest clock offset to another bell at the last scheduled ring", &s.peer_us);
+		MetricsServer::gauge("doorbell_sync_offset_us", "Clock offset to the master before the last beacon", &sync_offset, NULL, true);
+	}
+}
+
+// Refer to header for documentation
+uint32_t Bell::wifi_reconnects(void *arg)
+{
+	return ((WiFiHandler *)arg)->reconnects();
+}
+
+// Refer to header for documentation
+uint32_t Bell::sync_offset(void *arg)
+{
+	return SyncClock::stats().offset_us;
+}
+
+// Refer to header for documentation
+bool Bell::crash_labels(const crash_record_t *rec, char *buf, size_t len)
+{
+	if (rec == NULL)
+		return false;
+
+	snprintf(buf, len, "reason=\"%u\",exccause=\"%u\",epc1=\"0x%08lx\",excvaddr=\"0x%08lx\","
+		 "uptime_ms=\"%lu\",component=\"%s\",states=\"%u,%u,%u,%u\",stack=\"0x%08lx,0x%08lx,0x%08lx,0x%08lx\"",
+		 rec->reason, rec->exccause, (unsigned long)rec->epc1, (unsigned long)rec->excvaddr,
+		 (unsigned long)rec->uptime_ms, LoopProfiler::name((prof_component)rec->comp),
+		 rec->states[0], rec->states[1], rec->states[2], rec->states[3],
+		 (unsigned long)rec->stack[0], (unsigned long)rec->stack[1],
+		 (unsigned long)rec->stack[2], (unsigned long)rec->stack[3]);
+
+	return true;
+}
+
+// Refer to header for documentation
+bool Bell::own_crash_labels(char *buf, size_t len, void *arg)
+{
+	return crash_labels(CrashLog::last(), buf, len);
+}
+
+// Refer to header for documentation
+bool Bell::door_crash_labels(char *buf, size_t len, void *arg)
+{
+	return crash_labels(((RingReceiver *)arg)->doorCrash(), buf, len);
+}
+
+// Refer to header for documentation
+bool Bell::trace_labels(char *buf, size_t len, void *arg)
+{
+	const ring_trace_join_t *t = (const ring_trace_join_t *)arg;
+
+	if (t->n == 0)
+		return false;
+
+	snprintf(buf, len, "id=\"%lx\",boot_ms=\"%u\",assoc_ms=\"%u\",connect_ms=\"%u\",send_us=\"%u\","
+		 "total_ms=\"%u\",parse_us=\"%lu\",queue_us=\"%lu\",note_us=\"%lu\"",
+		 (unsigned long)t->door.id, t->door.boot_ms, t->door.assoc_ms, t->door.connect_ms, t->door.send_us,
+		 t->door.total_ms, (unsigned long)t->parse_us, (unsigned long)t->queue_us, (unsigned long)t->note_us);
+
+	return true;
+}
+
+// Refer to header for documentation
+void Bell::join_trace()
+{
+	unsigned long arrived, parsed;
+
+	if (last_path != PATH_TCP || !ring_receiver->trace(&joined.door, &arrived, &parsed))
+		return;
+
+	joined.parse_us = parsed - arrived;
+	joined.queue_us = pick_us - parsed;
+	joined.note_us = buzzer.firstNoteAt() - pick_us;
+	joined.n++;
+
+	const ring_trace_t &d = joined.door;
+
+	log_msg("Bell::join_trace", "Ring " + String(d.id, HEX) + ": door: boot " + String(d.boot_ms) +
+		"ms, associate " + String(d.assoc_ms) + "ms, connect " + String(d.connect_ms) + "ms, send " +
+		String(d.send_us) + "us, " + String(d.total_ms) + "ms in total; bell: parse " + String(joined.parse_us) +
+		"us, queue " + String(joined.queue_us) + "us, first note " + String(joined.note_us) + "us");
+}
+
+// Refer to header for documentation
+void Bell::relay_ring(ring_class cls, const uint32_t *start_at)
+{
+	ring_trace_t trace;
+	unsigned long arrived, parsed;
+	bool traced = last_path == PATH_TCP && ring_receiver->trace(&trace, &arrived, &parsed);
+
+	relay.send(cls, start_at, last_has_seq ? &last_seq : NULL, traced ? &trace : NULL);
+}
+
 // Refer to header for documentation
 Bell::bell_state Bell::disconnected()
 {
@@ -127,6 +349,19 @@ Bell::bell_state Bell::connecting()
 {
 	if (wifi_handler.status() == WiFiHandler::CONNECTED) {
 		led.mode(StatusLED::OFF);
+
+		// ESP-NOW was started before the channel was known
+		if (cfg.mesh || cfg.sync)
+			EspNow::rejoin();
+
+		if (cfg.discovery_port != 0) {
+			beacon.announce();
+
+			// Learn the bells to relay to, see RingRelay.h
+			if (cfg.door_ap)
+				beacon.query();
+		}
+
 		return CONNECTED;
 	}
 
@@ -139,12 +374,90 @@ Bell::bell_state Bell::connected()
 	// Calling received() will reset the return value
 	// to false after each call. That way we don't  keep 
 	// entering this condition when a ring has been received.
-	if (ring_receiver->received()) {
+	ring_class cls;
+
+	if (ring_received(&cls)) {
+		TRACE_HIGH(BELL_RING);
+		pick_us = micros();
+		uint32_t at;
+		bool scheduled = cfg.sync && last_path == PATH_TCP && ring_receiver->startAt(&at);
+
+		if (cfg.door_ap)
+			relay_ring(cls, scheduled ? &at : NULL);
+
+		if (scheduled && schedule_start(cls, at))
+			return RINGING;
+
 		led.mode(StatusLED::ON);
-		buzzer.ring();
+
+		// Time from the packet arriving to the first note being played,
+		// this includes any delay introduced by the idle loop. A ring
+		// that didn't start a ring tone has no first note of its own.
+		if (buzzer.ring(cls)) {
+			join_trace();
+
+			ring_latency_us = buzzer.firstNoteAt() - ring_us;
+			if (ring_latency_us > ring_latency_max_us)
+				ring_latency_max_us = ring_latency_us;
+
+			QuantileSketch::add(ring_sketch, ring_latency_us);
+
+			log_msg("Bell::connected", "Wake-to-first-note latency: " + String(ring_latency_us) +
+				"us (p50: " + String(QuantileSketch::quantile(ring_sketch, 500)) +
+				"us, p95: " + String(QuantileSketch::quantile(ring_sketch, 950)) +
+				"us, p99: " + String(QuantileSketch::quantile(ring_sketch, 990)) +
+				"us, max: " + String(ring_latency_max_us) + "us)");
+		}
+
+		if (cfg.mesh) {
+			const mesh_stats_t &m = MeshRing::stats();
+			log_msg("Bell::connected", "Mesh: " + String(m.rx) + " rings, " + String(m.dups) + " duplicates, " +
+				String(m.fwd) + " forwarded (" + String(m.fwd_dropped) + " dropped), delivery: " +
+				String(MeshRing::deliveryRatio() / 10.0) + "%, hop latency: " + String(m.hop_us_avg) +
+				"us (max: " + String(m.hop_us_max) + "us), last ring: " + String(m.last_hops) + 
+				" hops, " + String(m.last_relay_us) + "us in relays");
+		}
+
+		return RINGING;
+	}
+
+	if (cfg.prering && pre_ring.triggered()) {
+		TRACE_HIGH(BELL_RING);
+		log_msg("Bell::connected", "Door detected, ringing ahead of the ring message");
+
+		led.mode(StatusLED::ON);
+
+		if (buzzer.ring(RING_CLASS_NORMAL))
+			log_msg("Bell::connected", "Detection-to-first-note latency: " + 
+				String(buzzer.firstNoteAt() - pre_ring.triggeredAt()) + "us");
+
+		// Make sure the loop wakes up to cancel the ring
+		speculative = true;
+		prering_deadline.in(cfg.prering_window_ms);
+		Scheduler::schedule(&prering_task, cfg.prering_window_ms, &on_prering_timeout, this);
+
 		return RINGING;
 	}
 
+	// Bells heard by the beacon, kept until the current relay is done
+	if (cfg.door_ap && cfg.discovery_port != 0) {
+		IPAddress bell_ip;
+		uint16_t bell_port;
+
+		while (!relay.busy() && beacon.heard(&bell_ip, &bell_port))
+			relay.learn(bell_ip, bell_port);
+	}
+
+	// Reboot between rings, rather than having a ring fail
+	// later on as AsyncTCP runs out of memory
+	if (HeapMonitor::pressure()) {
+		const heap_stats_t &h = HeapMonitor::stats();
+		log_msg("Bell::connected", "Heap under pressure (free: " + String(h.free) + " bytes, largest block: " +
+			String(h.max_block) + " bytes, fragmentation: " + String(h.frag) + "%), rebooting!");
+		CrashLog::fault(CRASH_REASON_HEAP);
+		ESP.restart();
+	}
+
 	if (wifi_handler.status() == WiFiHandler::DISCONNECTED)
 		return DISCONNECTED;
 
@@ -154,14 +467,187 @@ Bell::bell_state Bell::connected()
 // Refer to header for documentation
 Bell::bell_state Bell::ringing()
 {
+	ring_class cls;
+
+	// Rings received while ringing are pre-empted or
+	// coalesced by the Buzzer, depending on their class
+	if (ring_received(&cls)) {
+		if (cfg.door_ap)
+			relay_ring(cls, NULL);
+
+		if (start_pending) {
+			// Join the scheduled start
+			if (cls > start_class)
+				start_class = cls;
+		} else if (speculative) {
+			log_msg("Bell::ringing", "Pre-ring confirmed, first note played " + 
+				String((long)(ring_us - buzzer.firstNoteAt()) / 1000) +
+				"ms ahead of the ring message");
+
+			speculative = false;
+			Scheduler::cancel(&prering_task);
+
+			// The normal ring tone is already playing
+			if (cls != RING_CLASS_NORMAL)
+				buzzer.ring(cls);
+		} else {
+			buzzer.ring(cls);
+		}
+	}
+
+	// Further frames of the door belong to the current ring
+	if (cfg.prering)
+		pre_ring.triggered();
+
+	if (speculative) {
+		if (prering_deadline.expired()) {
+			log_msg("Bell::ringing", "No ring message received, cancelling pre-ring");
+			speculative = false;
+			buzzer.stop();
+			return CONNECTED;
+		}
+
+		// Keep waiting for the ring message, even if the
+		// ring tone has finished, to avoid ringing twice
+		return RINGING;
+	}
+
+	if (start_pending)
+		return RINGING;
+
 	if (!buzzer.ringing()) {
-		led.mode(StatusLED::OFF);
+
+		if (cfg.sync) {
+			uint8_t n;
+			uint32_t skew = SyncClock::skew(&n);
+			log_msg("Bell::ringing", "Start skew across " + String(n) + " bells: " + String(skew) +
+				"us (peak: " + String(SyncClock::skewPeak()) + "us)");
+		}
+
+		LoopProfiler::report();
+#ifdef DEBUG
+		sm.report("Bell::ringing"); // Builds a String per state, too much churn after every ring
+#endif
 		return CONNECTED;
 	}
 
 	return RINGING;
 }
 
+// Refer to header for documentation
+void Bell::exit_ringing()
+{
+	led.mode(StatusLED::OFF);
+	TRACE_LOW(BELL_RING);
+}
+
+// Refer to header for documentation
+bool Bell::schedule_start(ring_class cls, uint32_t at)
+{
+	if (!SyncClock::synced()) {
+		log_msg("Bell::schedule_start", "Not synced, ringing right away");
+		return false;
+	}
+
+	int32_t wait_us = at - (uint32_t)SyncClock::now();
+
+	if (wait_us <= 0 || wait_us > (int32_t)SYNC_MAX_WAIT_MS * 1000) {
+		log_msg("Bell::schedule_start", "Start time out of range (" + String(wait_us) + "us), ringing right away");
+		return false;
+	}
+
+	start_pending = true;
+	start_class = cls;
+	start_at = at;
+
+	// The Scheduler counts in ms, so the start task is due on the first
+	// ms at or after the start, which keeps the error below a ms plus
+	// the loop latency without blocking the loop
+	uint64_t now_us = Clock::nowUs();
+	uint64_t start_us = now_us + wait_us;
+	Scheduler::schedule(&start_task, (start_us + 999) / 1000 - now_us / 1000, &on_start, this);
+
+	log_msg("Bell::schedule_start", "Ring tone scheduled in " + String(wait_us) + "us");
+	return true;
+}
+
+// Refer to header for documentation
+void Bell::on_start(void *arg)
+{
+	((Bell *)arg)->start_scheduled();
+}
+
+// Refer to header for documentation
+void Bell::start_scheduled()
+{
+	start_pending = false;
+	led.mode(StatusLED::ON);
+
+	// A ring tone that is still playing has no start to report
+	if (buzzer.ring(start_class)) {
+		int32_t err_us = SyncClock::common(buzzer.firstNoteAt()) - start_at;
+		SyncClock::report(start_at, err_us);
+
+		log_msg("Bell::start_scheduled", "Ring tone started " + String(err_us) + "us off schedule");
+		join_trace();
+	}
+
+	Scheduler::wake();
+}
+
+// Refer to header for documentation
+bool Bell::ring_received(ring_class *cls)
+{
+	ring_class c;
+	ring_path path;
+	unsigned long us;
+	uint16_t seq;
+	bool has_seq;
+
+	while (true) {
+		if (ring_receiver->received(&c)) {
+			path = PATH_TCP;
+			us = ring_receiver->receivedAt();
+			has_seq = ring_receiver->seq(&seq);
+		} else if (cfg.mesh && MeshRing::received(&c)) {
+			path = PATH_MESH;
+			us = MeshRing::receivedAt();
+			seq = MeshRing::receivedSeq();
+			has_seq = true;
+		} else {
+			return false;
+		}
+
+		// The same press, arriving over the other path
+		if (path != last_path && has_seq && last_has_seq && seq == last_seq &&
+		    !dedup_deadline.expired()) {
+			log_msg("Bell::ring_received", "Ring " + String(seq) +
+				" already received over the other path, dropping duplicate");
+			continue;
+		}
+
+		break;
+	}
+
+	ring_us = us;
+	last_path = path;
+	last_has_seq = has_seq;
+	last_seq = seq;
+	dedup_deadline.in(MESH_DEDUP_WINDOW_MS);
+
+	*cls = c;
+	return true;
+}
+
+// Refer to header for documentation
+void Bell::on_prering_timeout(void *arg)
+{
+	// Intentionally empty: Scheduler::idle() only wakes for scheduled tasks,
+	// so this task merely keeps the loop from idling past prering_deadline.
+	// The deadline itself is checked by ringing(), which runs right after
+	// the Scheduler in the same loop iteration.
+}
+
 // Refer to header for documentation
 Bell::bell_state Bell::error()
 {
@@ -192,7 +678,7 @@ Bell::bell_state Bell::error_handling()
 {
 	switch(err) {
 		case UNINITIALIZED: 	break;	// This should never occur but keeps the compiler happy
-		case CFG_INVALID: 	break;	// Blinks led, nothing to handle (taken care of by StatusLED.update())
+		case CFG_INVALID: 	break;	// Blinks led, nothing to handle (taken care of by the LEDEngine)
 	}
 
 	return ERROR_HANDLING;
@@ -201,22 +687,27 @@ Bell::bell_state Bell::error_handling()
 // Refer to header for documentation
 void Bell::run()
 {
-	// The main state machine
-	// Transitions are handled through return values of each state function
-	switch (state) {
-		case INIT:              state = init();                 break;
-		case DISCONNECTED:      state = disconnected();         break;
-		case CONNECTING:        state = connecting();           break;
-		case CONNECTED:         state = connected();            break;
-		case RINGING:           state = ringing();              break;
-		case ERROR:             state = error();                break;
-		case ERROR_HANDLING:    state = error_handling();       break;
-	}
-
-	// Update asynchronus components here
-	wifi_handler.update();
-	buzzer.update();
-	led.update();
+	LoopProfiler::loopStart(sm.state());
+
+	// Run the asynchronous components that are due first,
+	// so the state machine sees their latest state
+	Scheduler::run();
+
+	prof_mark_t m = LoopProfiler::enter(PROF_MAIN);
+
+	// The main state machine (See states)
+	bool changed = sm.step(this);
+
+	LoopProfiler::leave(m);
+
+	// Run the next state right away rather than idling
+	if (changed) {
+		CrashLog::state(sm.state());
+		EVT(EVT_STATE, sm.state(), 0);
+		Scheduler::wake();
+	}
+
+	LoopProfiler::loopEnd();
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file BellBeacon.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief BellBeacon class implementation
+ * 
+ * The following file contains the implementation of the BellBeacon class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#ifdef TARGET_DEV_BELL
+
+#include <log.h>
+#include <discovery_msg.h>
+
+#include <bell/BellBeacon.h>
+
+// Refer to header for documentation
+BellBeacon::BellBeacon()
+{
+}
+
+// Refer to header for documentation
+BellBeacon::BellBeacon(uint16_t discovery_port, uint16_t ring_port)
+: discovery_port(discovery_port), ring_port(ring_port)
+{
+	log_msg("BellBeacon::BellBeacon", "Initializing BellBeacon");
+}
+
+// Refer to header for documentation
+bool BellBeacon::begin()
+{
+	if (listening)
+		return true;
+
+	if (!udp.listen(discovery_port)) {
+		log_msg("BellBeacon::begin", "Failed to listen on UDP port " + String(discovery_port) + "!");
+		return false;
+	}
+
+	udp.onPacket(&on_packet, this);
+	listening = true;
+
+	log_msg("BellBeacon::begin", "Listening for discovery queries on UDP port " + String(discovery_port));
+
+	return true;
+}
+
+// Refer to header for documentation
+void BellBeacon::on_packet(void *arg, AsyncUDPPacket &packet)
+{
+	BellBeacon *b = (BellBeacon *)arg;
+
+	if (b->collecting && discovery_msg_valid(packet.data(), packet.length(), DISCOVERY_BEACON)) {
+		b->keep(packet.remoteIP(), ((discovery_msg_t *)packet.data())->port);
+		return;
+	}
+
+	if (!discovery_msg_valid(packet.data(), packet.length(), DISCOVERY_QUERY))
+		return;
+
+	discovery_msg_t msg = { DISCOVERY_MAGIC, DISCOVERY_BEACON, b->ring_port };
+
+	// Reply to the sender, from the interface the query was received on
+	packet.write((const uint8_t *)&msg, sizeof(msg));
+
+	log_msg("BellBeacon::on_packet", "Answered discovery query of " + packet.remoteIP().toString());
+}
+
+// Refer to header for documentation
+void BellBeacon::announce()
+{
+	if (!listening)
+		return;
+
+	discovery_msg_t msg = { DISCOVERY_MAGIC, DISCOVERY_BEACON, ring_port };
+	udp.broadcastTo((uint8_t *)&msg, sizeof(msg), discovery_port);
+
+	log_msg("BellBeacon::announce", "Beacon broadcast");
+}
+
+// Refer to header for documentation
+void BellBeacon::query()
+{
+	if (!listening)
+		return;
+
+	discovery_msg_t msg = { DISCOVERY_MAGIC, DISCOVERY_QUERY, 0 };
+
+	collecting = true;
+	udp.broadcastTo((uint8_t *)&msg, sizeof(msg), discovery_port);
+
+	log_msg("BellBeacon::query", "Discovery query broadcast");
+}
+
+// Refer to header for documentation
+void BellBeacon::keep(IPAddress ip, uint16_t port)
+{
+	if (ip == WiFi.localIP())
+		return;
+
+	for (uint8_t i = 0; i < n_heard; i++) {
+		if (heard_ip[i] == (uint32_t)ip) {
+			heard_port[i] = port;
+			return;
+		}
+	}
+
+	if (n_heard == BELL_BEACON_HEARD_LEN) {
+		log_msg("BellBeacon::keep", "Too many beacons pending, ignoring " + ip.toString());
+		return;
+	}
+
+	heard_ip[n_heard] = (uint32_t)ip;
+	heard_port[n_heard] = port;
+	n_heard++;
+}
+
+// Refer to header for documentation
+bool BellBeacon::heard(IPAddress *ip, uint16_t *port)
+{
+	if (n_heard == 0)
+		return false;
+
+	*ip = IPAddress(heard_ip[0]);
+	*port = heard_port[0];
+
+	// Callbacks don't pre-empt the loop, so the queue can be shifted safely
+	n_heard--;
+	for (uint8_t i = 0; i < n_heard; i++) {
+		heard_ip[i] = heard_ip[i + 1];
+		heard_port[i] = heard_port[i + 1];
+	}
+
+	return true;
+}
+
+#endif
@@ -80,6 +80,31 @@ bool BellCFG::checkValidity()
 		ret = false;
 	}
 
+	if (metrics_port != 0 && metrics_port == port) {
+		log_msg("BellCFG::valid", "Metrics port must differ from the ring port!");
+		ret = false;
+	}
+
+	if (mesh && mesh_door_mac == "") {
+		log_msg("BellCFG::valid", "Mesh enabled, but no door MAC specified in cfg!");
+		ret = false;
+	}
+
+	if (sync && sync_port == 0) {
+		log_msg("BellCFG::valid", "No sync port specified in cfg!");
+		ret = false;
+	}
+
+	if (door_ap && (ap_ssid == "" || ap_ip == "" || relay_door_ip == "")) {
+		log_msg("BellCFG::valid", "Access point for the door enabled, but not fully specified in cfg!");
+		ret = false;
+	}
+
+	if (prering && (!door_ap || door_mac == "")) {
+		log_msg("BellCFG::valid", "Pre-ring requires the access point for the door and its MAC address!");
+		ret = false;
+	}
+
 	return ret;
 }
 
@@ -34,6 +34,10 @@
 #include <log.h>
 #include <config.h>
 
+#include <EventTrace.h>
+#include <Scheduler.h>
+#include <trace.h>
+
 #include <bell/Buzzer.h>
 
 // Refer to header for documentation
@@ -43,40 +47,168 @@ Buzzer::Buzzer()
 }
 
 // Refer to header for documentation
-Buzzer::Buzzer(uint8_t pin, const note_t mel[], size_t melody_len) : pin(pin), melody_len(melody_len)
+Buzzer::Buzzer(uint8_t pin, const note_t mel[], size_t melody_len,
+	       const char *sample_file, uint16_t sample_rate) : pin(pin)
 {
-	// Melody array is a const, so we need to copy it to a non-const array
-	// if we wish to read it from within the class.
-	// We can theoretically afford to just work unsafe here, since
-	// we will only ever read from the melody array, let alone
-	// never use more than one Buzzer. However, since we still have
-	// plenty of memory, we might as well just do it the "right way".
+	// The melody is copied, so the caller doesn't need to keep it around.
+	// As the melodies of melodies.h are static anyway, the copy is skipped
+	// if long-lived objects are to be kept off the heap.
+
+#ifdef BELL_STATIC_ALLOC
+	const note_t *m = mel;
+#else
+	note_t *m = new note_t[melody_len];
+        memcpy(m, mel, melody_len * sizeof(note_t));
+#endif
 
-	melody = new note_t[melody_len];
-        memcpy(melody, mel, melody_len * sizeof(note_t));
+	for (uint8_t i = 0; i < N_RING_CLASSES; i++) {
+		melody[i] = m;
+		this->melody_len[i] = melody_len;
+	}
+
+	if (sample_file != NULL) {
+		sample = SamplePlayer(pin, sample_file, sample_rate);
+		has_sample = true;
+	}
 
 	pinMode(pin, OUTPUT);
+	task.prof = PROF_BUZZER;
 	stat = IDLE;
 }
 
 // Refer to header for documentation
-void Buzzer::ring()
+void Buzzer::setMelody(ring_class cls, const note_t mel[], size_t len)
+{
+	// See constructor on why the melody is copied
+#ifdef BELL_STATIC_ALLOC
+	melody[cls] = mel;
+#else
+	note_t *m = new note_t[len];
+	memcpy(m, mel, len * sizeof(note_t));
+	melody[cls] = m;
+#endif
+	melody_len[cls] = len;
+}
+
+// Refer to header for documentation
+void Buzzer::setCoalescePolicy(coalesce_policy policy)
+{
+	coalesce = policy;
+}
+
+// Refer to header for documentation
+void Buzzer::start(ring_class cls)
+{
+	log_msg("Buzzer(PIN:" + String(pin) + ")::start", "Ringing! (class: " + String(cls) + ")");
+
+	if (sample.playing())
+		sample.stop();
+	else if (stat == RINGING)
+		noTone(pin);
+
+	cur_class = cls;
+	preempt = false;
+	stat = RINGING;
+
+#ifndef BELL_SILENT
+	// Prefer the recorded chime, fall back to the melody if unavailable
+	if (cls == RING_CLASS_NORMAL && has_sample && sample.play()) {
+		TRACE_PULSE(BUZZER_NOTE);
+		EVT(EVT_NOTE, 0xFF, 0);
+		first_note_us = micros();
+		next_in(sample.refillInterval());
+		return;
+	}
+#endif
+
+	// Play the first note right away
+	i_tone = 0;
+	deadline.in(0);
+	update();
+}
+
+// Refer to header for documentation
+void Buzzer::next_in(unsigned long ms)
+{
+	deadline.in(ms);
+	Scheduler::schedule(&task, ms, &on_task, this);
+}
+
+// Refer to header for documentation
+void Buzzer::on_task(void *arg)
+{
+	((Buzzer *)arg)->update();
+}
+
+// Refer to header for documentation
+bool Buzzer::ring(ring_class cls)
 {
 	if (stat == UNINITIALIZED) {
 		log_msg("Buzzer(PIN:" + String(pin) + ")::ring", "Attempted to ring with uninitialized Buzzer!");
-		return;
+		return false;
 	}
 
-	if (stat == RINGING) {
-		log_msg("Buzzer(PIN:" + String(pin) + ")::ring", "Attempted to ring while already ringing!");
-		return;
+	if (stat != RINGING) {
+		start(cls);
+		return true;
 	}
 
-	log_msg("Buzzer(PIN:" + String(pin) + ")::ring", "Ringing!");
+	// A pending pre-emption counts as the current ring
+	ring_class active = preempt ? pending_class : cur_class;
 
-	i_tone = 0;
-	tstamp = millis() + NOTE_DURATION;
-	stat = RINGING;
+	if (cls > active) {
+		log_msg("Buzzer(PIN:" + String(pin) + ")::ring", "Higher priority ring, pre-empting current ring tone");
+		pending_class = cls;
+		preempt = true;
+		queued = false;
+
+		// Samples have no note boundaries to wait for
+		if (sample.playing())
+			Scheduler::notify(&task);
+
+		return false;
+	}
+
+	if (cls < active) {
+		log_msg("Buzzer(PIN:" + String(pin) + ")::ring", "Lower priority ring while ringing, dropping ring");
+		return false;
+	}
+
+	switch (coalesce) {
+		case COALESCE_DROP:
+			log_msg("Buzzer(PIN:" + String(pin) + ")::ring", "Attempted to ring while already ringing!");
+			break;
+		case COALESCE_RESTART:
+			log_msg("Buzzer(PIN:" + String(pin) + ")::ring", "Repeated ring, restarting ring tone");
+			pending_class = cls;
+			preempt = true;
+			break;
+		case COALESCE_QUEUE:
+			log_msg("Buzzer(PIN:" + String(pin) + ")::ring", "Repeated ring, queuing ring tone");
+			queued = true;
+			break;
+	}
+
+	return false;
+}
+
+// Refer to header for documentation
+void Buzzer::stop()
+{
+	if (stat != RINGING)
+		return;
+
+	if (sample.playing())
+		sample.stop();
+	else
+		noTone(pin);
+
+	preempt = false;
+	queued = false;
+	Scheduler::cancel(&task);
+	stat = IDLE;
+
+	log_msg("Buzzer(PIN:" + String(pin) + ")::stop", "Ring tone stopped!");
 }
 
 // Refer to header for documentation
@@ -91,22 +223,77 @@ void Buzzer::update()
 	if (stat != RINGING)
 		return;
 
-	if (millis() < tstamp)
-		return;
+	if (sample.playing()) {
+		// Samples have no notes, so pre-empt right away
+		if (preempt) {
+			start(pending_class);
+			return;
+		}
+
+		sample.update();
+
+		if (sample.playing()) {
+			next_in(sample.refillInterval());
+			return;
+		}
+	} else {
+		// Keep the note timing if called early
+		clock_ms_t remaining = deadline.remaining();
+		if (remaining > 0) {
+			next_in(remaining);
+			return;
+		}
+
+		// Note boundary
+		if (preempt) {
+			start(pending_class);
+			return;
+		}
+
+		if (i_tone < melody_len[cur_class]) {
+#ifndef BELL_SILENT
+			tone(pin, melody[cur_class][i_tone]);
+#endif
+			EVT(EVT_NOTE, i_tone, melody[cur_class][i_tone]);
+			if (i_tone == 0) {
+				TRACE_PULSE(BUZZER_NOTE);
+				first_note_us = micros();
+			}
+			i_tone++;
+			next_in(NOTE_DURATION);
+			return;
+		}
 
-	if (i_tone == melody_len) {
 		noTone(pin);
-		stat = IDLE;
-		log_msg("Buzzer::update", "Done ringing!");
+		EVT(EVT_NOTE, i_tone, 0);
+	}
+
+	if (queued) {
+		queued = false;
+		start(cur_class);
 		return;
 	}
 
-#ifndef BELL_SILENT
-	tone(pin, melody[i_tone]);
-#endif
+	stat = IDLE;
+	log_msg("Buzzer::update", "Done ringing!");
+}
 
-	i_tone++;
-	tstamp = millis() + NOTE_DURATION;
+// Refer to header for documentation
+unsigned long Buzzer::firstNoteAt()
+{
+	return first_note_us;
+}
+
+// Refer to header for documentation
+uint32_t Buzzer::sampleUnderruns()
+{
+	return sample.underruns();
+}
+
+// Refer to header for documentation
+uint32_t Buzzer::sampleReadRate()
+{
+	return sample.readRate();
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file DoorAP.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief DoorAP class implementation
+ * 
+ * The following file contains the implementation of the DoorAP class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#ifdef TARGET_DEV_BELL
+
+#include <log.h>
+
+#include <bell/DoorAP.h>
+
+#define DOOR_AP_HIDDEN 1
+#define DOOR_AP_MAX_CLIENTS 1 // Only the door
+
+// Refer to header for documentation
+DoorAP::DoorAP()
+{
+}
+
+// Refer to header for documentation
+DoorAP::DoorAP(const String ssid, const String psk, const IPAddress ip, uint8_t channel)
+: ssid(ssid), psk(psk), ip(ip), channel(channel)
+{
+	log_msg("DoorAP::DoorAP", "Initializing DoorAP");
+}
+
+// Refer to header for documentation
+bool DoorAP::begin()
+{
+	WiFi.mode(WIFI_AP_STA);
+
+	if (!WiFi.softAPConfig(ip, ip, IPAddress(255, 255, 255, 0)) ||
+	    !WiFi.softAP(ssid, psk, channel, DOOR_AP_HIDDEN, DOOR_AP_MAX_CLIENTS)) {
+		log_msg("DoorAP::begin", "Failed to start access point!");
+		return false;
+	}
+
+	active = true;
+	log_msg("DoorAP::begin", "Access point started on channel " + String(channel) + 
+		", IP: " + WiFi.softAPIP().toString());
+
+	return true;
+}
+
+// Refer to header for documentation
+bool DoorAP::running()
+{
+	return active;
+}
+
+#endif
@@ -29,10 +29,12 @@
  * 
  */
 
-#ifdef TARGET_DEV_BELL
+#if defined(TARGET_DEV_BELL) && !defined(TARGET_DEV_BENCH)
 
 #include <log.h>
+#include <Scheduler.h>
 #include <config.h>
+#include <trace.h>
 
 #include <bell/Bell.h>
 
@@ -40,6 +42,7 @@ Bell bell;
 
 void setup()
 {
+	TRACE_INIT();
 	Serial.begin(115200);
 
 	// Configure door using the BellCFG object
@@ -56,6 +59,44 @@ void setup()
 	cfg.gateway 		= GATEWAY;
 	cfg.subnet 		= "255.255.255.0";
 	cfg.port 		= TCP_PORT;
+	cfg.sleep_mode		= BELL_SLEEP_MODE;
+	cfg.listen_interval	= BELL_LISTEN_INTERVAL;
+	cfg.discovery_port	= DISCOVERY_PORT;
+	cfg.metrics_port	= BELL_METRICS_PORT;
+
+#ifdef USE_MESH
+	cfg.mesh		= true;
+	cfg.mesh_door_mac	= MESH_DOOR_MAC;
+#endif
+
+#ifdef USE_SYNC
+	cfg.sync		= true;
+	cfg.sync_master		= String(BELL_IP) == SYNC_MASTER_IP;
+	cfg.sync_port		= SYNC_PORT;
+#endif
+
+#ifdef USE_BELL_AP
+	// The primary bell hosts the access point for the door,
+	// all other bells accept the rings it relays
+	if (String(BELL_IP) == BELL_AP_PRIMARY_IP) {
+		cfg.door_ap		= true;
+		cfg.door_ip		= BELL_AP_DOOR_IP;
+		cfg.ap_ssid		= BELL_AP_SSID;
+		cfg.ap_psk		= BELL_AP_PSK;
+		cfg.ap_ip		= BELL_AP_IP;
+		cfg.ap_channel		= BELL_AP_CHANNEL;
+		cfg.relay_door_ip	= DOOR_IP;
+		cfg.relay_n_bells	= BELL_AP_N_BELLS;
+		cfg.relay_timeout_ms	= BELL_AP_RELAY_TIMEOUT_MS;
+#ifdef BELL_PRERING
+		cfg.prering		= true;
+		cfg.door_mac		= BELL_PRERING_DOOR_MAC;
+		cfg.prering_window_ms	= BELL_PRERING_WINDOW_MS;
+#endif
+	} else {
+		cfg.relay_ip		= BELL_AP_PRIMARY_IP;
+	}
+#endif
 
 	bell = Bell(cfg);
 }
@@ -63,6 +104,9 @@ void setup()
 void loop()
 {
 	bell.run();
+
+	// Sleep until the next component is due
+	Scheduler::idle();
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file MetricsServer.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief MetricsServer class implementation
+ * 
+ * The following file contains the implementation of the MetricsServer class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#ifdef TARGET_DEV_BELL
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <new>
+
+#include <ESP8266WiFi.h>
+
+#include <config.h>
+#include <EventTrace.h>
+#include <log.h>
+
+#include <bell/MetricsServer.h>
+
+#define METRICS_PATH "/metrics"
+#define TRACE_PATH "/trace"
+
+#define HTTP_OK "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n"
+#define HTTP_NOT_FOUND "HTTP/1.0 404 Not Found\r\nConnection: close\r\n\r\n"
+
+#define METRICS_N_BUILTIN 8 // Metrics served by append_item() itself
+
+#ifdef BELL_STATIC_ALLOC
+// See BELL_STATIC_ALLOC in config.h
+alignas(AsyncServer) static uint8_t server_mem[sizeof(AsyncServer)];
+#endif
+
+// Refer to header for documentation
+void MetricsServer::begin(uint16_t port)
+{
+	if (server != NULL) {
+		log_msg("MetricsServer::begin", "MetricsServer already running! Ignoring begin request...");
+		return;
+	}
+
+#ifdef BELL_STATIC_ALLOC
+	server = new (server_mem) AsyncServer(port);
+#else
+	server = new AsyncServer(port);
+#endif
+	server->onClient(&on_new_client, NULL);
+	server->begin();
+
+	log_msg("MetricsServer::begin", "Serving metrics on port " + String(port));
+}
+
+// Refer to header for documentation
+void MetricsServer::add(const char *name, const char *help, bool counter, bool sign, metric_fn_t fn, void *arg,
+			metric_info_fn_t info)
+{
+	if (n_metrics >= BELL_METRICS_MAX) {
+		log_msg("MetricsServer::add", "Too many metrics, ignoring " + String(name));
+		return;
+	}
+
+	metrics[n_metrics++] = { name, help, counter, sign, fn, info, arg };
+}
+
+// Refer to header for documentation
+uint32_t MetricsServer::read_u32(void *arg)
+{
+	return *(const uint32_t *)arg;
+}
+
+// Refer to header for documentation
+void MetricsServer::counter(const char *name, const char *help, const uint32_t *value)
+{
+	add(name, help, true, false, &read_u32, (void *)value);
+}
+
+// Refer to header for documentation
+void MetricsServer::counter(const char *name, const char *help, metric_fn_t fn, void *arg)
+{
+	add(name, help, true, false, fn, arg);
+}
+
+// Refer to header for documentation
+void MetricsServer::gauge(const char *name, const char *help, const uint32_t *value)
+{
+	add(name, help, false, false, &read_u32, (void *)value);
+}
+
+// Refer to header for documentation
+void MetricsServer::gauge(const char *name, const char *help, metric_fn_t fn, void *arg, bool sign)
+{
+	add(name, help, false, sign, fn, arg);
+}
+
+// Refer to header for documentation
+void MetricsServer::summary(const char *name, const char *help, const quantile_sketch_t *sketch)
+{
+	add(name, help, false, false, NULL, (void *)sketch);
+}
+
+// Refer to header for documentation
+void MetricsServer::info(const char *name, const char *help, metric_info_fn_t fn, void *arg)
+{
+	add(name, help, false, false, NULL, arg, fn);
+}
+
+// Refer to header for documentation
+void MetricsServer::append(const char *fmt, ...)
+{
+	if (len >= sizeof(buf) - 1)
+		return;
+
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(buf + len, sizeof(buf) - len, fmt, args);
+	va_end(args);
+
+	if (n < 0)
+		return;
+
+	// Truncated, keep what fit
+	len = len + n < sizeof(buf) ? len + n : sizeof(buf) - 1;
+}
+
+// Refer to header for documentation
+void MetricsServer::append_metric(const char *name, const char *help, bool counter, bool sign, uint32_t val)
+{
+	append("# HELP %s %s\n# TYPE %s %s\n", name, help, name, counter ? "counter" : "gauge");
+
+	if (sign)
+		append("%s %ld\n", name, (long)(int32_t)val);
+	else
+		append("%s %lu\n", name, (unsigned long)val);
+}
+
+// Refer to header for documentation
+void MetricsServer::append_summary(const char *name, const char *help, const quantile_sketch_t &s)
+{
+	append("# HELP %s %s\n# TYPE %s summary\n", name, help, name);
+	append("%s{quantile=\"0.5\"} %lu\n", name, (unsigned long)QuantileSketch::quantile(s, 500));
+	append("%s{quantile=\"0.95\"} %lu\n", name, (unsigned long)QuantileSketch::quantile(s, 950));
+	append("%s{quantile=\"0.99\"} %lu\n", name, (unsigned long)QuantileSketch::quantile(s, 990));
+	append("%s_count %lu\n", name, (unsigned long)s.n);
+}
+
+// Refer to header for documentation
+uint16_t MetricsServer::n_items()
+{
+#ifdef USE_EVENT_TRACE
+	if (tracing)
+		return EventTrace::lines();
+#endif
+
+	return METRICS_N_BUILTIN + n_metrics;
+}
+
+// Refer to header for documentation
+void MetricsServer::append_item(uint16_t i)
+{
+#ifdef USE_EVENT_TRACE
+	if (tracing) {
+		EventTrace::line(i, labels, sizeof(labels));
+		append("%s", labels);
+		return;
+	}
+#endif
+
+	switch (i) {
+		case 0:
+			append_metric("doorbell_uptime_seconds", "Time since boot", false, false, millis() / 1000);
+			return;
+		case 1:
+			append_metric("doorbell_reset_reason", "Reason of the last reset (REASON_* of the SDK)", false, false,
+				      ESP.getResetInfoPtr()->reason);
+			return;
+		case 2:
+			append_metric("doorbell_heap_free_bytes", "Free heap", false, false, ESP.getFreeHeap());
+			return;
+		case 3:
+			append_metric("doorbell_heap_max_block_bytes", "Largest free heap block", false, false,
+				      ESP.getMaxFreeBlockSize());
+			return;
+		case 4:
+			append_metric("doorbell_heap_fragmentation_percent", "Heap fragmentation", false, false,
+				      ESP.getHeapFragmentation());
+			return;
+		case 5:
+			append_metric("doorbell_wifi_rssi_dbm", "Signal strength of the access point", false, true,
+				      WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0);
+			return;
+		case 6:
+			append_metric("doorbell_metrics_scrapes_total", "Scrapes served", true, false, n_scrapes);
+			return;
+		case 7:
+			append_metric("doorbell_metrics_truncated_total", "Metrics sent truncated, as larger than a page",
+				      true, false, n_truncated);
+			return;
+	}
+
+	const metric_t &m = metrics[i - METRICS_N_BUILTIN];
+
+	if (m.info != NULL) {
+		if (m.info(labels, sizeof(labels), m.arg))
+			append("# HELP %s %s\n# TYPE %s gauge\n%s{%s} 1\n", m.name, m.help, m.name, m.name, labels);
+	} else if (m.fn == NULL) {
+		append_summary(m.name, m.help, *(const quantile_sketch_t *)m.arg);
+	} else {
+		append_metric(m.name, m.help, m.counter, m.sign, m.fn(m.arg));
+	}
+}
+
+// Refer to header for documentation
+void MetricsServer::render(bool found, bool trace)
+{
+	len = 0;
+	sent = 0;
+	acked = 0;
+	responding = true;
+	tracing = false;
+
+	if (!found) {
+		append(HTTP_NOT_FOUND);
+		next = n_items();
+		return;
+	}
+
+#ifdef USE_EVENT_TRACE
+	tracing = trace;
+	if (tracing)
+		EventTrace::hold(true);
+	else
+		n_scrapes++;
+#else
+	n_scrapes++;
+#endif
+
+	next = 0;
+
+	append(HTTP_OK);
+	render_page();
+}
+
+// Refer to header for documentation
+bool MetricsServer::render_page()
+{
+	if (next >= n_items())
+		return false;
+
+	while (next < n_items()) {
+		size_t start = len;
+		append_item(next);
+
+		if (len >= sizeof(buf) - 1) {
+			// Didn't fit, continue on the next page
+			if (start > 0) {
+				len = start;
+				break;
+			}
+
+			// Won't fit on any page, send what fit
+			n_truncated++;
+			log_msg("MetricsServer::render_page", "Item " + String(next) + " exceeds BELL_METRICS_BUF_LEN, truncated");
+		}
+
+		next++;
+	}
+
+	return true;
+}
+
+// Refer to header for documentation
+void MetricsServer::send_more()
+{
+	if (acked >= len) {
+		len = 0;
+		sent = 0;
+		acked = 0;
+
+		if (!render_page()) {
+#ifdef USE_EVENT_TRACE
+			if (tracing)
+				EventTrace::hold(false);
+#endif
+			client->close();
+			return;
+		}
+	}
+
+	size_t n = len - sent;
+	if (n == 0)
+		return;
+
+	if (n > client->space())
+		n = client->space();
+
+	if (n == 0)
+		return; // Continued from the next ack
+
+	// Copied, as lwIP may still hold unacknowledged segments after a timeout
+	// or early close, by which time the buffer is reused for the next client
+	sent += client->add(buf + sent, n, ASYNC_WRITE_FLAG_COPY);
+	client->send();
+}
+
+// Refer to header for documentation
+void MetricsServer::on_new_client(void *arg, AsyncClient *new_client)
+{
+	if (client != NULL) {
+		new_client->onDisconnect(&on_disconnect, NULL);
+		new_client->close();
+		return;
+	}
+
+	client = new_client;
+	responding = false;
+
+	client->onData(&on_data, NULL);
+	client->onAck(&on_ack, NULL);
+	client->onDisconnect(&on_disconnect, NULL);
+	client->onTimeout(&on_timeout, NULL);
+}
+
+// Refer to header for documentation
+void MetricsServer::on_data(void *arg, AsyncClient *c, void *data, size_t n)
+{
+	// Only the request line matters, which comes with the first segment
+	if (c != client || responding)
+		return;
+
+	const char *req = (const char *)data;
+
+#ifdef USE_EVENT_TRACE
+	if (requested(req, n, TRACE_PATH)) {
+		render(true, true);
+		send_more();
+		return;
+	}
+#endif
+
+	render(requested(req, n, METRICS_PATH));
+	send_more();
+}
+
+// Refer to header for documentation
+bool MetricsServer::requested(const char *req, size_t n, const char *path)
+{
+	size_t path_len = strlen(path);
+
+	return n > 4 + path_len && strncmp(req, "GET ", 4) == 0 && strncmp(req + 4, path, path_len) == 0 &&
+	       (req[4 + path_len] == ' ' || req[4 + path_len] == '?');
+}
+
+// Refer to header for documentation
+void MetricsServer::on_ack(void *arg, AsyncClient *c, size_t n, uint32_t time)
+{
+	if (c != client)
+		return;
+
+	acked += n;
+	send_more();
+}
+
+// Refer to header for documentation
+void MetricsServer::on_disconnect(void *arg, AsyncClient *c)
+{
+	if (c == client) {
+		client = NULL;
+
+#ifdef USE_EVENT_TRACE
+		// Resume recording if the client left early
+		if (tracing)
+			EventTrace::hold(false);
+#endif
+	}
+
+	// AsyncServer leaves freeing closed clients to us
+	delete c;
+}
+
+// Refer to header for documentation
+void MetricsServer::on_timeout(void *arg, AsyncClient *c, uint32_t time)
+{
+	c->close();
+}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file PreRing.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief PreRing class implementation
+ * 
+ * The following file contains the implementation of the PreRing class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#ifdef TARGET_DEV_BELL
+
+#include <log.h>
+#include <Scheduler.h>
+
+#include <bell/PreRing.h>
+
+// Refer to header for documentation
+PreRing::PreRing()
+{
+}
+
+// Refer to header for documentation
+PreRing::PreRing(const String door_mac)
+{
+	unsigned int m[6] = {0};
+
+	if (sscanf(door_mac.c_str(), "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 6)
+		log_msg("PreRing::PreRing", "Invalid door MAC address: " + door_mac);
+
+	for (uint8_t i = 0; i < 6; i++)
+		this->door_mac[i] = m[i];
+
+	log_msg("PreRing::PreRing", "Watching for door with MAC: " + door_mac);
+}
+
+// Refer to header for documentation
+void PreRing::begin()
+{
+	probe_handler = WiFi.onSoftAPModeProbeRequestReceived(
+		[this](const WiFiEventSoftAPModeProbeRequestReceived &evt) { on_frame(evt.mac); });
+	sta_handler = WiFi.onSoftAPModeStationConnected(
+		[this](const WiFiEventSoftAPModeStationConnected &evt) { on_frame(evt.mac); });
+}
+
+// Refer to header for documentation
+void PreRing::on_frame(const uint8_t mac[6])
+{
+	// Called for every probe request in range, so keep this short
+	if (memcmp(mac, door_mac, sizeof(door_mac)) != 0)
+		return;
+
+	if (!seen) {
+		seen_us = micros();
+		seen = true;
+		Scheduler::wake();
+	}
+}
+
+// Refer to header for documentation
+bool PreRing::triggered()
+{
+	bool ret = seen;
+	seen = false;
+	return ret;
+}
+
+// Refer to header for documentation
+unsigned long PreRing::triggeredAt()
+{
+	return seen_us;
+}
+
+#endif
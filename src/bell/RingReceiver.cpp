@@ -29,13 +29,25 @@
 
 #ifdef TARGET_DEV_BELL
 
+#include <new>
+
 #include <ESP8266WiFi.h>
 
+#include <config.h>
+#include <EventTrace.h>
 #include <log.h>
 #include <ring_msg.h>
+#include <Scheduler.h>
+#include <trace.h>
 
 #include <bell/RingReceiver.h>
 
+#ifdef BELL_STATIC_ALLOC
+// Static storage for the long-lived objects, see BELL_STATIC_ALLOC in config.h
+alignas(RingReceiver) static uint8_t instance_mem[sizeof(RingReceiver)];
+alignas(AsyncServer) static uint8_t server_mem[sizeof(AsyncServer)];
+#endif
+
 // Refer to header for documentation
 RingReceiver::RingReceiver()
 {
@@ -48,8 +60,13 @@ RingReceiver::RingReceiver()
 // Refer to header for documentation
 RingReceiver * RingReceiver::get_instance()
 {
-	if (instance == NULL)
+	if (instance == NULL) {
+#ifdef BELL_STATIC_ALLOC
+		instance = new (instance_mem) RingReceiver();
+#else
 		instance = new RingReceiver();
+#endif
+	}
 
 	return instance;
 }
@@ -63,7 +80,11 @@ void RingReceiver::begin(uint16_t port, String door_ip_addr)
 	}
 
 	door_ip.fromString(door_ip_addr);
+#ifdef BELL_STATIC_ALLOC
+	server = new (server_mem) AsyncServer(port);
+#else
 	server = new AsyncServer(port);
+#endif
 	server->onClient(&on_new_client, NULL); // Register callback for new clients
 	server->begin();
 	running = true;
@@ -84,12 +105,14 @@ void RingReceiver::on_new_client(void* arg, AsyncClient* new_client)
 	
 	if (client != NULL) {
 		log_msg("RingReceiver::on_new_client", "Client already connected! Ignoring new client...");
+		stat.rejected++;
 		new_client->close();
 		return;
 	}
 
-	if (ip != door_ip) {
+	if (ip != door_ip && ip != relay_ip) {
 		log_msg("RingReceiver::on_new_client", "Client is not the door! Ignoring new client...");
+		stat.rejected++;
 		new_client->close();
 		return;
 	}
@@ -108,31 +131,95 @@ void RingReceiver::on_new_client(void* arg, AsyncClient* new_client)
 // Refer to header for documentation
 void RingReceiver::on_data(void* arg, AsyncClient* client, void *data, size_t len)
 {
+	TRACE_HIGH(RING_RX);
+	arrived_us = micros();
 	log_msg("RingReceiver::on_data", "Received data from door");
 
-	uint8_t msg;
+	bool valid = handle((const uint8_t *)data, len);
+	TRACE_LOW(RING_RX);
+
+	if (valid)
+		log_msg("RingReceiver::on_data", "Closing connection with door");
+	else
+		log_msg("RingReceiver::on_data", "Invalid packet received from door! Closing connection!");
+
+	client->close();
+}
 
-	if (len != 1)
-		goto INVALID_PACKET;
+// Refer to header for documentation
+bool RingReceiver::parse(const uint8_t *buf, size_t len, ring_rx_msg_t *msg)
+{
+	const uint8_t *val;
+	uint8_t vlen;
+
+	if (len < 1 || len > RING_MSG_MAX_LEN || !ring_msg_tlvs_valid(buf, len) ||
+	    !ring_msg_class(buf[0], &msg->cls))
+		return false;
+
+	val = ring_msg_tlv(buf, len, RING_TLV_START_AT, &vlen);
+	msg->has_start_at = val != NULL && vlen == sizeof(msg->start_at);
+	if (msg->has_start_at)
+		memcpy(&msg->start_at, val, sizeof(msg->start_at));
+
+	val = ring_msg_tlv(buf, len, RING_TLV_TRACE, &vlen);
+	msg->has_trace = val != NULL && vlen == sizeof(msg->trace);
+	if (msg->has_trace)
+		memcpy(&msg->trace, val, sizeof(msg->trace));
+
+	val = ring_msg_tlv(buf, len, RING_TLV_SEQ, &vlen);
+	msg->has_seq = val != NULL && vlen == sizeof(msg->seq);
+	if (msg->has_seq)
+		memcpy(&msg->seq, val, sizeof(msg->seq));
+
+	val = ring_msg_tlv(buf, len, RING_TLV_CRASH, &vlen);
+	msg->has_crash = val != NULL && vlen == sizeof(msg->crash);
+	if (msg->has_crash)
+		memcpy(&msg->crash, val, sizeof(msg->crash));
+
+	return true;
+}
 
- 	// Cast data to uint8_t as the ring_msg is only 1 byte
-	msg = *((uint8_t *)data);
+// Refer to header for documentation
+bool RingReceiver::handle(const uint8_t *buf, size_t len)
+{
+	ring_rx_msg_t msg;
 
-	if (msg == RING_MSG) {
-		recv = true;
-		log_msg("RingReceiver::on_data", "Received ring message from door");
-	} else {
-		goto INVALID_PACKET;
+	if (!parse(buf, len, &msg)) {
+		stat.invalid++;
+		EVT(EVT_RX_INVALID, 0, len);
+		return false;
 	}
 
-	log_msg("RingReceiver::on_data", "Closing connection with door");
-	client->close();
-	
-	return;
+	recv_us = micros();
+	EVT(EVT_RX, msg.cls, len);
 
-	INVALID_PACKET:
-		log_msg("RingReceiver::on_data", "Invalid packet received from door! Closing connection!");
-		client->close();
+	// Keep the highest priority ring if the last one hasn't been polled yet
+	if (!recv || msg.cls > recv_class) {
+		recv_class = msg.cls;
+		recv_has_start_at = msg.has_start_at;
+		recv_start_at = msg.start_at;
+	}
+
+	// The trace context and press counter belong to the latest message, even if a higher priority ring is kept
+	recv_has_trace = msg.has_trace;
+	recv_trace = msg.trace;
+	recv_has_seq = msg.has_seq;
+	recv_seq = msg.seq;
+
+	if (msg.has_crash) {
+		door_crash = msg.crash;
+		has_door_crash = true;
+		stat.crashes++;
+		log_msg("RingReceiver::handle", "Door reported a crash: " + CrashLog::describe(door_crash));
+	}
+
+	recv = true;
+	stat.rings++;
+	parsed_us = micros();
+	Scheduler::wake(); // Let the bell react right away
+	log_msg("RingReceiver::handle", "Received ring message from door (class: " + String(msg.cls) + ")");
+
+	return true;
 }
 
 // Refer to header for documentation
@@ -149,6 +236,7 @@ void RingReceiver::on_disconnect(void* arg, AsyncClient* _client)
 void RingReceiver::on_timeout(void* arg, AsyncClient* client, uint32_t time)
 {
 	log_msg("RingReceiver::on_timeout", "Client: " + client->remoteIP().toString() +  " timed out!");
+	stat.timeouts++;
 	client->close();
 }
 
@@ -156,13 +244,74 @@ void RingReceiver::on_timeout(void* arg, AsyncClient* client, uint32_t time)
 void RingReceiver::on_error(void* arg, AsyncClient* client, int8_t error)
 {
 	log_msg("RingReceiver::on_error", "Client: " + client->remoteIP().toString() + " error: " + error);
+	stat.errors++;
 	return;
 }
 
 // Refer to header for documentation
-bool RingReceiver::received()
+void RingReceiver::allow(String relay_ip_addr)
+{
+	relay_ip.fromString(relay_ip_addr);
+	log_msg("RingReceiver::allow", "Accepting relayed rings from " + relay_ip_addr);
+}
+
+// Refer to header for documentation
+bool RingReceiver::startAt(uint32_t *start_at)
+{
+	if (recv_has_start_at)
+		*start_at = recv_start_at;
+
+	return recv_has_start_at;
+}
+
+// Refer to header for documentation
+unsigned long RingReceiver::receivedAt()
+{
+	return recv_us;
+}
+
+// Refer to header for documentation
+bool RingReceiver::trace(ring_trace_t *trace, unsigned long *arrived, unsigned long *parsed)
+{
+	if (!recv_has_trace)
+		return false;
+
+	*trace = recv_trace;
+	*arrived = arrived_us;
+	*parsed = parsed_us;
+
+	return true;
+}
+
+// Refer to header for documentation
+bool RingReceiver::seq(uint16_t *seq)
+{
+	if (recv_has_seq)
+		*seq = recv_seq;
+
+	return recv_has_seq;
+}
+
+// Refer to header for documentation
+const crash_record_t *RingReceiver::doorCrash()
+{
+	return has_door_crash ? &door_crash : NULL;
+}
+
+// Refer to header for documentation
+const ring_rx_stats_t &RingReceiver::stats()
+{
+	return stat;
+}
+
+// Refer to header for documentation
+bool RingReceiver::received(ring_class *cls)
 {
 	bool ret = recv;
+
+	if (ret && cls != NULL)
+		*cls = recv_class;
+
 	recv = false;
 	return ret;
 }
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file RingRelay.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief RingRelay class implementation
+ * 
+ * The following file contains the implementation of the RingRelay class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#ifdef TARGET_DEV_BELL
+
+#include <log.h>
+
+#include <bell/RingRelay.h>
+
+// Refer to header for documentation
+RingRelay::RingRelay()
+{
+}
+
+// Refer to header for documentation
+RingRelay::RingRelay(IPAddress door_ip, IPAddress own_ip, unsigned int port, uint8_t n_bells,
+		     unsigned long timeout_ms)
+: own_ip(own_ip), timeout_ms(timeout_ms)
+{
+	log_msg("RingRelay::RingRelay", "Initializing RingRelay");
+
+	task.prof = PROF_NET;
+	tx = new RingTX[RING_RELAY_MAX_BELLS];
+
+	// Until the first beacon, see learn()
+	for (uint8_t i = 0; i < n_bells; i++) {
+		IPAddress ip = door_ip;
+		ip[3] = door_ip[3] + 1 + i;
+
+		if (ip != own_ip && !add(ip, port))
+			break;
+	}
+
+	assumed = true;
+}
+
+// Refer to header for documentation
+RingRelay::~RingRelay()
+{
+	delete[] tx;
+}
+
+// Refer to header for documentation
+RingRelay& RingRelay::operator=(const RingRelay& other)
+{
+	if (this == &other)
+		return *this;
+
+	delete[] tx;
+
+	n_tx = other.n_tx;
+	assumed = other.assumed;
+	own_ip = other.own_ip;
+	timeout_ms = other.timeout_ms;
+	relaying = other.relaying;
+
+	tx = new RingTX[RING_RELAY_MAX_BELLS];
+	for (uint8_t i = 0; i < n_tx; i++) {
+		tx[i] = other.tx[i];
+		tx_ip[i] = other.tx_ip[i];
+		tx_port[i] = other.tx_port[i];
+		tx_fails[i] = other.tx_fails[i];
+	}
+
+	return *this;
+}
+
+// Refer to header for documentation
+bool RingRelay::add(IPAddress ip, uint16_t port)
+{
+	if (n_tx == RING_RELAY_MAX_BELLS) {
+		log_msg("RingRelay::add", "Too many bells, ignoring " + ip.toString());
+		return false;
+	}
+
+	tx[n_tx] = RingTX(ip.toString(), port, timeout_ms);
+	tx_ip[n_tx] = (uint32_t)ip;
+	tx_port[n_tx] = port;
+	tx_fails[n_tx] = 0;
+	n_tx++;
+
+	return true;
+}
+
+// Refer to header for documentation
+void RingRelay::remove(uint8_t i)
+{
+	log_msg("RingRelay::remove", "No longer relaying to " + IPAddress(tx_ip[i]).toString());
+
+	n_tx--;
+	for (; i < n_tx; i++) {
+		tx[i] = tx[i + 1];
+		tx_ip[i] = tx_ip[i + 1];
+		tx_port[i] = tx_port[i + 1];
+		tx_fails[i] = tx_fails[i + 1];
+	}
+}
+
+// Refer to header for documentation
+void RingRelay::learn(IPAddress ip, uint16_t port)
+{
+	if (relaying) {
+		log_msg("RingRelay::learn", "Still relaying, ignoring " + ip.toString());
+		return;
+	}
+
+	if (ip == own_ip)
+		return;
+
+	if (assumed) {
+		log_msg("RingRelay::learn", "First bell discovered, no longer assuming bells following the door");
+		n_tx = 0;
+		assumed = false;
+	}
+
+	for (uint8_t i = 0; i < n_tx; i++) {
+		if (tx_ip[i] != (uint32_t)ip)
+			continue;
+
+		// Known bell, only recreate the RingTX if its port has changed
+		if (tx_port[i] != port) {
+			tx[i] = RingTX(ip.toString(), port, timeout_ms);
+			tx_port[i] = port;
+		}
+
+		tx_fails[i] = 0;
+		return;
+	}
+
+	if (add(ip, port))
+		log_msg("RingRelay::learn", "Relaying rings to " + ip.toString() + ":" + String(port));
+}
+
+// Refer to header for documentation
+bool RingRelay::busy()
+{
+	return relaying;
+}
+
+// Refer to header for documentation
+void RingRelay::send(ring_class cls, const uint32_t *start_at, const uint16_t *seq, const ring_trace_t *trace)
+{
+	log_msg("RingRelay::send", "Relaying ring to " + String(n_tx) + " bells (class: " + String(cls) + ")");
+
+	for (uint8_t i = 0; i < n_tx; i++) {
+		tx[i].setMessage(ring_class_msg(cls));
+
+		if (start_at != NULL)
+			tx[i].setStartAt(*start_at);
+		else
+			tx[i].clearStartAt();
+
+		if (seq != NULL)
+			tx[i].setSeq(*seq);
+		else
+			tx[i].clearSeq();
+
+		if (trace != NULL)
+			tx[i].setTrace(*trace, false);
+		else
+			tx[i].clearTrace();
+
+		tx[i].send(&task);
+	}
+
+	relaying = true;
+	Scheduler::schedule(&task, RING_RELAY_POLL_MS, &on_task, this);
+}
+
+// Refer to header for documentation
+void RingRelay::on_task(void *arg)
+{
+	RingRelay *r = (RingRelay *)arg;
+
+	r->update();
+
+	if (r->relaying)
+		Scheduler::schedule(&r->task, RING_RELAY_POLL_MS, &on_task, r);
+}
+
+// Refer to header for documentation
+void RingRelay::update()
+{
+	if (!relaying)
+		return;
+
+	uint8_t acks = 0;
+	bool busy = false;
+
+	for (uint8_t i = 0; i < n_tx; i++) {
+		tx[i].update();
+
+		switch (tx[i].status()) {
+			case RingTX::CONNECTING:
+			case RingTX::SENDING:
+				busy = true;
+				break;
+			case RingTX::SUCCESS:
+				acks++;
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (busy)
+		return;
+
+	relaying = false;
+	log_msg("RingRelay::update", "Relayed ring to " + String(acks) + "/" + String(n_tx) + " bells");
+
+	// Assumed bells are kept, as there is nothing to replace them with
+	for (uint8_t i = n_tx; i-- > 0;) {
+		if (tx[i].status() == RingTX::SUCCESS)
+			tx_fails[i] = 0;
+		else if (tx_fails[i] < UINT8_MAX)
+			tx_fails[i]++;
+
+		if (tx_fails[i] >= RING_RELAY_MAX_FAILS && !assumed)
+			remove(i);
+	}
+}
+
+#endif
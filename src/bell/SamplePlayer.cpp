@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file SamplePlayer.cpp
+ * @author Patrick Pedersen
+ *
+ * @brief SamplePlayer class implementation
+ *
+ * The following file contains the implementation of the SamplePlayer class.
+ * For more information on the class, see the header file.
+ *
+ */
+
+#ifdef TARGET_DEV_BELL
+
+#include <log.h>
+
+#include <bell/SamplePlayer.h>
+
+#define SIGMA_DELTA_CHANNEL 0
+#define SIGMA_DELTA_FREQ 312500 // Hz, well above the audible range
+#define SAMPLE_SILENCE 0x80	// Midpoint of unsigned 8-bit PCM
+#define TIMER1_TICKS_PER_S 5000000 // 80 MHz / TIM_DIV16
+
+// Refer to header for documentation
+SamplePlayer::SamplePlayer()
+{
+}
+
+// Refer to header for documentation
+SamplePlayer::SamplePlayer(uint8_t pin, const String path, uint16_t rate)
+: pin(pin), path(path), rate(rate)
+{
+	log_msg("SamplePlayer::SamplePlayer", "Initializing SamplePlayer for: " + path);
+
+	// Don't format the flash if no filesystem image has been uploaded,
+	// we'll just fall back to the melody instead.
+	LittleFSConfig cfg;
+	cfg.setAutoFormat(false);
+	LittleFS.setConfig(cfg);
+
+	mounted = LittleFS.begin();
+
+	if (!mounted)
+		log_msg("SamplePlayer::SamplePlayer", "Failed to mount LittleFS, samples unavailable!");
+}
+
+// Refer to header for documentation
+void IRAM_ATTR SamplePlayer::isr()
+{
+	if (pos >= buf_len[cur]) {
+		uint8_t nxt = cur ^ 1;
+
+		if (buf_len[nxt] == 0) {
+			if (eof)
+				done = true;
+			else
+				n_underruns++; // Hold last sample until refilled
+			return;
+		}
+
+		buf_len[cur] = 0; // Hand buffer back to update() for refilling
+		cur = nxt;
+		pos = 0;
+	}
+
+	GPSD = (GPSD & ~(0xFF << GPSDT)) | (buf[cur][pos++] << GPSDT);
+}
+
+// Refer to header for documentation
+void SamplePlayer::fill(uint8_t i)
+{
+	uint32_t t = micros();
+	size_t n = file.read(buf[i], BELL_SAMPLE_BUF_LEN);
+	read_us += micros() - t;
+	bytes_read += n;
+
+	// The length marks the buffer as ready for the ISR. It must be set
+	// before eof, or the ISR may take the missing buffer for the end
+	// of the sample and drop it.
+	buf_len[i] = n;
+
+	if (n < BELL_SAMPLE_BUF_LEN)
+		eof = true;
+}
+
+// Refer to header for documentation
+bool SamplePlayer::play()
+{
+	if (!mounted)
+		return false;
+
+	if (active) {
+		log_msg("SamplePlayer::play", "Attempted to play while already playing!");
+		return false;
+	}
+
+	uint32_t t = micros();
+
+	file = LittleFS.open(path, "r");
+	if (!file) {
+		log_msg("SamplePlayer::play", "Sample file " + path + " not found!");
+		return false;
+	}
+
+	buf_len[0] = 0;
+	buf_len[1] = 0;
+	cur = 0;
+	pos = 0;
+	eof = false;
+	done = false;
+
+	// Only fill the first buffer here to keep the start latency bounded,
+	// the second one is filled by the next update() call.
+	fill(0);
+
+	if (buf_len[0] == 0) {
+		log_msg("SamplePlayer::play", "Sample file " + path + " is empty!");
+		file.close();
+		return false;
+	}
+
+	sigmaDeltaSetup(SIGMA_DELTA_CHANNEL, SIGMA_DELTA_FREQ);
+	sigmaDeltaAttachPin(pin, SIGMA_DELTA_CHANNEL);
+	sigmaDeltaWrite(SIGMA_DELTA_CHANNEL, SAMPLE_SILENCE);
+
+	timer1_attachInterrupt(&isr);
+	timer1_enable(TIM_DIV16, TIM_EDGE, TIM_LOOP);
+	timer1_write(TIMER1_TICKS_PER_S / rate);
+
+	active = true;
+	start_us = micros() - t;
+
+	log_msg("SamplePlayer::play", "Playing " + path + " (started after " + String(start_us) + "us)");
+
+	return true;
+}
+
+// Refer to header for documentation
+void SamplePlayer::stop()
+{
+	timer1_disable();
+	timer1_detachInterrupt();
+
+	sigmaDeltaWrite(SIGMA_DELTA_CHANNEL, 0);
+	sigmaDeltaDetachPin(pin);
+
+	file.close();
+	active = false;
+
+	log_msg("SamplePlayer::stop", "Done playing! Underruns: " + String(n_underruns) +
+		", flash read rate: " + String(readRate()) + " B/s");
+}
+
+// Refer to header for documentation
+bool SamplePlayer::playing()
+{
+	return active;
+}
+
+// Refer to header for documentation
+void SamplePlayer::update()
+{
+	if (!active)
+		return;
+
+	if (done) {
+		stop();
+		return;
+	}
+
+	uint8_t nxt = cur ^ 1;
+	if (!eof && buf_len[nxt] == 0)
+		fill(nxt);
+}
+
+// Refer to header for documentation
+uint16_t SamplePlayer::refillInterval()
+{
+	return (uint32_t)BELL_SAMPLE_BUF_LEN * 1000 / rate / 2;
+}
+
+// Refer to header for documentation
+uint32_t SamplePlayer::underruns()
+{
+	return n_underruns;
+}
+
+// Refer to header for documentation
+uint32_t SamplePlayer::readRate()
+{
+	if (read_us == 0)
+		return 0;
+
+	return (uint64_t)bytes_read * 1000000 / read_us;
+}
+
+// Refer to header for documentation
+uint32_t SamplePlayer::startLatency()
+{
+	return start_us;
+}
+
+#endif
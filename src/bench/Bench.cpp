@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file Bench.cpp
+ * @author Patrick Pedersen
+ *
+ * @brief Bench class implementation
+ *
+ * The following file contains the implementation of the Bench class.
+ * For more information on the class, see the header file.
+ *
+ */
+
+#ifdef TARGET_DEV_BENCH
+
+#include <stdlib.h>
+
+#ifdef ARDUINO
+#include <log.h>
+#else
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+#include <bench/Bench.h>
+
+#ifdef ARDUINO
+#define bench_printf Serial.printf
+#else
+#define bench_printf printf
+#endif
+
+#ifdef ARDUINO
+// Allocation counters, see the nodemcuv2_bench environment
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	Bench::n_allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	Bench::n_allocs++;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	Bench::n_allocs++;
+	return __real_realloc(ptr, size);
+}
+}
+#endif
+
+// Refer to header for documentation
+uint32_t Bench::cycles()
+{
+#ifdef ARDUINO
+	return ESP.getCycleCount();
+#elif defined(__x86_64__) || defined(__i386__)
+	return (uint32_t)__rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Refer to header for documentation
+void Bench::nop(void *arg)
+{
+	asm volatile("" ::: "memory");
+}
+
+// Refer to header for documentation
+void Bench::add(const char *name, bench_fn_t fn, void *arg)
+{
+	if (n_cases >= BENCH_MAX_CASES) {
+#ifdef ARDUINO
+		log_msg("Bench::add", "Too many benchmarks, dropping " + String(name));
+#else
+		fprintf(stderr, "Too many benchmarks, dropping %s\n", name);
+#endif
+		return;
+	}
+
+	cases[n_cases++] = { name, fn, arg };
+}
+
+// Refer to header for documentation
+bench_result_t Bench::measure(bench_fn_t fn, void *arg, uint32_t iterations, uint32_t overhead)
+{
+	bench_result_t r = {};
+	r.iterations = iterations;
+
+	uint32_t allocs = n_allocs;
+
+	for (uint32_t i = 0; i < iterations; i++) {
+		uint32_t t = cycles();
+		fn(arg);
+		t = cycles() - t;
+
+		samples[i] = t > overhead ? t - overhead : 0;
+
+#ifdef ARDUINO
+		// Keep the software watchdog and the SDK happy
+		if ((i & 0x0F) == 0x0F)
+			yield();
+#endif
+	}
+
+	r.allocs = n_allocs - allocs;
+
+	// Insertion sort, iterations are few and the samples mostly ordered
+	for (uint32_t i = 1; i < iterations; i++) {
+		uint32_t v = samples[i];
+		uint32_t j = i;
+
+		for (; j > 0 && samples[j - 1] > v; j--)
+			samples[j] = samples[j - 1];
+
+		samples[j] = v;
+	}
+
+	r.min = samples[0];
+	r.median = samples[iterations / 2];
+	r.max = samples[iterations - 1];
+
+	return r;
+}
+
+// Refer to header for documentation
+void Bench::run(uint32_t iterations)
+{
+	if (iterations > BENCH_MAX_ITERATIONS)
+		iterations = BENCH_MAX_ITERATIONS;
+
+	if (iterations == 0)
+		return;
+
+	uint32_t overhead = measure(&nop, NULL, iterations, 0).min;
+
+	bench_printf("BENCH,name,iterations,min,median,max,allocs_per_call\n");
+	bench_printf("BENCH,overhead,%lu,%lu,%lu,%lu,0\n", (unsigned long)iterations,
+		     (unsigned long)overhead, (unsigned long)overhead, (unsigned long)overhead);
+
+	for (uint8_t i = 0; i < n_cases; i++) {
+		bench_result_t r = measure(cases[i].fn, cases[i].arg, iterations, overhead);
+
+		bench_printf("BENCH,%s,%lu,%lu,%lu,%lu,%lu.%02lu\n", cases[i].name, (unsigned long)r.iterations,
+			     (unsigned long)r.min, (unsigned long)r.median, (unsigned long)r.max,
+			     (unsigned long)(r.allocs / iterations), (unsigned long)(r.allocs * 100 / iterations % 100));
+	}
+
+	bench_printf("BENCH,done\n");
+}
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file Main_Bench.cpp
+ * @author Patrick Pedersen
+ *
+ * @brief Main file of the benchmark firmware
+ *
+ * The following file contains the setup and loop function for the benchmark firmware.
+ * The benchmark firmware is built on top of the bell firmware (see the nodemcuv2_bench
+ * environment), registers the hot paths of the bell, as well as the benchmarks that
+ * don't depend on the hardware (See pure_cases.h), and runs them through the Bench
+ * class. Results are printed on boot, and again whenever a byte is received over serial.
+ *
+ */
+
+#if defined(TARGET_DEV_BENCH) && defined(ARDUINO)
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include <config.h>
+#include <log.h>
+#include <ring_msg.h>
+#include <Scheduler.h>
+#include <StatusLED.h>
+
+#include <bell/Bell.h>
+#include <bell/Buzzer.h>
+#include <bell/RingReceiver.h>
+
+#include <bench/Bench.h>
+#include <bench/pure_cases.h>
+
+Bell bell;
+Buzzer buzzer;
+StatusLED led;
+
+static uint8_t ring_pkt[] = { RING_MSG };
+
+static void bench_log_msg(void *arg)
+{
+	log_msg("Bench", "Benchmark log message");
+}
+
+static void bench_ip_from_string(void *arg)
+{
+	IPAddress ip;
+	ip.fromString(BELL_IP);
+}
+
+// Only the parser, handling the ring would leave it pending for the Bell::run() case
+static void bench_ring_parse(void *arg)
+{
+	ring_rx_msg_t msg;
+	RingReceiver::parse(ring_pkt, sizeof(ring_pkt), &msg);
+}
+
+static void bench_led_mode(void *arg)
+{
+	led.mode(StatusLED::BLINK);
+}
+
+static void bench_buzzer_update(void *arg)
+{
+	buzzer.update();
+}
+
+static void bench_bell_run(void *arg)
+{
+	bell.run();
+}
+
+void setup()
+{
+	Serial.begin(115200);
+
+	BellCFG cfg;
+
+	cfg.buzzer_pin		= BELL_BUZZER;
+	cfg.led_pin		= BELL_LED;
+	cfg.ssid 		= WIFI_SSID;
+	cfg.psk 		= WIFI_PSK;
+	cfg.door_ip 		= DOOR_IP;
+	cfg.static_ip 		= BELL_IP;
+	cfg.gateway 		= GATEWAY;
+	cfg.subnet 		= "255.255.255.0";
+	cfg.port 		= TCP_PORT;
+	cfg.sleep_mode		= WIFI_NONE_SLEEP;
+	cfg.discovery_port	= 0;
+	cfg.metrics_port	= 0;
+
+	bell = Bell(cfg);
+
+	// Get past the boot message, so the step measures a regular state
+	for (uint8_t i = 0; i < BENCH_WARMUP_STEPS; i++)
+		bell.run();
+
+	led = StatusLED(BELL_LED);
+
+	// Without a sample file, the Buzzer keeps rescheduling
+	// the current note, which is the common update() path
+	buzzer = Buzzer(BELL_BUZZER, BELL_MELODY, MELODY_LEN(BELL_MELODY));
+	buzzer.ring();
+
+	Bench::add("log_msg", &bench_log_msg);
+	Bench::add("IPAddress::fromString", &bench_ip_from_string);
+	Bench::add("RingReceiver::parse", &bench_ring_parse);
+	Bench::add("StatusLED::mode", &bench_led_mode);
+	Bench::add("Buzzer::update", &bench_buzzer_update);
+	Bench::add("Bell::run", &bench_bell_run);
+	bench_add_pure_cases();
+
+	Bench::run(BENCH_ITERATIONS);
+}
+
+void loop()
+{
+	if (Serial.available() > 0) {
+		while (Serial.available() > 0)
+			Serial.read();
+
+		Bench::run(BENCH_ITERATIONS);
+	}
+
+	Scheduler::idle();
+}
+
+#endif
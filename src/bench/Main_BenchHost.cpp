@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file Main_BenchHost.cpp
+ * @author Patrick Pedersen
+ *
+ * @brief Main file of the host benchmark runner
+ *
+ * The following file contains the main function of the host benchmark runner
+ * (see the native_bench environment). It runs the benchmarks that don't depend
+ * on the hardware (See pure_cases.h) and prints the same BENCH CSV lines as the
+ * benchmark firmware.
+ *
+ */
+
+#if defined(TARGET_DEV_BENCH) && !defined(ARDUINO)
+
+#include <config.h>
+
+#include <bench/Bench.h>
+#include <bench/pure_cases.h>
+
+int main(int argc, char **argv)
+{
+	bench_add_pure_cases();
+	Bench::run(BENCH_ITERATIONS);
+
+	return 0;
+}
+
+#endif
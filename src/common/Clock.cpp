@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file Clock.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief Clock and Deadline class implementation
+ * 
+ * The following file contains the implementation of the Clock and
+ * Deadline classes. For more information on the classes, see the
+ * header file.
+ * 
+ */
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#include <Clock.h>
+
+// Refer to header for documentation
+clock_ms_t Clock::now()
+{
+	return nowUs() / 1000;
+}
+
+// Refer to header for documentation
+uint64_t Clock::nowUs()
+{
+#ifdef ARDUINO
+	return micros64();
+#else
+	return src != NULL ? src() : 0;
+#endif
+}
+
+#ifndef ARDUINO
+// Refer to header for documentation
+void Clock::source(clock_source_t fn)
+{
+	src = fn;
+}
+#endif
+
+// Refer to header for documentation
+void Deadline::in(clock_ms_t ms)
+{
+	at = Clock::now() + ms;
+}
+
+// Refer to header for documentation
+void Deadline::advance(clock_ms_t ms)
+{
+	clock_ms_t now = Clock::now();
+
+	at += ms;
+	if (at <= now)
+		at = now + ms;
+}
+
+// Refer to header for documentation
+bool Deadline::expired() const
+{
+	return Clock::now() >= at;
+}
+
+// Refer to header for documentation
+clock_ms_t Deadline::remaining() const
+{
+	clock_ms_t now = Clock::now();
+	return at > now ? at - now : 0;
+}
+
+// Refer to header for documentation
+clock_ms_t Deadline::time() const
+{
+	return at;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file CrashLog.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief CrashLog class implementation
+ * 
+ * The following file contains the implementation of the CrashLog class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#include <user_interface.h>
+
+#include <log.h>
+#include <LoopProfiler.h>
+
+#include <CrashLog.h>
+
+#define CRASH_RTC_MAGIC 0x43525348 // "CRSH"
+#define CRASH_RTC_OFFSET 0	   // In 4-byte blocks of the RTC user memory
+
+// Code lives in IRAM or is mapped from flash
+#define CRASH_IS_CODE(a) (((a) >= 0x40100000 && (a) < 0x40108000) || ((a) >= 0x40200000 && (a) < 0x40300000))
+
+/// Record as kept in RTC memory
+struct crash_rtc_t {
+	uint32_t magic;
+	crash_record_t rec;
+};
+
+// Refer to header for documentation
+void CrashLog::begin(crash_save_t save_cb)
+{
+	save = save_cb;
+
+	const rst_info *rst = ESP.getResetInfoPtr();
+	crash_rtc_t rtc;
+
+	// The crash handler doesn't run on hardware watchdog resets,
+	// so take what the SDK knows and complete it from RTC memory
+	crashed = rst->reason == REASON_WDT_RST || rst->reason == REASON_EXCEPTION_RST ||
+		  rst->reason == REASON_SOFT_WDT_RST;
+
+	if (ESP.rtcUserMemoryRead(CRASH_RTC_OFFSET, (uint32_t *)&rtc, sizeof(rtc)) &&
+	    rtc.magic == CRASH_RTC_MAGIC) {
+		prev = rtc.rec;
+		crashed = true;
+
+		// Consume the record
+		rtc.magic = 0;
+		ESP.rtcUserMemoryWrite(CRASH_RTC_OFFSET, (uint32_t *)&rtc, sizeof(rtc));
+	} else if (crashed) {
+		memset(&prev, 0, sizeof(prev));
+		prev.reason = rst->reason;
+		prev.exccause = rst->exccause;
+		prev.epc1 = rst->epc1;
+		prev.excvaddr = rst->excvaddr;
+	}
+
+	if (crashed)
+		log_msg("CrashLog::begin", "Recovered from a crash: " + describe(prev));
+}
+
+// Refer to header for documentation
+void CrashLog::state(uint8_t s)
+{
+	memmove(&cur.states[1], &cur.states[0], CRASH_N_STATES - 1);
+	cur.states[0] = s;
+}
+
+// Refer to header for documentation
+void CrashLog::store()
+{
+	crash_rtc_t rtc = { CRASH_RTC_MAGIC, cur };
+	ESP.rtcUserMemoryWrite(CRASH_RTC_OFFSET, (uint32_t *)&rtc, sizeof(rtc));
+
+	if (save != NULL)
+		save(cur);
+}
+
+// Refer to header for documentation
+void CrashLog::fault(uint8_t reason)
+{
+	cur.reason = reason;
+	cur.exccause = 0;
+	cur.epc1 = 0;
+	cur.excvaddr = 0;
+	cur.uptime_ms = millis();
+	cur.comp = LoopProfiler::current();
+	memset(cur.stack, 0, sizeof(cur.stack));
+
+	store();
+}
+
+// Refer to header for documentation
+void CrashLog::capture(uint32_t reason, uint32_t exccause, uint32_t epc1, uint32_t excvaddr,
+		       uint32_t stack, uint32_t stack_end)
+{
+	cur.reason = reason;
+	cur.exccause = exccause;
+	cur.epc1 = epc1;
+	cur.excvaddr = excvaddr;
+	cur.uptime_ms = millis();
+	cur.comp = LoopProfiler::current();
+
+	// Return addresses are the code addresses on the stack,
+	// though not every code address is a return address
+	uint8_t n = 0;
+	memset(cur.stack, 0, sizeof(cur.stack));
+
+	for (uint32_t p = stack; p + 4 <= stack_end && n < CRASH_STACK_WORDS; p += 4) {
+		uint32_t v = *(const uint32_t *)(uintptr_t)p;
+
+		if (CRASH_IS_CODE(v))
+			cur.stack[n++] = v;
+	}
+
+	store();
+}
+
+// Refer to header for documentation
+const crash_record_t *CrashLog::last()
+{
+	return crashed ? &prev : NULL;
+}
+
+// Refer to header for documentation
+String CrashLog::describe(const crash_record_t &rec)
+{
+	String s = "reason: " + String(rec.reason) + ", exception: " + String(rec.exccause) +
+		   ", epc1: 0x" + String(rec.epc1, HEX) + ", excvaddr: 0x" + String(rec.excvaddr, HEX) +
+		   ", uptime: " + String(rec.uptime_ms) + "ms, component: " +
+		   LoopProfiler::name((prof_component)rec.comp) + ", states:";
+
+	for (uint8_t i = 0; i < CRASH_N_STATES; i++)
+		s += " " + String(rec.states[i]);
+
+	s += ", stack:";
+
+	for (uint8_t i = 0; i < CRASH_STACK_WORDS && rec.stack[i] != 0; i++)
+		s += " 0x" + String(rec.stack[i], HEX);
+
+	return s;
+}
+
+// Called by the postmortem handler of the ESP8266 core on exceptions and software watchdog resets
+extern "C" void custom_crash_callback(struct rst_info *rst_info, uint32_t stack, uint32_t stack_end)
+{
+	CrashLog::capture(rst_info->reason, rst_info->exccause, rst_info->epc1, rst_info->excvaddr,
+			  stack, stack_end);
+}
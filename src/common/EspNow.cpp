@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file EspNow.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief EspNow class implementation
+ * 
+ * The following file contains the implementation of the EspNow class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#include <ESP8266WiFi.h>
+#include <espnow.h>
+
+#include <log.h>
+
+#include <EspNow.h>
+
+static uint8_t broadcast_mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+// Refer to header for documentation
+bool EspNow::begin()
+{
+	if (running)
+		return true;
+
+	if (esp_now_init() != 0) {
+		log_msg("EspNow::begin", "Failed to initialize ESP-NOW!");
+		return false;
+	}
+
+	esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
+	esp_now_add_peer(broadcast_mac, ESP_NOW_ROLE_COMBO, WiFi.channel(), NULL, 0);
+	esp_now_register_recv_cb(&on_recv);
+	esp_now_register_send_cb(&on_sent);
+
+	running = true;
+	log_msg("EspNow::begin", "ESP-NOW started");
+
+	return true;
+}
+
+// Refer to header for documentation
+void EspNow::rejoin()
+{
+	if (!running)
+		return;
+
+	esp_now_del_peer(broadcast_mac);
+	esp_now_add_peer(broadcast_mac, ESP_NOW_ROLE_COMBO, WiFi.channel(), NULL, 0);
+	log_msg("EspNow::rejoin", "Broadcasting on channel " + String(WiFi.channel()));
+}
+
+// Refer to header for documentation
+bool EspNow::onFrame(uint8_t m, espnow_frame_handler_t handler)
+{
+	if (n_handlers == ESPNOW_MAX_HANDLERS) {
+		log_msg("EspNow::onFrame", "Too many frame handlers!");
+		return false;
+	}
+
+	magic[n_handlers] = m;
+	handlers[n_handlers] = handler;
+	n_handlers++;
+
+	return true;
+}
+
+// Refer to header for documentation
+void EspNow::onSent(espnow_sent_handler_t handler)
+{
+	sent_handler = handler;
+}
+
+// Refer to header for documentation
+bool EspNow::broadcast(const void *data, uint8_t len)
+{
+	if (!running)
+		return false;
+
+	tx_at = micros();
+	return esp_now_send(broadcast_mac, (uint8_t *)data, len) == 0;
+}
+
+// Refer to header for documentation
+uint32_t EspNow::txLatency()
+{
+	return tx_us;
+}
+
+// Refer to header for documentation
+void EspNow::on_recv(uint8_t *mac, uint8_t *data, uint8_t len)
+{
+	if (len == 0)
+		return;
+
+	for (uint8_t i = 0; i < n_handlers; i++) {
+		if (magic[i] == data[0]) {
+			handlers[i](mac, data, len);
+			return;
+		}
+	}
+}
+
+// Refer to header for documentation
+void EspNow::on_sent(uint8_t *mac, uint8_t status)
+{
+	uint32_t lat = micros() - tx_at;
+
+	// Exponentially weighted, frames are sent one at a time
+	tx_us = tx_us == 0 ? lat : tx_us + ((int32_t)lat - (int32_t)tx_us) / 8;
+
+	if (sent_handler != NULL)
+		sent_handler(status == 0);
+}
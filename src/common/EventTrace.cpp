@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file EventTrace.cpp
+ * @author Patrick Pedersen
+ *
+ * @brief EventTrace class implementation
+ *
+ * The following file contains the implementation of the EventTrace class.
+ * For more information on the class, see the header file.
+ *
+ */
+
+#include <stdio.h>
+
+#include <Clock.h>
+#include <EventTrace.h>
+
+// Refer to header for documentation
+void EventTrace::begin(const char *dev, uint8_t n_states, evt_state_name_fn_t fn, void *arg)
+{
+	device = dev;
+	EventTrace::n_states = n_states;
+	state_name = fn;
+	state_arg = arg;
+}
+
+// The rest is only compiled in if used, as the buffer takes up RAM
+#ifdef USE_EVENT_TRACE
+
+#define EVENT_TRACE_LINE_LEN 48
+
+static evt_t events[EVENT_TRACE_LEN];
+
+// Refer to header for documentation
+void EventTrace::record(evt_type type, uint8_t a, uint16_t b)
+{
+	if (held)
+		return;
+
+#ifdef ARDUINO
+	uint32_t us = micros();
+#else
+	uint32_t us = Clock::nowUs();
+#endif
+
+	events[head] = { us, type, a, b };
+	head = (head + 1) % EVENT_TRACE_LEN;
+
+	if (n < EVENT_TRACE_LEN)
+		n++;
+	else
+		n_lost++;
+}
+
+// Refer to header for documentation
+void EventTrace::hold(bool hold)
+{
+	held = hold;
+}
+
+// Refer to header for documentation
+uint16_t EventTrace::lines()
+{
+	return 1 + n_states + n + 1;
+}
+
+// Refer to header for documentation
+void EventTrace::line(uint16_t i, char *buf, size_t len)
+{
+	if (i == 0) {
+		snprintf(buf, len, "EVT_BEGIN,%s,%u,%lu\n", device, n, (unsigned long)n_lost);
+		return;
+	}
+
+	i--;
+
+	if (i < n_states) {
+		const char *name = state_name != NULL ? state_name(i, state_arg) : "";
+		snprintf(buf, len, "EVT_STATE,%u,%s\n", i, name);
+		return;
+	}
+
+	i -= n_states;
+
+	if (i < n) {
+		const evt_t &e = events[(head + EVENT_TRACE_LEN - n + i) % EVENT_TRACE_LEN];
+		snprintf(buf, len, "EVT,%lu,%u,%u,%u\n", (unsigned long)e.us, e.type, e.a, e.b);
+		return;
+	}
+
+	snprintf(buf, len, "EVT_END\n");
+}
+
+// Refer to header for documentation
+void EventTrace::dump()
+{
+	char buf[EVENT_TRACE_LINE_LEN];
+
+	hold(true);
+
+	for (uint16_t i = 0; i < lines(); i++) {
+		line(i, buf, sizeof(buf));
+#ifdef ARDUINO
+		Serial.print(buf);
+
+		// Don't starve the SDK while the UART drains
+		if ((i & 0x1F) == 0x1F)
+			yield();
+#else
+		fputs(buf, stdout);
+#endif
+	}
+
+	hold(false);
+}
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file HeapMonitor.cpp
+ * @author Patrick Pedersen
+ *
+ * @brief HeapMonitor class implementation
+ *
+ * The following file contains the implementation of the HeapMonitor class.
+ * For more information on the class, see the header file.
+ *
+ */
+
+#include <log.h>
+
+#include <HeapMonitor.h>
+
+#define HEAP_ALERT_HYSTERESIS 10 // %
+
+// Refer to header for documentation
+void HeapMonitor::begin(uint16_t interval_ms, uint8_t frag_alert, uint32_t min_block)
+{
+	HeapMonitor::interval_ms = interval_ms;
+	HeapMonitor::frag_alert = frag_alert;
+	HeapMonitor::min_block = min_block;
+
+	stat.free_min = UINT32_MAX;
+	stat.max_block_min = UINT32_MAX;
+	stat.stack_free_min = UINT32_MAX;
+
+	task.prof = PROF_OTHER;
+	sample();
+	Scheduler::schedule(&task, interval_ms, &on_sample, NULL);
+}
+
+// Refer to header for documentation
+void HeapMonitor::on_sample(void *arg)
+{
+	sample();
+	Scheduler::schedule(&task, interval_ms, &on_sample, NULL);
+}
+
+// Refer to header for documentation
+void HeapMonitor::sample()
+{
+	stat.free = ESP.getFreeHeap();
+	stat.max_block = ESP.getMaxFreeBlockSize();
+	stat.frag = ESP.getHeapFragmentation();
+	stat.samples++;
+
+	// Scans the stack for the fill pattern, and thus
+	// returns the least free stack since boot
+	uint32_t stack_free = ESP.getFreeContStack();
+
+	if (stat.free < stat.free_min)
+		stat.free_min = stat.free;
+
+	if (stat.max_block < stat.max_block_min)
+		stat.max_block_min = stat.max_block;
+
+	if (stat.frag > stat.frag_max)
+		stat.frag_max = stat.frag;
+
+	if (stack_free < stat.stack_free_min)
+		stat.stack_free_min = stack_free;
+
+	if (!alerted && stat.frag >= frag_alert) {
+		alerted = true;
+		stat.alerts++;
+		log_msg("HeapMonitor::sample", "Heap fragmentation at " + String(stat.frag) + "%! Free: " +
+			String(stat.free) + " bytes, largest block: " + String(stat.max_block) + " bytes");
+	} else if (alerted && stat.frag + HEAP_ALERT_HYSTERESIS < frag_alert) {
+		alerted = false;
+	}
+}
+
+// Refer to header for documentation
+bool HeapMonitor::pressure()
+{
+	return stat.samples > 0 && stat.max_block < min_block;
+}
+
+// Refer to header for documentation
+const heap_stats_t &HeapMonitor::stats()
+{
+	return stat;
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file LEDEngine.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief LEDEngine class implementation
+ * 
+ * The following file contains the implementation of the LEDEngine class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#include <Arduino.h>
+
+#include <EventTrace.h>
+#include <LEDEngine.h>
+#include <LoopProfiler.h>
+
+#define GPIO16 16
+
+// Refer to header for documentation
+int8_t LEDEngine::attach(uint8_t pin)
+{
+	int8_t free = -1;
+
+	for (int8_t i = 0; i < LED_ENGINE_MAX_LEDS; i++) {
+		if (ch[i].used && ch[i].pin == pin)
+			return i;
+
+		if (!ch[i].used && free == -1)
+			free = i;
+	}
+
+	if (free == -1)
+		return -1;
+
+	channel &c = ch[free];
+	c = {};
+	c.pin = pin;
+	c.used = true;
+
+	pinMode(pin, OUTPUT);
+	digitalWrite(pin, LOW);
+
+	return free;
+}
+
+// Refer to header for documentation
+uint16_t LEDEngine::duration(channel &c)
+{
+	uint16_t ms = c.steps[c.step].ms;
+	return ms ? ms : c.interval;
+}
+
+// Refer to header for documentation
+void LEDEngine::level(channel &c, uint8_t lvl, uint32_t *set, uint32_t *clr)
+{
+	if (lvl != LED_LEVEL_OFF && lvl != LED_LEVEL_ON) {
+		analogWrite(c.pin, lvl);
+		c.pwm = true;
+		return;
+	}
+
+	// Setting the GPIO registers won't stop a running PWM waveform
+	if (c.pwm || c.pin == GPIO16) {
+		digitalWrite(c.pin, lvl ? HIGH : LOW);
+		c.pwm = false;
+		return;
+	}
+
+	if (lvl)
+		*set |= 1 << c.pin;
+	else
+		*clr |= 1 << c.pin;
+}
+
+// Refer to header for documentation
+void LEDEngine::flush(uint32_t set, uint32_t clr)
+{
+	if (set) {
+		GPOS = set;
+		EVT(EVT_LED, 1, set);
+	}
+	if (clr) {
+		GPOC = clr;
+		EVT(EVT_LED, 0, clr);
+	}
+}
+
+// Refer to header for documentation
+void LEDEngine::arm()
+{
+	bool any = false;
+	clock_ms_t next = 0;
+
+	for (uint8_t i = 0; i < LED_ENGINE_MAX_LEDS; i++) {
+		if (!ch[i].running)
+			continue;
+
+		clock_ms_t d = ch[i].deadline.remaining();
+		if (!any || d < next)
+			next = d;
+		any = true;
+	}
+
+	if (!any) {
+		ticker.detach();
+		return;
+	}
+
+	ticker.once_ms(next > 0 ? (uint32_t)next : 1, &tick);
+}
+
+// Refer to header for documentation
+void LEDEngine::tick()
+{
+	prof_mark_t m = LoopProfiler::enter(PROF_LED);
+	uint32_t set = 0, clr = 0;
+	uint8_t finished = 0;
+
+	for (uint8_t i = 0; i < LED_ENGINE_MAX_LEDS; i++) {
+		channel &c = ch[i];
+
+		if (!c.running || c.deadline.remaining() > LED_ENGINE_BATCH_MS)
+			continue;
+
+		if (++c.step == c.n_steps) {
+			c.step = 0;
+			c.reps++;
+
+			if (c.count && c.reps >= c.count) {
+				c.running = false;
+				level(c, LED_LEVEL_OFF, &set, &clr);
+				finished |= 1 << i;
+				continue;
+			}
+		}
+
+		level(c, c.steps[c.step].level, &set, &clr);
+
+		// Advance from the previous deadline rather than from now to
+		// avoid drifting, unless we've fallen behind (ex. long stall)
+		c.deadline.advance(duration(c));
+	}
+
+	flush(set, clr);
+
+	// Callbacks last, as they may start new patterns
+	for (uint8_t i = 0; i < LED_ENGINE_MAX_LEDS; i++) {
+		if ((finished & (1 << i)) && ch[i].cb != NULL)
+			ch[i].cb(ch[i].cb_arg);
+	}
+
+	arm();
+	LoopProfiler::leave(m);
+}
+
+// Refer to header for documentation
+void LEDEngine::set(int8_t c, uint8_t lvl)
+{
+	if (c < 0)
+		return;
+
+	uint32_t set = 0, clr = 0;
+
+	ch[c].running = false;
+	level(ch[c], lvl, &set, &clr);
+	flush(set, clr);
+
+	arm();
+}
+
+// Refer to header for documentation
+void LEDEngine::play(int8_t c, const led_pattern_t &p, uint16_t interval,
+		     uint16_t count, led_callback_t cb, void *arg)
+{
+	if (c < 0 || p.n_steps == 0)
+		return;
+
+	channel &chn = ch[c];
+	uint32_t set = 0, clr = 0;
+
+	chn.steps = p.steps;
+	chn.n_steps = p.n_steps;
+	chn.step = 0;
+	chn.count = count;
+	chn.reps = 0;
+	chn.interval = interval;
+	chn.cb = cb;
+	chn.cb_arg = arg;
+	chn.deadline.in(duration(chn));
+	chn.running = true;
+
+	level(chn, chn.steps[0].level, &set, &clr);
+	flush(set, clr);
+
+	arm();
+}
+
+// Refer to header for documentation
+void LEDEngine::setInterval(int8_t c, uint16_t interval)
+{
+	if (c < 0)
+		return;
+
+	ch[c].interval = interval;
+}
+
+// Refer to header for documentation
+uint16_t LEDEngine::repetitions(int8_t c)
+{
+	if (c < 0)
+		return 0;
+
+	return ch[c].reps;
+}
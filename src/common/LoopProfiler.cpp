@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file LoopProfiler.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief LoopProfiler class implementation
+ * 
+ * The following file contains the implementation of the LoopProfiler class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#include <LoopProfiler.h>
+
+#ifdef ARDUINO
+#include <log.h>
+
+static const char *const prof_names[PROF_N] = {
+	"main", "wifi", "buzzer", "led", "ring_sender", "net", "other"
+};
+
+// Refer to header for documentation
+void LoopProfiler::begin(uint16_t stall_ms)
+{
+	stall_us = (uint32_t)stall_ms * 1000;
+
+	timer0_isr_init();
+	timer0_attachInterrupt(&on_check);
+	running = true;
+
+	log_msg("LoopProfiler::begin", "Stall watchdog started (threshold: " + String(stall_ms) + "ms)");
+}
+
+// Refer to header for documentation
+void IRAM_ATTR LoopProfiler::arm(uint32_t us)
+{
+	timer0_write(ESP.getCycleCount() + microsecondsToClockCycles(us));
+}
+
+// Refer to header for documentation
+void IRAM_ATTR LoopProfiler::on_check()
+{
+	if (!busy || tripped)
+		return;
+
+	uint32_t elapsed = micros() - iter_us;
+
+	if (elapsed < stall_us) {
+		arm(stall_us - elapsed);
+		return;
+	}
+
+	tripped = true;
+	stall.comp = cur;
+	stall.state = iter_state;
+	stall.at_ms = millis();
+}
+
+// Refer to header for documentation
+void LoopProfiler::loopStart(uint8_t state)
+{
+	uint32_t now = micros();
+
+	if (stat.iterations > 0) {
+		uint32_t gap = now - end_us;
+		gap = gap > idle_us ? gap - idle_us : 0;
+
+		if (gap > stat.gap_max_us)
+			stat.gap_max_us = gap;
+	}
+
+	idle_us = 0;
+	iter_state = state;
+	iter_us = now;
+	tripped = false;
+	busy = true;
+
+	if (running)
+		arm(stall_us);
+}
+
+// Refer to header for documentation
+void LoopProfiler::loopEnd()
+{
+	busy = false;
+	end_us = micros();
+
+	stat.iterations++;
+	stat.loop_us = end_us - iter_us;
+	if (stat.loop_us > stat.loop_max_us)
+		stat.loop_max_us = stat.loop_us;
+
+	QuantileSketch::add(loop_sketch, stat.loop_us);
+
+	if (tripped) {
+		stall.dur_ms = stat.loop_us / 1000;
+		stat.stalls++;
+
+		log_msg("LoopProfiler::loopEnd", "Loop stalled for " + String(stall.dur_ms) + "ms in " +
+			String(name(stall.comp)) + " (state: " + String(stall.state) + ")");
+
+		// Don't count the log message above
+		end_us = micros();
+	}
+}
+
+// Refer to header for documentation
+prof_mark_t LoopProfiler::enter(prof_component c)
+{
+	prof_mark_t m = { cur, (uint32_t)micros() };
+	cur = c;
+	return m;
+}
+
+// Refer to header for documentation
+void LoopProfiler::leave(const prof_mark_t &m)
+{
+	prof_component c = cur;
+	uint32_t us = micros() - m.start_us;
+
+	stat.comp_us[c] += us;
+	if (us > stat.comp_max_us[c])
+		stat.comp_max_us[c] = us;
+
+	cur = m.prev;
+}
+
+// Refer to header for documentation
+void LoopProfiler::idling(uint32_t ms)
+{
+	idle_us = ms * 1000;
+}
+
+// Refer to header for documentation
+void LoopProfiler::logged(uint32_t us)
+{
+	stat.log_us += us;
+}
+
+// Refer to header for documentation
+void LoopProfiler::report()
+{
+	String s;
+
+	for (uint8_t i = 0; i < PROF_N; i++) {
+		s += String(prof_names[i]) + ": " + String(stat.comp_us[i] / 1000) + "ms (max: " +
+		     String(stat.comp_max_us[i]) + "us), ";
+	}
+
+	log_msg("LoopProfiler::report", s + "logging: " + String(stat.log_us / 1000) + "ms");
+	log_msg("LoopProfiler::report", String(stat.iterations) + " iterations, p99: " +
+		String(QuantileSketch::quantile(loop_sketch, 990)) + "us, max: " + String(stat.loop_max_us) +
+		"us, max gap: " + String(stat.gap_max_us) + "us, stalls: " + String(stat.stalls));
+}
+
+// Refer to header for documentation
+prof_component LoopProfiler::current()
+{
+	return cur;
+}
+
+// Refer to header for documentation
+const char *LoopProfiler::name(prof_component c)
+{
+	return c < PROF_N ? prof_names[c] : "?";
+}
+
+// Refer to header for documentation
+const prof_stats_t &LoopProfiler::stats()
+{
+	return stat;
+}
+
+// Refer to header for documentation
+const quantile_sketch_t &LoopProfiler::loopSketch()
+{
+	return loop_sketch;
+}
+
+// Refer to header for documentation
+const prof_stall_t &LoopProfiler::lastStall()
+{
+	return stall;
+}
+
+#else
+
+// Host builds don't profile, see header
+
+// Refer to header for documentation
+prof_mark_t LoopProfiler::enter(prof_component c)
+{
+	return { c, 0 };
+}
+
+// Refer to header for documentation
+void LoopProfiler::leave(const prof_mark_t &m)
+{
+}
+
+// Refer to header for documentation
+void LoopProfiler::idling(uint32_t ms)
+{
+	if (idle_hook != NULL)
+		idle_hook(ms);
+}
+
+// Refer to header for documentation
+void LoopProfiler::onIdle(prof_idle_hook_t fn)
+{
+	idle_hook = fn;
+}
+
+#endif
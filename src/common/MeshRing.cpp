@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file MeshRing.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief MeshRing class implementation
+ * 
+ * The following file contains the implementation of the MeshRing class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include <config.h>
+#include <log.h>
+
+#include <EspNow.h>
+#include <MeshRing.h>
+
+// Refer to header for documentation
+bool MeshRing::begin(bool relay, const char *door_mac)
+{
+	if (running)
+		return true;
+
+	if (relay) {
+		unsigned int m[6];
+
+		if (door_mac == NULL ||
+		    sscanf(door_mac, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 6) {
+			log_msg("MeshRing::begin", "Invalid door MAC address, cannot relay rings!");
+			return false;
+		}
+
+		for (uint8_t i = 0; i < 6; i++)
+			door[i] = m[i];
+	}
+
+	if (!EspNow::begin())
+		return false;
+
+	fwd_task.prof = PROF_NET;
+	EspNow::onSent(&on_sent);
+
+	if (relay)
+		EspNow::onFrame(MESH_MAGIC, &on_recv);
+
+	running = true;
+
+	log_msg("MeshRing::begin", relay ? "Receiving and relaying rings over ESP-NOW" : 
+					   "Sending rings over ESP-NOW");
+
+	return true;
+}
+
+// Refer to header for documentation
+bool MeshRing::send(uint8_t msg, uint16_t seq)
+{
+	if (!running) {
+		log_msg("MeshRing::send", "ESP-NOW not started, cannot send!");
+		return false;
+	}
+
+	mesh_frame_t frame = {};
+	frame.magic = MESH_MAGIC;
+	frame.msg = msg;
+	frame.seq = seq;
+	WiFi.macAddress(frame.origin);
+
+	// Don't ring ourselves if a relay picks up our own ring
+	seen(&frame);
+
+	if (!EspNow::broadcast(&frame, sizeof(frame))) {
+		log_msg("MeshRing::send", "Failed to send ring frame!");
+		return false;
+	}
+
+	log_msg("MeshRing::send", "Ring frame " + String(seq) + " sent");
+	return true;
+}
+
+// Refer to header for documentation
+bool MeshRing::seen(const mesh_frame_t *frame)
+{
+	for (uint8_t i = 0; i < cache_len; i++) {
+		if (cache[i].seq == frame->seq && 
+		    memcmp(cache[i].origin, frame->origin, sizeof(frame->origin)) == 0)
+			return true;
+	}
+
+	memcpy(cache[cache_pos].origin, frame->origin, sizeof(frame->origin));
+	cache[cache_pos].seq = frame->seq;
+	cache_pos = (cache_pos + 1) % MESH_DUP_CACHE_LEN;
+
+	if (cache_len < MESH_DUP_CACHE_LEN)
+		cache_len++;
+
+	return false;
+}
+
+// Refer to header for documentation
+void MeshRing::on_recv(const uint8_t *mac, const uint8_t *data, uint8_t len)
+{
+	mesh_frame_t frame;
+	ring_class cls;
+	unsigned long now = micros();
+
+	if (len != sizeof(frame))
+		return;
+
+	memcpy(&frame, data, sizeof(frame));
+
+	if (frame.magic != MESH_MAGIC || !ring_msg_class(frame.msg, &cls))
+		return;
+
+	// Only rings of our door, which sends the first hop itself
+	if (memcmp(frame.origin, door, sizeof(door)) != 0 ||
+	    (frame.hops == 0 && memcmp(mac, door, sizeof(door)) != 0)) {
+		stat.foreign++;
+		return;
+	}
+
+	if (seen(&frame)) {
+		stat.dups++;
+		return;
+	}
+
+	// Gaps in the press counter are rings we missed, counters
+	// that went backwards stem from a reset of the door
+	uint16_t gap = frame.seq - last_seq;
+	if (have_seq && gap > 1 && gap < 0x8000)
+		stat.lost += gap - 1;
+	last_seq = frame.seq;
+	have_seq = true;
+
+	stat.rx++;
+	stat.last_hops = frame.hops;
+	stat.last_relay_us = frame.relay_us;
+
+	// Keep the highest priority ring if the last one hasn't been polled yet
+	if (!recv || cls > recv_class)
+		recv_class = cls;
+	recv_us = now;
+	recv_seq = frame.seq;
+	recv = true;
+	Scheduler::wake();
+
+	if (frame.hops >= MESH_MAX_HOPS)
+		return;
+
+	if (fwd_pending || fwd_sending) {
+		stat.fwd_dropped++;
+		return;
+	}
+
+	fwd = frame;
+	fwd.hops++;
+	fwd_rx_us = now;
+	fwd_pending = true;
+	Scheduler::schedule(&fwd_task, random(MESH_FORWARD_JITTER_MS + 1), &on_forward, NULL);
+}
+
+// Refer to header for documentation
+void MeshRing::on_forward(void *arg)
+{
+	fwd_pending = false;
+	fwd.relay_us += micros() - fwd_rx_us;
+	fwd_sending = true;
+
+	if (!EspNow::broadcast(&fwd, sizeof(fwd))) {
+		fwd_sending = false;
+		log_msg("MeshRing::on_forward", "Failed to forward ring frame " + String(fwd.seq) + "!");
+	}
+}
+
+// Refer to header for documentation
+void MeshRing::on_sent(bool ok)
+{
+	// Only forwards are measured
+	if (!fwd_sending)
+		return;
+
+	fwd_sending = false;
+
+	uint32_t hop_us = micros() - fwd_rx_us;
+
+	stat.fwd++;
+	stat.hop_us_avg = stat.hop_us_avg + ((int32_t)hop_us - (int32_t)stat.hop_us_avg) / (int32_t)stat.fwd;
+	if (hop_us > stat.hop_us_max)
+		stat.hop_us_max = hop_us;
+}
+
+// Refer to header for documentation
+bool MeshRing::received(ring_class *cls)
+{
+	bool ret = recv;
+
+	if (ret && cls != NULL)
+		*cls = recv_class;
+
+	recv = false;
+	return ret;
+}
+
+// Refer to header for documentation
+unsigned long MeshRing::receivedAt()
+{
+	return recv_us;
+}
+
+// Refer to header for documentation
+uint16_t MeshRing::receivedSeq()
+{
+	return recv_seq;
+}
+
+// Refer to header for documentation
+const mesh_stats_t &MeshRing::stats()
+{
+	return stat;
+}
+
+// Refer to header for documentation
+uint16_t MeshRing::deliveryRatio()
+{
+	uint32_t total = stat.rx + stat.lost;
+
+	if (total == 0)
+		return 1000;
+
+	return (uint64_t)stat.rx * 1000 / total;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file QuantileSketch.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief QuantileSketch class implementation
+ * 
+ * The following file contains the implementation of the QuantileSketch class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#include <string.h>
+
+#include <QuantileSketch.h>
+
+// Refer to header for documentation
+uint8_t QuantileSketch::bucket(uint32_t v)
+{
+	// Small values are counted exactly
+	if (v < SKETCH_SUB)
+		return v;
+
+	uint8_t msb = 31 - __builtin_clz(v);
+	uint8_t octave = msb - SKETCH_SUB_BITS + 1;
+
+	return (octave << SKETCH_SUB_BITS) + ((v >> (msb - SKETCH_SUB_BITS)) & (SKETCH_SUB - 1));
+}
+
+// Refer to header for documentation
+uint32_t QuantileSketch::lower(uint8_t i)
+{
+	if (i < SKETCH_SUB)
+		return i;
+
+	uint8_t octave = i >> SKETCH_SUB_BITS;
+	return (uint32_t)(SKETCH_SUB + (i & (SKETCH_SUB - 1))) << (octave - 1);
+}
+
+// Refer to header for documentation
+void QuantileSketch::halve(quantile_sketch_t &s)
+{
+	// Rounded up, so rare values aren't dropped from the tail
+	for (uint16_t i = 0; i < SKETCH_N_BUCKETS; i++)
+		s.counts[i] = (s.counts[i] + 1) >> 1;
+}
+
+// Refer to header for documentation
+void QuantileSketch::add(quantile_sketch_t &s, uint32_t v)
+{
+	uint8_t i = bucket(v);
+
+	if (s.counts[i] == UINT16_MAX)
+		halve(s);
+
+	s.counts[i]++;
+	s.n++;
+
+	if (v > s.max)
+		s.max = v;
+}
+
+// Refer to header for documentation
+void QuantileSketch::merge(quantile_sketch_t &dst, const quantile_sketch_t &src)
+{
+	for (uint16_t i = 0; i < SKETCH_N_BUCKETS; i++) {
+		uint32_t c = (uint32_t)dst.counts[i] + src.counts[i];
+		dst.counts[i] = c < UINT16_MAX ? c : UINT16_MAX;
+	}
+
+	dst.n += src.n;
+
+	if (src.max > dst.max)
+		dst.max = src.max;
+}
+
+// Refer to header for documentation
+uint32_t QuantileSketch::quantile(const quantile_sketch_t &s, uint16_t permille)
+{
+	uint32_t total = 0;
+
+	for (uint16_t i = 0; i < SKETCH_N_BUCKETS; i++)
+		total += s.counts[i];
+
+	if (total == 0)
+		return 0;
+
+	// Rank of the quantile, rounded up
+	uint32_t rank = ((uint64_t)total * permille + 999) / 1000;
+	if (rank == 0)
+		rank = 1;
+
+	uint32_t seen = 0;
+
+	for (uint16_t i = 0; i < SKETCH_N_BUCKETS; i++) {
+		seen += s.counts[i];
+
+		if (seen >= rank) {
+			// Buckets of the n-th power of two are 2^(n-1) wide
+			uint32_t mid = lower(i);
+			if (i >= SKETCH_SUB)
+				mid += (1UL << ((i >> SKETCH_SUB_BITS) - 1)) / 2;
+
+			return mid < s.max ? mid : s.max;
+		}
+	}
+
+	return s.max;
+}
+
+// Refer to header for documentation
+void QuantileSketch::reset(quantile_sketch_t &s)
+{
+	memset(&s, 0, sizeof(s));
+}
@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file RingTX.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief RingTX class implementation
+ * 
+ * The following file contains the implementation of the RingTX class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#include <EventTrace.h>
+#include <log.h>
+#include <ring_msg.h>
+#include <trace.h>
+
+#include <RingTX.h>
+
+// Refer to header for documentation
+RingTX::RingTX()
+{
+	stat = UNINITIALIZED;
+}
+
+// Refer to header for documentation
+RingTX::RingTX(String dest_ip, unsigned int port, unsigned long timeout_ms, uint8_t msg)
+: ip(dest_ip), port(port), msg(msg), timeout(timeout_ms)
+{
+	log_msg("RingTX::RingTX", "Initializing RingTX to " + ip + ":" + String(port));
+	host = ip.substring(ip.lastIndexOf('.') + 1).toInt();
+	stat = AWAITING;
+}
+
+// Refer to header for documentation
+void RingTX::send(sched_task_t *notify)
+{
+	if (stat == UNINITIALIZED) {
+		log_msg("RingTX(to:" + ip + ":" + String(port) + ")::send", 
+			"RingTX not initialized, cannot send!");
+		return;
+	}
+
+	if (stat == CONNECTING || stat == SENDING) {
+		log_msg("RingTX(to:" + ip + ":" + String(port) + ")::send", 
+			"Still sending previous ring msg, ignoring send request!");
+		return;
+	}
+
+	log_msg("RingTX(to:" + ip + ":" + String(port) + ")::send", 
+		"Attempting to connect to bell at " + ip + ":" + String(port));
+
+	TRACE_HIGH(RING_TX);
+	EVT(EVT_CONNECT, host, 0);
+	notify_task = notify;
+	client.onConnect(&on_connect, this);
+	client.onAck(&on_ack, this);
+	tx_len = 0;
+	acked = 0;
+	client.connect(ip.c_str(), port);
+	stat = CONNECTING;
+	start = Clock::now();
+	deadline.in(timeout);
+}
+
+// Refer to header for documentation
+void RingTX::setMessage(uint8_t msg)
+{
+	this->msg = msg;
+}
+
+// Refer to header for documentation
+void RingTX::setStartAt(uint32_t start_at)
+{
+	this->start_at = start_at;
+	has_start_at = true;
+}
+
+// Refer to header for documentation
+void RingTX::clearStartAt()
+{
+	has_start_at = false;
+}
+
+// Refer to header for documentation
+bool RingTX::addTLV(uint8_t type, const void *val, uint8_t len)
+{
+	uint8_t i = 0;
+
+	while (i < n_tlvs && tlv_type[i] != type)
+		i++;
+
+	if (i == RING_TX_MAX_TLVS)
+		return false;
+
+	if (i == n_tlvs)
+		n_tlvs++;
+
+	tlv_type[i] = type;
+	tlv_val[i] = val;
+	tlv_len[i] = len;
+
+	return true;
+}
+
+// Refer to header for documentation
+void RingTX::setTrace(const ring_trace_t &t, bool fill)
+{
+	trace = t;
+	has_trace = true;
+	fill_trace = fill;
+}
+
+// Refer to header for documentation
+void RingTX::clearTrace()
+{
+	has_trace = false;
+}
+
+// Refer to header for documentation
+void RingTX::setSeq(uint16_t seq)
+{
+	this->seq = seq;
+	has_seq = true;
+}
+
+// Refer to header for documentation
+void RingTX::clearSeq()
+{
+	has_seq = false;
+}
+
+// Refer to header for documentation
+void RingTX::setTimeout(unsigned long timeout_ms)
+{
+	timeout = timeout_ms;
+}
+
+// Refer to header for documentation
+clock_ms_t RingTX::latency()
+{
+	return lat_ms;
+}
+
+// Refer to header for documentation
+bool RingTX::delivered()
+{
+	return tx_len > 0 && acked >= tx_len;
+}
+
+// Refer to header for documentation
+clock_ms_t RingTX::ackLatency()
+{
+	return ack_ms;
+}
+
+// Refer to header for documentation
+void RingTX::on_connect(void *arg, AsyncClient *client)
+{
+	RingTX *tx = (RingTX *)arg;
+
+	if (tx->notify_task != NULL)
+		Scheduler::notify(tx->notify_task);
+}
+
+// Refer to header for documentation
+void RingTX::on_ack(void *arg, AsyncClient *client, size_t len, uint32_t time)
+{
+	RingTX *tx = (RingTX *)arg;
+	bool pending = tx->acked < tx->tx_len;
+
+	tx->acked += len;
+	if (pending && tx->acked >= tx->tx_len)
+		tx->ack_ms = Clock::now() - tx->start;
+
+	EVT(EVT_ACK, tx->host, len);
+}
+
+// Refer to header for documentation
+bool RingTX::txRingMSG()
+{
+	size_t len = 0;
+
+	buf[len++] = msg;
+
+	if (has_start_at)
+		ring_msg_add_tlv(buf, &len, RING_TLV_START_AT, &start_at, sizeof(start_at));
+
+	if (has_trace) {
+		if (fill_trace) {
+			unsigned long send_us = micros() - con_us;
+
+			trace.send_us = send_us < UINT16_MAX ? send_us : UINT16_MAX;
+			trace.total_ms = Clock::now();
+		}
+
+		ring_msg_add_tlv(buf, &len, RING_TLV_TRACE, &trace, sizeof(trace));
+	}
+
+	if (has_seq)
+		ring_msg_add_tlv(buf, &len, RING_TLV_SEQ, &seq, sizeof(seq));
+
+	for (uint8_t i = 0; i < n_tlvs; i++) {
+		if (!ring_msg_add_tlv(buf, &len, tlv_type[i], tlv_val[i], tlv_len[i]))
+			log_msg("RingTX(to:" + ip + ":" + String(port) + ")::txRingMSG",
+				"TLV " + String(tlv_type[i]) + " doesn't fit into the ring message, dropped");
+	}
+
+	client.add((const char *)buf, len);
+	bool ret = client.send();
+
+	if (ret) {
+		tx_len = len;
+		TRACE_LOW(RING_TX);
+		EVT(EVT_SENT, host, msg);
+	}
+
+	return ret;
+}
+
+// Refer to header for documentation
+RingTX::ring_stat RingTX::con()
+{
+	if (client.connected()) {
+		log_msg("RingTX(to:" + ip + ":" + String(port) + ")::con", 
+			"Connected to bell at " + ip + ":" + String(port));
+		EVT(EVT_CONNECTED, host, 0);
+		if (fill_trace)
+			trace.connect_ms = Clock::now() - start;
+		con_us = micros();
+		deadline.in(timeout);
+		return SENDING;
+	}
+
+	if (timeout && deadline.expired()) {
+		log_msg("RingTX(to:" + ip + ":" + String(port) + ")::con", 
+			"Failed to connect to bell at " + ip + ":" + String(port) + ", timed out!");
+		TRACE_LOW(RING_TX);
+		EVT(EVT_TX_FAIL, host, 0);
+		return FAIL;
+	}
+
+	return CONNECTING;
+}
+
+// Refer to header for documentation
+RingTX::ring_stat RingTX::sen()
+{
+	if (txRingMSG()) {
+		lat_ms = Clock::now() - start;
+		return SUCCESS;
+	}
+
+	if (timeout && deadline.expired()) {
+		log_msg("RingTX(to:" + ip + ":" + String(port) + ")::send",
+			"Failed to send ring msg to bell at " + ip + ":" + String(port) + ", timed out!");
+		TRACE_LOW(RING_TX);
+		EVT(EVT_TX_FAIL, host, 0);
+		return FAIL;
+	}
+
+	return SENDING;
+}
+
+// Refer to header for documentation
+void RingTX::update()
+{
+	switch (stat) {
+		case CONNECTING:
+			stat = con();
+			break;
+		case SENDING:
+			stat = sen();
+			break;
+		default:
+			break;
+	}
+}
+
+// Refer to header for documentation
+RingTX::ring_stat RingTX::status()
+{
+	return stat;
+}
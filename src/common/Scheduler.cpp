@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file Scheduler.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief Scheduler class implementation
+ * 
+ * The following file contains the implementation of the Scheduler class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <coredecls.h>
+#endif
+
+#include <Scheduler.h>
+
+// Refer to header for documentation
+uint8_t Scheduler::slot(clock_ms_t deadline)
+{
+	return (deadline / SCHED_TICK_MS) % SCHED_WHEEL_SLOTS;
+}
+
+// Refer to header for documentation
+void Scheduler::unlink(sched_task_t *t)
+{
+	sched_task_t **p = &wheel[slot(t->deadline)];
+
+	while (*p != NULL) {
+		if (*p == t) {
+			*p = t->next;
+			break;
+		}
+		p = &(*p)->next;
+	}
+
+	t->next = NULL;
+	t->scheduled = false;
+}
+
+// Refer to header for documentation
+void Scheduler::schedule(sched_task_t *t, unsigned long delay_ms, sched_callback_t cb, void *arg)
+{
+	if (t->scheduled)
+		unlink(t);
+
+	t->cb = cb;
+	t->arg = arg;
+	t->deadline = Clock::now() + delay_ms;
+
+	uint8_t s = slot(t->deadline);
+	t->next = wheel[s];
+	wheel[s] = t;
+	t->scheduled = true;
+}
+
+// Refer to header for documentation
+void Scheduler::notify(sched_task_t *t)
+{
+	if (t->cb != NULL)
+		schedule(t, 0, t->cb, t->arg);
+
+	wake();
+}
+
+// Refer to header for documentation
+void Scheduler::cancel(sched_task_t *t)
+{
+	if (t->scheduled)
+		unlink(t);
+}
+
+// Refer to header for documentation
+bool Scheduler::scheduled(sched_task_t *t)
+{
+	return t->scheduled;
+}
+
+// Refer to header for documentation
+void Scheduler::wake()
+{
+	woken = true;
+#ifdef ARDUINO
+	esp_schedule(); // Resume the loop if it is idling
+#endif
+}
+
+// Refer to header for documentation
+uint8_t Scheduler::run()
+{
+	clock_ms_t now = Clock::now();
+	clock_ms_t now_tick = now / SCHED_TICK_MS;
+	clock_ms_t ticks = now_tick - cursor + 1;
+	sched_task_t *ready = NULL;
+	uint8_t n = 0;
+
+	woken = false;
+
+	// If we've fallen behind by more than a full turn,
+	// every slot has to be visited once anyways
+	if (ticks > SCHED_WHEEL_SLOTS)
+		ticks = SCHED_WHEEL_SLOTS;
+
+	// Collect due tasks first, as callbacks may (re-)schedule tasks
+	for (uint8_t i = 0; i < ticks; i++) {
+		sched_task_t **p = &wheel[(now_tick - i) % SCHED_WHEEL_SLOTS];
+
+		while (*p != NULL) {
+			sched_task_t *t = *p;
+
+			// Tasks of later turns of the wheel remain in their slot
+			if (t->deadline > now) {
+				p = &t->next;
+				continue;
+			}
+
+			*p = t->next;
+			t->next = ready;
+			t->scheduled = false;
+			ready = t;
+		}
+	}
+
+	// The current tick is revisited on the next run, as
+	// tasks may still become due within it
+	cursor = now_tick;
+
+	while (ready != NULL) {
+		sched_task_t *t = ready;
+		ready = t->next;
+		t->next = NULL;
+
+		unsigned long lat = now - t->deadline;
+		if (lat > lat_max)
+			lat_max = lat;
+		lat_avg = lat_avg - (lat_avg >> 4) + lat;
+
+		prof_mark_t m = LoopProfiler::enter(t->prof);
+		t->cb(t->arg);
+		LoopProfiler::leave(m);
+		n++;
+	}
+
+	return n;
+}
+
+// Refer to header for documentation
+void Scheduler::idle()
+{
+	clock_ms_t now = Clock::now();
+	clock_ms_t next = SCHED_IDLE_MAX_MS;
+
+	if (woken)
+		return;
+
+	for (uint8_t i = 0; i < SCHED_WHEEL_SLOTS; i++) {
+		for (sched_task_t *t = wheel[i]; t != NULL; t = t->next) {
+			if (t->deadline <= now)
+				return;
+
+			if (t->deadline - now < next)
+				next = t->deadline - now;
+		}
+	}
+
+	LoopProfiler::idling(next);
+#ifdef ARDUINO
+	esp_delay(next, []() { return !woken; }, SCHED_IDLE_POLL_MS);
+#endif
+}
+
+// Refer to header for documentation
+unsigned long Scheduler::latencyMax()
+{
+	return lat_max;
+}
+
+// Refer to header for documentation
+unsigned long Scheduler::latencyAvg()
+{
+	return lat_avg >> 4;
+}
@@ -41,7 +41,11 @@ StatusLED::StatusLED()
 StatusLED::StatusLED(uint8_t pin, unsigned long blink_interval_ms) : pin(pin)
 {
         log_msg("StatusLED::StatusLED", "Initializing StatusLED on pin " + String(pin));
-        pinMode(pin, OUTPUT);
+
+        chn = LEDEngine::attach(pin);
+        if (chn == -1)
+                log_msg("StatusLED::StatusLED", "No LEDEngine channel left for pin " + String(pin) + "!");
+
         setBlinkInterval(blink_interval_ms);
         mode(OFF);
 }
@@ -50,60 +54,52 @@ StatusLED::StatusLED(uint8_t pin, unsigned long blink_interval_ms) : pin(pin)
 void StatusLED::setBlinkInterval(unsigned long interval)
 {
         blink_interval = interval;
+        LEDEngine::setInterval(chn, interval);
 }
 
 // Refer to header for documentation
-void StatusLED::mode(led_mode m) {
+void StatusLED::mode(led_mode m, uint16_t count, led_callback_t cb, void *arg) {
         switch(m) {
                 case OFF:
                         log_msg("StatusLED(PIN:" + String(pin) + ")::mode", "Setting mode to OFF");
-                        stat = LOW;
+                        LEDEngine::set(chn, LED_LEVEL_OFF);
                         break;
                 case ON:
                         log_msg("StatusLED(PIN:" + String(pin) + ")::mode", "Setting mode to ON");
-                        stat = HIGH;
+                        LEDEngine::set(chn, LED_LEVEL_ON);
                         break;
                 case BLINK: // ON then OFF
                         log_msg("StatusLED(PIN:" + String(pin) + ")::mode", "Setting mode to BLINK");
-                        stat = HIGH;
-                        tstamp = millis() + blink_interval;
+                        LEDEngine::play(chn, LED_PATTERN_BLINK, blink_interval, count, cb, arg);
                         break;
                 case BLINK_INV: // OFF then ON
                         log_msg("StatusLED(PIN:" + String(pin) + ")::mode", "Setting mode to BLINK_INV");
-                        stat = LOW;
-                        tstamp = millis() + blink_interval;
+                        LEDEngine::play(chn, LED_PATTERN_BLINK_INV, blink_interval, count, cb, arg);
                         m = BLINK;
                         break;
                 default:
-                        break;
+                        return;
         }
 
-        digitalWrite(pin, stat);
         mod = m;
-        blks = 0;
 }
 
 // Refer to header for documentation
-StatusLED::led_mode StatusLED::getMode()
+void StatusLED::pattern(const led_pattern_t &p, uint16_t count, led_callback_t cb, void *arg)
 {
-        return mod;
+        log_msg("StatusLED(PIN:" + String(pin) + ")::pattern", "Setting mode to PATTERN");
+        LEDEngine::play(chn, p, blink_interval, count, cb, arg);
+        mod = PATTERN;
 }
 
 // Refer to header for documentation
-void StatusLED::update()
+StatusLED::led_mode StatusLED::getMode()
 {
-        unsigned long t;
-        if (mod == BLINK && (t = millis()) >= tstamp) {
-                stat = !stat;
-                digitalWrite(pin, stat);
-                tstamp = t + blink_interval;
-                if (!stat)
-                        blks++;
-        }
+        return mod;
 }
 
 // Refer to header for documentation
 unsigned int StatusLED::blinks()
 {
-        return blks;
-}
\ No newline at end of file
+        return LEDEngine::repetitions(chn);
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file SyncClock.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief SyncClock class implementation
+ * 
+ * The following file contains the implementation of the SyncClock class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#include <Arduino.h>
+
+#include <config.h>
+#include <log.h>
+
+#include <EspNow.h>
+#include <SyncClock.h>
+
+// Refer to header for documentation
+bool SyncClock::begin(bool master, uint16_t port)
+{
+	if (running)
+		return true;
+
+	if (!EspNow::begin())
+		return false;
+
+	SyncClock::master = master;
+	SyncClock::port = port;
+	beacon_task.prof = PROF_NET;
+
+	EspNow::onFrame(SYNC_MAGIC, &on_frame);
+	listen();
+
+	if (master) {
+		beacon_deadline.in(SYNC_INTERVAL_MS);
+		Scheduler::schedule(&beacon_task, SYNC_INTERVAL_MS, &on_beacon, NULL);
+	}
+
+	running = true;
+	log_msg("SyncClock::begin", master ? "Providing the common time" : "Following the common time");
+
+	return true;
+}
+
+// Refer to header for documentation
+bool SyncClock::listen()
+{
+	if (listening)
+		return true;
+
+	if (!udp.listen(port)) {
+		log_msg("SyncClock::listen", "Failed to listen on UDP port " + String(port) + "!");
+		return false;
+	}
+
+	udp.onPacket(&on_packet, NULL);
+	listening = true;
+
+	return true;
+}
+
+// Refer to header for documentation
+void SyncClock::query(const uint32_t *ips, uint8_t n, uint16_t port)
+{
+	SyncClock::port = port;
+
+	if (!listen())
+		return;
+
+	sync_query_t q = {};
+	q.magic = SYNC_MAGIC;
+	q.type = SYNC_QUERY;
+
+	for (uint8_t i = 0; i < n; i++) {
+		q.t_req = micros();
+		udp.writeTo((const uint8_t *)&q, sizeof(q), IPAddress(ips[i]), port);
+	}
+
+	log_msg("SyncClock::query", "Requested the common time from " + String(n) + " bells");
+}
+
+// Refer to header for documentation
+void SyncClock::on_beacon(void *arg)
+{
+	sync_beacon_t b;
+	b.magic = SYNC_MAGIC;
+	b.type = SYNC_BEACON;
+	b.time_us = now();
+	b.tx_us = min(EspNow::txLatency(), (uint32_t)UINT16_MAX);
+
+	EspNow::broadcast(&b, sizeof(b));
+
+	beacon_deadline.advance(SYNC_INTERVAL_MS);
+	Scheduler::schedule(&beacon_task, beacon_deadline.remaining(), &on_beacon, NULL);
+}
+
+// Refer to header for documentation
+void SyncClock::on_frame(const uint8_t *mac, const uint8_t *data, uint8_t len)
+{
+	uint64_t local = Clock::nowUs();
+
+	if (len < 2)
+		return;
+
+	switch (data[1]) {
+		case SYNC_BEACON: {
+			sync_beacon_t b;
+
+			if (master || len != sizeof(b))
+				return;
+
+			memcpy(&b, data, sizeof(b));
+
+			if (have_time && valid.expired())
+				log_msg("SyncClock::on_frame", "Resynced after missing beacons");
+
+			// The beacon reaches all bells at virtually the same instant,
+			// so its time, as of the end of the transmission, is taken over
+			uint64_t sent = b.time_us + b.tx_us;
+
+			if (have_time && !valid.expired())
+				stat.offset_us = (int64_t)(local + offset - sent);
+
+			offset = (int64_t)(sent - local);
+			have_time = true;
+			valid.in(SYNC_VALID_MS);
+			break;
+		}
+
+		case SYNC_REPORT: {
+			sync_report_t r;
+
+			if (len != sizeof(r))
+				return;
+
+			memcpy(&r, data, sizeof(r));
+
+			// Clock of the reporting bell minus ours, as of the end of the transmission
+			int32_t peer_us = r.time_us + r.tx_us - (uint32_t)(local + offset);
+			record(r.start_at, r.err_us - peer_us, peer_us);
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+// Refer to header for documentation
+void SyncClock::on_packet(void *arg, AsyncUDPPacket &packet)
+{
+	sync_query_t q;
+	uint32_t t_ans = micros();
+
+	if (packet.length() != sizeof(q))
+		return;
+
+	memcpy(&q, packet.data(), sizeof(q));
+
+	if (q.magic != SYNC_MAGIC)
+		return;
+
+	// Bell: answer requests of the door, if we know the time
+	if (q.type == SYNC_QUERY && running && synced()) {
+		q.type = SYNC_ANSWER;
+		q.time_us = now();
+		packet.write((const uint8_t *)&q, sizeof(q));
+		return;
+	}
+
+	// Door: take over the first answer
+	if (q.type == SYNC_ANSWER && !running && !synced()) {
+		rtt_us = t_ans - q.t_req;
+		offset = (int64_t)(q.time_us + rtt_us / 2) - (int64_t)Clock::nowUs();
+		have_time = true;
+		valid.in(SYNC_VALID_MS);
+
+		log_msg("SyncClock::on_packet", "Common time received from " + packet.remoteIP().toString() +
+			" (RTT: " + String(rtt_us) + "us)");
+
+		Scheduler::wake();
+	}
+}
+
+// Refer to header for documentation
+bool SyncClock::synced()
+{
+	return master || (have_time && !valid.expired());
+}
+
+// Refer to header for documentation
+uint64_t SyncClock::now()
+{
+	return Clock::nowUs() + offset;
+}
+
+// Refer to header for documentation
+uint32_t SyncClock::common(unsigned long local_us)
+{
+	// micros() are the lower 32 bits of Clock::nowUs()
+	return (uint32_t)local_us + (uint32_t)offset;
+}
+
+// Refer to header for documentation
+void SyncClock::report(uint32_t start_at, int32_t err_us)
+{
+	sync_report_t r;
+	r.magic = SYNC_MAGIC;
+	r.type = SYNC_REPORT;
+	r.start_at = start_at;
+	r.err_us = err_us;
+	r.time_us = now();
+	r.tx_us = min(EspNow::txLatency(), (uint32_t)UINT16_MAX);
+
+	EspNow::broadcast(&r, sizeof(r));
+	record(start_at, err_us, 0);
+}
+
+// Refer to header for documentation
+void SyncClock::record(uint32_t start_at, int32_t err_us, int32_t peer_us)
+{
+	uint32_t peer = peer_us < 0 ? -peer_us : peer_us;
+
+	if (skew_n == 0 || start_at != skew_start_at) {
+		skew_start_at = start_at;
+		skew_min = err_us;
+		skew_max = err_us;
+		skew_n = 1;
+		stat.skew_us = 0;
+		stat.peer_us = peer;
+		return;
+	}
+
+	if (err_us < skew_min)
+		skew_min = err_us;
+	if (err_us > skew_max)
+		skew_max = err_us;
+	if (skew_n < UINT8_MAX)
+		skew_n++;
+	if (peer > stat.peer_us)
+		stat.peer_us = peer;
+
+	stat.skew_us = skew_max - skew_min;
+	if (stat.skew_us > stat.skew_peak_us)
+		stat.skew_peak_us = stat.skew_us;
+}
+
+// Refer to header for documentation
+uint32_t SyncClock::skew(uint8_t *n)
+{
+	if (n != NULL)
+		*n = skew_n;
+
+	return stat.skew_us;
+}
+
+// Refer to header for documentation
+uint32_t SyncClock::skewPeak()
+{
+	return stat.skew_peak_us;
+}
+
+// Refer to header for documentation
+uint32_t SyncClock::rtt()
+{
+	return rtt_us;
+}
+
+// Refer to header for documentation
+const sync_stats_t &SyncClock::stats()
+{
+	return stat;
+}
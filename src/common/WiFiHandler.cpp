@@ -46,6 +46,23 @@ WiFiHandler::WiFiHandler(const String ssid, const String psk,
 {
 	log_msg("WiFiHandler::WiFiHandler", "Initializing WiFiHandler");
 	stat = DISCONNECTED;
+	task.prof = PROF_WIFI;
+}
+
+// Refer to header for documentation
+void WiFiHandler::register_events()
+{
+	// The handlers capture this object, so they can only be registered
+	// once the WiFiHandler has been assigned to its final location
+	if (got_ip_handler)
+		return;
+
+	connected_handler = WiFi.onStationModeConnected(
+		[this](const WiFiEventStationModeConnected &evt) { on_connected(evt); });
+	got_ip_handler = WiFi.onStationModeGotIP(
+		[this](const WiFiEventStationModeGotIP &evt) { on_got_ip(evt); });
+	disconnected_handler = WiFi.onStationModeDisconnected(
+		[this](const WiFiEventStationModeDisconnected &evt) { on_disconnected(evt); });
 }
 
 // Refer to header for documentation
@@ -63,45 +80,127 @@ void WiFiHandler::_connect()
 
 	log_msg("WiFiHandler::_connect", "Attempting to connect to: " + ssid);
 
-	WiFi.begin(ssid, psk);
-	WiFi.config(ip, gateway, subnet);
+	register_events();
+
+	// The listen interval is negotiated during association,
+	// so the sleep mode must be set before connecting
+	if (sleep_set && !WiFi.setSleepMode(sleep_type, listen_interval))
+		log_msg("WiFiHandler::_connect", "Failed to set sleep mode!");
 
 	stat = CONNECTING;
+	ip_mismatch = false;
+
+	WiFi.begin(ssid, psk, channel);
+	WiFi.config(ip, gateway, subnet);
 }
 
 // Refer to header for documentation
-void WiFiHandler::connect()
+void WiFiHandler::on_connected(const WiFiEventStationModeConnected &evt)
 {
-	_connect();
-	if (timeout_ms > 0) {
-		timeout_tstamp = millis() + timeout_ms;
-	}
+	log_msg("WiFiHandler::on_connected", "Associated with: " + ssid + 
+		" (channel: " + String(evt.channel) + ")");
 }
 
 // Refer to header for documentation
-void WiFiHandler::unexpected_disconnect()
+void WiFiHandler::on_got_ip(const WiFiEventStationModeGotIP &evt)
 {
-	if (!rejoin) {
-		// If rejoin isn't enabled, treat as intentional disconnect
-		disconnect();
+	if (stat == UNINITIALIZED || stat == CONNECTED)
+		return;
+
+	if (evt.ip != ip) {
+		log_msg("WiFiHandler::on_got_ip", "IP address mismatch, attempting to reconnect");
+
+		// Requires a "hard" reconnect, which mustn't be done
+		// from within a WiFi event
+		ip_mismatch = true;
+		Scheduler::schedule(&task, 0, &on_task, this);
+		Scheduler::wake();
 		return;
 	}
 
-	// The ESP8266WiFiClass will automatically reconnect
-	// if WiFi.disconnect() has not been called
+	if (stat == DISCONNECTED) {
+		log_msg("WiFiHandler::on_got_ip", "Re-established connection to: " + ssid);
+		n_reconnects++;
+	} else {
+		log_msg("WiFiHandler::on_got_ip", "Connected to: " + ssid);
+	}
+
+	log_msg("WiFiHandler::on_got_ip", "IP: " + evt.ip.toString());
+
+	stat = CONNECTED;
+	Scheduler::cancel(&task); // Connection timeout no longer applies
+	Scheduler::wake();
+}
+
+// Refer to header for documentation
+void WiFiHandler::on_disconnected(const WiFiEventStationModeDisconnected &evt)
+{
+	// Failed association attempts while connecting are
+	// reported as disconnects too, those are covered by
+	// the connection timeout.
+	if (stat == CONNECTING && n_retries < UINT8_MAX)
+		n_retries++;
+
+	if (stat != CONNECTED)
+		return;
+
+	log_msg("WiFiHandler::on_disconnected", "Lost connection to: " + ssid +
+		" (reason: " + String(evt.reason) + ")");
 
 	stat = DISCONNECTED;
-	
-	log_msg("WiFiHandler::unexpected_disconnect", "Attempting to reconnect to: " + ssid);
+
+	// Without rejoin, WiFi must be disconnected "properly",
+	// which mustn't be done from within a WiFi event
+	if (!rejoin)
+		Scheduler::schedule(&task, 0, &on_task, this);
+	else
+		log_msg("WiFiHandler::on_disconnected", "Attempting to reconnect to: " + ssid);
+
+	Scheduler::wake();
+}
+
+// Refer to header for documentation
+void WiFiHandler::on_task(void *arg)
+{
+	((WiFiHandler *)arg)->update();
+}
+
+// Refer to header for documentation
+void WiFiHandler::connect()
+{
+	n_retries = 0;
+	_connect();
+	if (timeout_ms > 0) {
+		timeout_deadline.in(timeout_ms);
+		Scheduler::schedule(&task, timeout_ms, &on_task, this);
+	}
+}
+
+// Refer to header for documentation
+void WiFiHandler::setSleepMode(WiFiSleepType_t type, uint8_t listen_interval)
+{
+	sleep_set = true;
+	sleep_type = type;
+	this->listen_interval = listen_interval;
+}
+
+// Refer to header for documentation
+void WiFiHandler::setChannel(int32_t channel)
+{
+	this->channel = channel;
 }
 
 // Refer to header for documentation
 void WiFiHandler::disconnect()
 {
+	// Set first, so the disconnect event isn't
+	// mistaken for an unexpected disconnect
+	stat = DISCONNECTED;
+
 	// disconnect() method of WiFi class will ensure
 	// it no longer attempt to automatically re-connect
 	WiFi.disconnect();
-	stat = DISCONNECTED;
+	Scheduler::cancel(&task);
 
 	log_msg("WiFiHandler::disconnect", "Disconnected from: " + ssid);
 }
@@ -112,50 +211,40 @@ bool WiFiHandler::timeout()
 	if (timeout_ms == NO_TIMEOUT)
 		return false;
 
-	return millis() >= timeout_tstamp;
+	return timeout_deadline.expired();
 }
 
 // Refer to header for documentation
 void WiFiHandler::update()
 {
+	if (ip_mismatch) {
+		// Requires "hard" reconnect
+		disconnect();
+		_connect();
+
+		// The timeout of the original attempt still applies
+		if (timeout_ms > 0)
+			Scheduler::schedule(&task, timeout_deadline.remaining(), &on_task, this);
+
+		return;
+	}
+
 	switch(stat) {
 		case CONNECTING: {
-			if (WiFi.status() == WL_CONNECTED) {
-				log_msg("WiFiHandler::update", "Connected to: " + ssid);
-
-				if (WiFi.localIP() != ip) {
-					log_msg("WiFiHandler::update", "IP address mismatch, attempting to reconnect");
-					
-					// Requires "hard" reconnect
-					disconnect();
-					_connect();
-				}
-
-				log_msg("WiFiHandler::update", "IP: " + WiFi.localIP().toString());
-				stat = CONNECTED;
-			}
-			else if (timeout()) {
+			if (timeout()) {
 				log_msg("WiFiHandler::update", "Timeout after " + String(timeout_ms) + "ms!");
 				log_msg("WiFiHandler::update", "Failed to establish a successful connection to: " + ssid);
 				disconnect();
 			}
 			break;
 		}
-		
-		case CONNECTED: {
-			if (WiFi.status() != WL_CONNECTED) {
-				log_msg("WiFiHandler::update", "Lost connection to: " + ssid);
-				unexpected_disconnect();
-			}
+
+		case DISCONNECTED: {
+			// If rejoin isn't enabled, treat as intentional disconnect
+			if (!rejoin)
+				disconnect();
 			break;
 		}
-		
-		case DISCONNECTED:
-			if (WiFi.status() == WL_CONNECTED) {
-				log_msg("WiFiHandler::update", "Re-established connection to: " + ssid);
-				stat = CONNECTED;
-			}
-			break;
 			
 		default: {
 			break;
@@ -163,8 +252,20 @@ void WiFiHandler::update()
 	}
 }
 
+// Refer to header for documentation
+uint8_t WiFiHandler::retries()
+{
+	return n_retries;
+}
+
+// Refer to header for documentation
+uint32_t WiFiHandler::reconnects()
+{
+	return n_reconnects;
+}
+
 // Refer to header for documentation
 WiFiHandler::wifi_stat WiFiHandler::status()
 {
 	return stat;
-}
\ No newline at end of file
+}
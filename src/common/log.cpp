@@ -26,10 +26,14 @@
  * For more information, see the header file.
  * 
  */
+#include <Clock.h>
+#include <LoopProfiler.h>
 #include <log.h>
 
 // Refer to header for documentation
 void log_msg(String category, String message)
 {
-        Serial.println("[" + String(millis())+ "]\t\t" + category + ": " + message);
+	uint32_t t = micros();
+        Serial.println("[" + String(Clock::now())+ "]\t\t" + category + ": " + message);
+	LoopProfiler::logged(micros() - t);
 }
\ No newline at end of file
@@ -48,13 +48,102 @@
 // TCP
 #define TCP_PORT 8888
 
+// Loop profiler (See LoopProfiler.h)
+#define LOOP_STALL_MS 250 // Main loop iterations taking longer trip the stall watchdog
+
+// Heap monitor (See HeapMonitor.h)
+#define HEAP_SAMPLE_MS 1000
+#define HEAP_FRAG_ALERT 50 // %, fragmentation above which an alert is logged
+#define HEAP_MIN_BLOCK 4096 // Bytes, bells reboot between rings if the largest free block falls below
+
+// GPIO tracing (Optional, See trace.h)
+// Toggles spare GPIOs at trace points of the ring path, for timing with a logic
+// analyzer. Points may share a pin, unmapped points are compiled out. Only GPIO0-15
+// are supported, and the pins mustn't collide with the pins configured below.
+// #define USE_TRACE
+
+#ifdef USE_TRACE
+// Door
+#define TRACE_PIN_DOOR_BOOT D5 // Power latch -> WiFi started
+#define TRACE_PIN_DOOR_WIFI D6 // WiFi started -> IP assigned
+#define TRACE_PIN_RING_TX D7 // Connects -> first ring message sent or failed (shared by all bells)
+
+// Bell
+#define TRACE_PIN_RING_RX D5 // Ring message handled
+#define TRACE_PIN_BELL_RING D6 // Ring -> ring tone done
+#define TRACE_PIN_BUZZER_NOTE D7 // Pulse on the first note
+#endif
+
+// Event tracing (Optional, See EventTrace.h)
+// Records state transitions, connects, ring messages, notes and LED edges into a RAM
+// ring buffer. The door prints the trace over serial before powering off, which delays
+// the power off by about half a second. Bells serve it under /trace on the metrics port.
+// Convert the dumps with tools/evtrace2chrome.py.
+// #define USE_EVENT_TRACE
+#define EVENT_TRACE_LEN 256 // Events kept, 8 bytes each
+
+// Bell discovery (See BellBeacon.h and BellDirectory.h)
+#define DISCOVERY_PORT 8889 // UDP
+
+// Bell hosted access point for the door (Optional)
+// If enabled, the door doesn't join WIFI_SSID, but a hidden access point hosted
+// by the primary bell, which relays rings to the other bells over WIFI_SSID.
+// As the ESP8266 only has a single radio, the access point runs on the channel
+// of WIFI_SSID, which must therefore be fixed and match BELL_AP_CHANNEL.
+// #define USE_BELL_AP
+
+#ifdef USE_BELL_AP
+#define BELL_AP_SSID "TUDODoorbell"
+#define BELL_AP_PSK "SECRET"
+#define BELL_AP_CHANNEL 6 // Channel of WIFI_SSID
+#define BELL_AP_DOOR_IP "192.168.4.20"
+#define BELL_AP_IP "192.168.4.21" // IP of the primary bell on the access point, must follow BELL_AP_DOOR_IP
+#define BELL_AP_PRIMARY_IP "192.168.0.21" // BELL_IP of the primary bell
+#define BELL_AP_N_BELLS 3 // Bells on WIFI_SSID following DOOR_IP, including the primary bell, only used until bells have been discovered
+#define BELL_AP_RELAY_TIMEOUT_MS 2000
+
+// Pre-ring (Optional, See PreRing.h)
+// The primary bell starts ringing as soon as the door probes for or joins its
+// access point, the ring message then only confirms the ring. If no ring message
+// follows within BELL_PRERING_WINDOW_MS, the ring is cancelled.
+// #define BELL_PRERING
+#define BELL_PRERING_DOOR_MAC "AA:BB:CC:DD:EE:FF" // Station MAC of the door
+#define BELL_PRERING_WINDOW_MS 3000
+#endif
+
+// ESP-NOW relay mesh (Optional, See MeshRing.h)
+// The door additionally broadcasts its rings over ESP-NOW, which bells forward
+// to bells out of reach of the door or the access point. Bells then keep their
+// radio awake, as ESP-NOW frames aren't buffered for sleeping stations.
+// #define USE_MESH
+
+#define MESH_DOOR_MAC "AA:BB:CC:DD:EE:FF" // Station MAC of the door, bells drop rings of any other origin
+#define MESH_MAX_HOPS 3
+#define MESH_FORWARD_JITTER_MS 8 // Random delay before forwarding, avoids collisions between relays
+#define MESH_DUP_CACHE_LEN 16 // Rings remembered for duplicate suppression
+#define MESH_DEDUP_WINDOW_MS 3000 // Rings of the same press received over TCP and ESP-NOW within this window are merged
+
+// Synchronised ring tone start (Optional, See SyncClock.h)
+// Bells keep a common time through ESP-NOW beacons of a master bell, and the door
+// schedules the start of the ring tone SYNC_START_MARGIN_MS ahead, so all bells
+// start together. As with the mesh, bells then keep their radio awake.
+// #define USE_SYNC
+
+#define SYNC_PORT 8890 // UDP, time requests of the door
+#define SYNC_MASTER_IP "192.168.0.21" // BELL_IP of the bell providing the common time
+#define SYNC_INTERVAL_MS 5000 // Beacon interval of the master
+#define SYNC_VALID_MS 20000 // Bells consider themselves synced this long after the last beacon
+#define SYNC_START_MARGIN_MS 150 // Must cover the delivery of the ring message to all bells
+#define SYNC_QUERY_TIMEOUT_MS 50 // Door: ring unscheduled if the common time isn't received in time
+#define SYNC_MAX_WAIT_MS 1000 // Bell: start times further ahead are considered bogus
+
 /////////////////////////////////////
 // DOOR SPECIFIC CONFIGURATION
 /////////////////////////////////////
 
 #ifdef TARGET_DEV_DOOR
 
-#define DOOR_N_BELLS 1
+#define DOOR_N_BELLS 1 // Bells following DOOR_IP, only used until bells have been discovered
 
 #if DOOR_N_BELLS > 9
 #error DOOR_N_BELLS must be less than 10!
@@ -71,7 +160,32 @@
 
 // Timeouts
 #define DOOR_CONNECT_TIMEOUT_S 20
-#define DOOR_BELL_TCP_TIMEOUT_MS 10000
+#define DOOR_BELL_TCP_TIMEOUT_MS 10000 // Upper bound, per bell timeouts are learned (See BellHistory.h)
+#define DOOR_BELL_TIMEOUT_MARGIN_MS 200 // Added to the learned latency of a bell
+#define DOOR_BELL_TIMEOUT_MIN_MS 500
+#define DOOR_BELL_FAILED_TIMEOUT_MS 1000 // Budget for bells that failed on their last ring
+#define DOOR_BELL_RELEARN_FAILS 8 // Grant the full timeout again after this many consecutive failures
+
+// Bell directory (See BellDirectory.h)
+// Until the first bell has been discovered, bells are expected to follow DOOR_IP
+#define DOOR_DISCOVERY_WINDOW_MS 500 // Time to collect beacons after a ring, covers bells in modem sleep
+#define DOOR_DISCOVERY_INTERVAL 8 // Refresh the directory every this many presses, or if a bell failed
+#define DOOR_DISCOVERY_MAX_MISSES 4 // Drop bells that haven't answered this many refreshes
+
+// RF calibration on boot (See RFCal.h)
+// Powerup option used if the stored calibration data is trusted:
+// 	1	Calibrate TX power and VDD33 only (~18ms)
+// 	2	Calibrate VDD33 only (~2ms)
+#define DOOR_RF_CAL_OPTION 2
+#define DOOR_RF_CAL_MAX_BOOTS 64 // Force a full calibration after this many boots
+
+// TX power & PHY mode selection (See LinkTuner.h)
+#define DOOR_LINK_STEP_DOWN_AFTER 4 // Clean presses before trying a lower level
+#define DOOR_LINK_STEP_DOWN_RSSI -70 // dBm, never step down if the RSSI is below this
+
+// Ring message sent on button press (See ring_msg.h)
+// RING_MSG, RING_MSG_URGENT or RING_MSG_TEST
+#define DOOR_RING_MSG RING_MSG
 
 #define DOOR_NO_BELLS_BLINKS 3
 #define DOOR_PARTIAL_SUCCESS_BLINKS 3
@@ -106,8 +220,56 @@
 #define BELL_MELODY DEFAULT_CHIME
 #endif
 
+// Melodies of the urgent and maintenance test ring classes (See ring_msg.h)
+#define BELL_URGENT_MELODY URGENT_CHIME
+#define BELL_TEST_MELODY TEST_CHIME
+
+// Handling of repeated rings of the same class while ringing (See Buzzer.h)
+// COALESCE_DROP, COALESCE_RESTART or COALESCE_QUEUE
+#define BELL_RING_COALESCE Buzzer::COALESCE_DROP
+
+// Recorded chime (See SamplePlayer.h)
+// Raw unsigned 8-bit mono PCM, uploaded to LittleFS via "Upload Filesystem Image".
+// If the file is missing, BELL_MELODY is played instead.
+#define BELL_SAMPLE_FILE "/chime.raw"
+#define BELL_SAMPLE_RATE 8000 // Hz
+#define BELL_SAMPLE_BUF_LEN 512 // Bytes per buffer, two buffers are used
+
+// Idle mode
+// Trades idle current against the latency of incoming rings:
+// 	WIFI_NONE_SLEEP		Always awake, rings are received right away
+// 	WIFI_MODEM_SLEEP	Radio sleeps between beacons
+// 	WIFI_LIGHT_SLEEP	Radio and CPU sleep between beacons (lowest idle current)
+// In the sleep modes, rings may be delayed by up to BELL_LISTEN_INTERVAL
+// beacon intervals (~102ms each). 0 uses the DTIM interval of the AP.
+#define BELL_SLEEP_MODE WIFI_MODEM_SLEEP
+#define BELL_LISTEN_INTERVAL 0
+
+// Prometheus style metrics, served at http://<BELL_IP>:<BELL_METRICS_PORT>/metrics
+// (See MetricsServer.h). 0 disables the endpoint. Latencies are served as p50/p95/p99
+// summaries (See QuantileSketch.h).
+#define BELL_METRICS_PORT 9100
+
+// Static allocation (Optional)
+// Places the RingReceiver and the TCP servers in static storage, and keeps the
+// melodies in place rather than copying them to the heap, so only short-lived
+// objects remain on the heap.
+// #define BELL_STATIC_ALLOC
+
 // Indicators/Error messages
 #define BELL_LED_BLINK_INTERVAL NOTE_DURATION //ms
 #define BELL_LED_CONNECTING_BLINK_INTERVAL 1000 //ms
 
-#endif // TARGET_DEV_BELL
\ No newline at end of file
+#endif // TARGET_DEV_BELL
+
+/////////////////////////////////////
+// BENCHMARK SPECIFIC CONFIGURATION
+/////////////////////////////////////
+
+// Built on top of the bell configuration (See Main_Bench.cpp and Bench.h)
+#ifdef TARGET_DEV_BENCH
+
+#define BENCH_ITERATIONS 200 // Calls per benchmark, capped at BENCH_MAX_ITERATIONS
+#define BENCH_WARMUP_STEPS 4 // Bell::run() steps before benchmarking
+
+#endif // TARGET_DEV_BENCH
\ No newline at end of file
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file BellDirectory.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief BellDirectory class implementation
+ * 
+ * The following file contains the implementation of the BellDirectory class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#ifdef TARGET_DEV_DOOR
+
+#include <config.h>
+#include <log.h>
+#include <discovery_msg.h>
+
+#include <door/BellDirectory.h>
+#include <door/DoorStore.h>
+
+// Refer to header for documentation
+BellDirectory::BellDirectory()
+{
+}
+
+// Refer to header for documentation
+BellDirectory::BellDirectory(uint16_t port) : port(port)
+{
+	log_msg("BellDirectory::BellDirectory", "Initializing BellDirectory");
+	task.prof = PROF_NET;
+}
+
+// Refer to header for documentation
+void BellDirectory::seed(IPAddress door_ip, uint16_t ring_port, uint8_t n_bells)
+{
+	door_record_t &rec = DoorStore::record();
+
+	if (rec.n_bells > 0)
+		return;
+
+	log_msg("BellDirectory::seed", "Directory empty, assuming " + String(n_bells) + " bells following the door");
+
+	for (uint8_t i = 0; i < n_bells && i < DOOR_STORE_MAX_BELLS; i++) {
+		IPAddress ip = door_ip;
+		ip[3] = door_ip[3] + 1 + i;
+
+		memset(&rec.bells[i], 0, sizeof(bell_entry_t));
+		rec.bells[i].ip = (uint32_t)ip;
+		rec.bells[i].port = ring_port;
+		rec.n_bells++;
+	}
+
+	// Replace the assumed bells with the actual ones right away
+	rec.presses_since_refresh = DOOR_DISCOVERY_INTERVAL;
+}
+
+// Refer to header for documentation
+void BellDirectory::refresh(bool force)
+{
+	door_record_t &rec = DoorStore::record();
+
+	if (rec.presses_since_refresh < UINT8_MAX)
+		rec.presses_since_refresh++;
+
+	if (!force && rec.presses_since_refresh < DOOR_DISCOVERY_INTERVAL)
+		return;
+
+	if (!listening) {
+		if (!udp.listen(port)) {
+			log_msg("BellDirectory::refresh", "Failed to listen on UDP port " + String(port) + "!");
+			return;
+		}
+
+		udp.onPacket(&on_packet, this);
+		listening = true;
+	}
+
+	discovery_msg_t msg = { DISCOVERY_MAGIC, DISCOVERY_QUERY, 0 };
+
+	n_found = 0;
+	active = true;
+
+	if (udp.broadcastTo((uint8_t *)&msg, sizeof(msg), port) == 0) {
+		log_msg("BellDirectory::refresh", "Failed to broadcast discovery query!");
+		active = false;
+		return;
+	}
+
+	log_msg("BellDirectory::refresh", "Discovery query sent, collecting beacons");
+	Scheduler::schedule(&task, DOOR_DISCOVERY_WINDOW_MS, &on_task, this);
+}
+
+// Refer to header for documentation
+bool BellDirectory::refreshing()
+{
+	return active;
+}
+
+// Refer to header for documentation
+void BellDirectory::on_packet(void *arg, AsyncUDPPacket &packet)
+{
+	BellDirectory *d = (BellDirectory *)arg;
+
+	if (!d->active || !discovery_msg_valid(packet.data(), packet.length(), DISCOVERY_BEACON))
+		return;
+
+	uint32_t ip = (uint32_t)packet.remoteIP();
+
+	for (uint8_t i = 0; i < d->n_found; i++) {
+		if (d->found_ip[i] == ip)
+			return;
+	}
+
+	if (d->n_found == DOOR_STORE_MAX_BELLS)
+		return;
+
+	d->found_ip[d->n_found] = ip;
+	d->found_port[d->n_found] = ((discovery_msg_t *)packet.data())->port;
+	d->n_found++;
+}
+
+// Refer to header for documentation
+void BellDirectory::on_task(void *arg)
+{
+	BellDirectory *d = (BellDirectory *)arg;
+
+	d->active = false;
+	d->merge();
+}
+
+// Refer to header for documentation
+void BellDirectory::merge()
+{
+	door_record_t &rec = DoorStore::record();
+	bool known[DOOR_STORE_MAX_BELLS] = { false };
+
+	rec.presses_since_refresh = 0;
+
+	if (n_found == 0) {
+		log_msg("BellDirectory::merge", "No bells answered, keeping directory");
+		return;
+	}
+
+	// Update known bells
+	for (uint8_t i = 0; i < rec.n_bells; i++) {
+		bell_entry_t &e = rec.bells[i];
+		uint8_t j;
+
+		for (j = 0; j < n_found; j++) {
+			if (found_ip[j] == e.ip)
+				break;
+		}
+
+		if (j < n_found) {
+			known[j] = true;
+			e.port = found_port[j];
+			e.missed = 0;
+		} else if (e.missed < UINT8_MAX) {
+			e.missed++;
+		}
+	}
+
+	// Drop bells that have been missing for too long
+	uint8_t n = 0;
+	for (uint8_t i = 0; i < rec.n_bells; i++) {
+		if (rec.bells[i].missed >= DOOR_DISCOVERY_MAX_MISSES) {
+			log_msg("BellDirectory::merge", "Dropping bell " + IPAddress(rec.bells[i].ip).toString());
+			continue;
+		}
+
+		rec.bells[n++] = rec.bells[i];
+	}
+	rec.n_bells = n;
+
+	// Add new bells
+	for (uint8_t j = 0; j < n_found; j++) {
+		if (known[j])
+			continue;
+
+		if (rec.n_bells == DOOR_STORE_MAX_BELLS) {
+			log_msg("BellDirectory::merge", "Directory full, ignoring bell " + IPAddress(found_ip[j]).toString());
+			continue;
+		}
+
+		bell_entry_t &e = rec.bells[rec.n_bells++];
+		memset(&e, 0, sizeof(bell_entry_t));
+		e.ip = found_ip[j];
+		e.port = found_port[j];
+
+		log_msg("BellDirectory::merge", "Discovered bell " + IPAddress(e.ip).toString() + ":" + String(e.port));
+	}
+
+	log_msg("BellDirectory::merge", String(n_found) + " bells answered, " + String(rec.n_bells) + " bells in directory");
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file BellHistory.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief BellHistory class implementation
+ * 
+ * The following file contains the implementation of the BellHistory class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#ifdef TARGET_DEV_DOOR
+
+#include <config.h>
+
+#include <door/BellHistory.h>
+
+// Refer to header for documentation
+unsigned long BellHistory::timeout(const bell_hist_t &h, unsigned long max_ms)
+{
+	unsigned long t;
+
+	// Nothing learned yet, or time to re-learn
+	if (h.samples == 0 || h.fails == DOOR_BELL_RELEARN_FAILS)
+		return max_ms;
+
+	t = (unsigned long)h.srtt + 4 * (unsigned long)h.rttvar;
+	if (h.max > t)
+		t = h.max;
+
+	t += DOOR_BELL_TIMEOUT_MARGIN_MS;
+
+	if (t < DOOR_BELL_TIMEOUT_MIN_MS)
+		t = DOOR_BELL_TIMEOUT_MIN_MS;
+
+	// Likely powered off, try optimistically
+	if (h.fails > 0 && t > DOOR_BELL_FAILED_TIMEOUT_MS)
+		t = DOOR_BELL_FAILED_TIMEOUT_MS;
+
+	return t < max_ms ? t : max_ms;
+}
+
+// Refer to header for documentation
+void BellHistory::success(bell_hist_t &h, unsigned long lat_ms)
+{
+	long lat = lat_ms > UINT16_MAX ? UINT16_MAX : lat_ms;
+
+	if (h.samples == 0) {
+		h.srtt = lat;
+		h.rttvar = lat / 2;
+		h.max = lat;
+	} else {
+		long err = lat - (long)h.srtt;
+
+		// Gains of 1/8 and 1/4, as for the TCP retransmission timeout
+		h.srtt += err / 8;
+		h.rttvar += ((err < 0 ? -err : err) - (long)h.rttvar) / 4;
+
+		// Let old outliers fade out
+		h.max -= h.max / 16;
+		if (lat > h.max)
+			h.max = lat;
+	}
+
+	if (h.samples < UINT8_MAX)
+		h.samples++;
+
+	h.fails = 0;
+}
+
+// Refer to header for documentation
+void BellHistory::fail(bell_hist_t &h)
+{
+	h.fails = h.fails % DOOR_BELL_RELEARN_FAILS + 1;
+}
+
+#endif
@@ -32,17 +32,43 @@
 #include <config.h>
 
 #include <log.h>
+#include <EventTrace.h>
+#include <LoopProfiler.h>
+#include <MeshRing.h>
 #include <StatusLED.h>
+#include <Scheduler.h>
+#include <SyncClock.h>
+#include <trace.h>
 
 #include <door/Door.h>
+#include <door/DoorStore.h>
+#include <door/LinkTuner.h>
+#include <door/RFCal.h>
 #include <door/fallback_error.h>
 #include <door/power_latch.h>
 
+// State table, transitions are handled through the return values of the state functions
+constexpr Door::door_sm_t::state_t Door::states[] = {
+	{ INIT,			&Door::init,		NULL,	NULL,	"INIT",			SM_TO(CONNECTING) },
+	{ CONNECTING,		&Door::connecting,	NULL,	NULL,	"CONNECTING",		SM_TO(CONNECTED) | SM_TO(ERROR) },
+	{ CONNECTED,		&Door::connected,	NULL,	NULL,	"CONNECTED",		SM_TO(SYNCING) | SM_TO(RINGING) },
+	{ SYNCING,		&Door::syncing,		NULL,	NULL,	"SYNCING",		SM_TO(RINGING) },
+	{ RINGING,		&Door::ringing,		NULL,	NULL,	"RINGING",		SM_TO(REFRESHING) | SM_TO(ERROR) },
+	{ ERROR,		&Door::error,		NULL,	NULL,	"ERROR",		SM_TO(ERROR_HANDLING) },
+	{ ERROR_HANDLING,	&Door::error_handling,	NULL,	NULL,	"ERROR_HANDLING",	SM_TO(REFRESHING) },
+	{ REFRESHING,		&Door::refreshing,	NULL,	NULL,	"REFRESHING",		SM_TO(POWER_OFF) },
+	{ POWER_OFF,		&Door::power_off,	NULL,	NULL,	"POWER_OFF",		SM_TO(POWERED_OFF) },
+	{ POWERED_OFF,		NULL,			NULL,	NULL,	"POWERED_OFF",		0 },
+};
+
 // Refer to header for documentation
 Door::Door()
 {
+	static_assert(door_sm_t::ordered(states), "Door state table must follow the order of door_state");
+
 	err = UNINITIALIZED;
-	state = ERROR;
+	err_shown = false;
+	sm = door_sm_t(states, ERROR);
 }
 
 // Refer to header for documentation
@@ -50,6 +76,12 @@ Door::Door(DoorCFG door_cfg) : cfg(door_cfg)
 {	
 	log_msg("Door::Door", "Initializing door");
 
+	// Before anything can fail
+	CrashLog::begin(&on_crash);
+
+	err_shown = false;
+	sync_task.prof = PROF_MAIN;
+
 	if (!cfg.checkValidity()) {
 		if (cfg.ring_led_pin == -1 ||
 		    cfg.power_led_pin == -1) {
@@ -58,7 +90,7 @@ Door::Door(DoorCFG door_cfg) : cfg(door_cfg)
 		}
 
 		err = CFG_INVALID;
-		state = ERROR;
+		sm = door_sm_t(states, ERROR);
 		return;
 	}
 
@@ -75,10 +107,31 @@ Door::Door(DoorCFG door_cfg) : cfg(door_cfg)
 		ip, gateway, subnet,
 		cfg.con_timeout_s, false
 	);
+	wifi_handler.setChannel(cfg.wifi_channel);
 	
-	ring_sender = RingSender(ip, cfg.port, cfg.n_bells, cfg.bell_timeout_ms);
+	// The directory is seeded before the RingSender is built from it
+	directory = BellDirectory(cfg.discovery_port);
+	BellDirectory::seed(ip, cfg.port, cfg.n_bells);
+
+	ring_sender = RingSender(cfg.bell_timeout_ms, cfg.ring_msg);
+
+	door_record_t &rec = DoorStore::record();
+	if (rec.crash_pending) {
+		log_msg("Door::Door", "Reporting last crash to the bells: " + CrashLog::describe(rec.crash));
+		ring_sender.addTLV(RING_TLV_CRASH, &rec.crash, sizeof(rec.crash));
+	}
+
+	sm = door_sm_t(states, INIT);
+}
+
+// Refer to header for documentation
+void Door::on_crash(const crash_record_t &rec)
+{
+	door_record_t &r = DoorStore::record();
 
-	state = INIT;
+	r.crash = rec;
+	r.crash_pending = true;
+	DoorStore::save();
 }
 
 // Refer to header for documentation
@@ -109,8 +162,20 @@ void Door::bootMSG()
 Door::door_state Door::init()
 {
 	bootMSG();
+	LoopProfiler::begin(LOOP_STALL_MS);
+	EventTrace::begin("door", N_DOOR_STATES, [](uint8_t s, void *arg) { return states[s].name; }, NULL);
+	EVT(EVT_STATE, INIT, 0);
+
+	trace.id = ESP.random();
+	trace.boot_ms = Clock::now();
+	log_msg("Door::init", "Trace ID: " + String(trace.id, HEX));
+
 	pwr_led.mode(StatusLED::ON);
+	LinkTuner::apply();
+	TRACE_LOW(DOOR_BOOT);
+	TRACE_HIGH(DOOR_WIFI);
 	wifi_handler.connect();
+	wifi_started = true;
 	return CONNECTING;
 }
 
@@ -119,8 +184,15 @@ Door::door_state Door::connecting()
 {	
 	switch (wifi_handler.status()) {
 		case WiFiHandler::CONNECTING: return CONNECTING;
-		case WiFiHandler::CONNECTED:  return CONNECTED;
+		case WiFiHandler::CONNECTED:
+			TRACE_LOW(DOOR_WIFI);
+			con_ms = Clock::now();
+			rssi = WiFi.RSSI();
+			trace.assoc_ms = con_ms - trace.boot_ms;
+			ring_sender.setTrace(trace);
+			return CONNECTED;
 		default:
+			TRACE_LOW(DOOR_WIFI);
 			err = NO_WIFI;
 			return ERROR;
 	}
@@ -129,10 +201,63 @@ Door::door_state Door::connecting()
 // Refer to header for documentation
 Door::door_state Door::connected()
 {
+	if (cfg.mesh) {
+		uint16_t seq = ++DoorStore::record().mesh_seq;
+
+		// Bells receiving the ring over both paths drop the duplicate by its press counter
+		ring_sender.setSeq(seq);
+
+		// ESP-NOW runs on the channel of the access point, so the
+		// ring frame can only be sent once connected
+		if (MeshRing::begin(false))
+			MeshRing::send(cfg.ring_msg, seq);
+	}
+
+	if (cfg.sync) {
+		door_record_t &rec = DoorStore::record();
+		uint32_t ips[DOOR_STORE_MAX_BELLS];
+
+		for (uint8_t i = 0; i < rec.n_bells; i++)
+			ips[i] = rec.bells[i].ip;
+
+		SyncClock::query(ips, rec.n_bells, cfg.sync_port);
+		sync_deadline.in(SYNC_QUERY_TIMEOUT_MS);
+		Scheduler::schedule(&sync_task, SYNC_QUERY_TIMEOUT_MS, &on_sync_timeout, this);
+		return SYNCING;
+	}
+
 	ring_sender.send();
 	return RINGING;
 }
 
+// Refer to header for documentation
+Door::door_state Door::syncing()
+{
+	if (SyncClock::synced()) {
+		Scheduler::cancel(&sync_task);
+
+		uint32_t start_at = SyncClock::now() + SYNC_START_MARGIN_MS * 1000;
+		ring_sender.setStartAt(start_at);
+
+		log_msg("Door::syncing", "Ring tone scheduled " + String(SYNC_START_MARGIN_MS) + "ms ahead");
+	} else if (!sync_deadline.expired()) {
+		return SYNCING;
+	} else {
+		log_msg("Door::syncing", "Common time unavailable, ringing unscheduled");
+	}
+
+	ring_sender.send();
+	return RINGING;
+}
+
+// Refer to header for documentation
+void Door::on_sync_timeout(void *arg)
+{
+	// Only scheduled to end the idle period once sync_deadline has
+	// passed, syncing() then gives up on the common time. Running
+	// a task already wakes the loop, so no Scheduler::wake() needed.
+}
+
 // Refer to header for documentation
 Door::door_state Door::ringing()
 {	
@@ -147,16 +272,19 @@ Door::door_state Door::ringing()
 		
 		case RingSender::SUCCESS: {
 			ring_led.mode(StatusLED::OFF);
-			return POWER_OFF;
+			directory.refresh();
+			return REFRESHING;
 		}
 
 		case RingSender::PARTIAL_SUCCESS: {
 			ring_led.mode(StatusLED::OFF);
+			directory.refresh(true);
 			err = PARTIAL_SUCCESS;
 			return ERROR;
 		}
 
 		default: {
+			directory.refresh(true);
 			err = FAIL;
 			return ERROR;
 		}
@@ -174,21 +302,23 @@ Door::door_state Door::error()
 		case CFG_INVALID:
 			log_msg("Door::error", "Invalid configuration provided!");
 			pwr_led.setBlinkInterval(250);
-			pwr_led.mode(StatusLED::BLINK);
+			pwr_led.mode(StatusLED::BLINK, DOOR_CFG_INVALID_BLINKS, &on_error_shown, this);
 			break;
 		case NO_WIFI:
 			log_msg("Door::error", "Failed to establish a WiFi connection!");
-			pwr_led.mode(StatusLED::BLINK_INV);
-			ring_led.mode(StatusLED::BLINK);
+			rf_drift = true;
+			ring_led.mode(StatusLED::BLINK, DOOR_NO_WIFI_BLINKS);
+			pwr_led.mode(StatusLED::BLINK_INV, DOOR_NO_WIFI_BLINKS, &on_error_shown, this);
 			break;
 		case PARTIAL_SUCCESS:
 			log_msg("Door::error", "Partial success, some bells did not ring!");
-			pwr_led.mode(StatusLED::BLINK);
-			ring_led.mode(StatusLED::BLINK);
+			ring_led.mode(StatusLED::BLINK, DOOR_PARTIAL_SUCCESS_BLINKS);
+			pwr_led.mode(StatusLED::BLINK, DOOR_PARTIAL_SUCCESS_BLINKS, &on_error_shown, this);
 			break;
 		case FAIL:
 			log_msg("Door::error", "Failed to contact bells!");
-			pwr_led.mode(StatusLED::BLINK);
+			rf_drift = true;
+			pwr_led.mode(StatusLED::BLINK, DOOR_NO_BELLS_BLINKS, &on_error_shown, this);
 			break;
 	}
 	
@@ -196,45 +326,33 @@ Door::door_state Door::error()
 }
 
 // Refer to header for documentation
-Door::door_state Door::error_handling()
+void Door::on_error_shown(void *arg)
 {
-	switch(err) {
-		case CFG_INVALID: {
-			if (pwr_led.blinks() >= DOOR_CFG_INVALID_BLINKS) {
-				return POWER_OFF;
-			}
-			break;
-		}
+	((Door *)arg)->err_shown = true;
+	Scheduler::wake();
+}
 
-		case NO_WIFI: {
-			if (pwr_led.blinks() >= DOOR_NO_WIFI_BLINKS &&
-			    ring_led.blinks() >= DOOR_NO_WIFI_BLINKS) {
-				return POWER_OFF;
-			}
-			break;
-		}
-		
-		case PARTIAL_SUCCESS: {
-			if (pwr_led.blinks() >= DOOR_PARTIAL_SUCCESS_BLINKS &&
-			    ring_led.blinks() >= DOOR_PARTIAL_SUCCESS_BLINKS) {
-				return POWER_OFF;
-			}
-			break;
-		}
+// Refer to header for documentation
+Door::door_state Door::error_handling()
+{
+	// Both LEDs blink the same number of times, so the
+	// callback of the power LED covers both of them.
+	// Until then, the loop idles while the LEDEngine
+	// drives the LEDs.
+	if (err_shown)
+		return REFRESHING;
 
-		case FAIL: {
-			if (pwr_led.blinks() >= DOOR_NO_BELLS_BLINKS) {
-				return POWER_OFF;
-			}
-			break;
-		}
+	return ERROR_HANDLING;
+}
 
-		default: {
-			break;
-		}
-	}
+// Refer to header for documentation
+Door::door_state Door::refreshing()
+{
+	// The BellDirectory ends the refresh through the Scheduler
+	if (directory.refreshing())
+		return REFRESHING;
 
-	return ERROR_HANDLING;
+	return POWER_OFF;
 }
 
 // Refer to header for documentation
@@ -243,6 +361,39 @@ Door::door_state Door::power_off()
 	log_msg("Door::power_off", "Unlatching power, shutting down...");
 
 	wifi_handler.disconnect();
+
+	RFCal::report(con_ms, rf_drift);
+
+	if (wifi_started) {
+		LinkTuner::link_result link = LinkTuner::LINK_CLEAN;
+
+		// Only judged by the association, as bells that are powered off
+		// fail the ring without saying anything about the link
+		if (con_ms == 0)
+			link = LinkTuner::LINK_NO_WIFI;
+		else if (wifi_handler.retries() > 0)
+			link = LinkTuner::LINK_DEGRADED;
+
+		LinkTuner::report(link, rssi, wifi_handler.retries());
+	}
+
+	ring_sender.learnAcks();
+
+	// The crash has been reported once a bell acknowledged the ring,
+	// a ring merely handed to the TCP stack may still have been lost
+	if (ring_sender.delivered() > 0)
+		DoorStore::record().crash_pending = false;
+
+	if (!DoorStore::save())
+		log_msg("Door::power_off", "Failed to save door record!");
+
+	LoopProfiler::report();
+	sm.report("Door::power_off");
+	EVT(EVT_STATE, POWERED_OFF, 0);
+#ifdef USE_EVENT_TRACE
+	EventTrace::dump(); // The trace is lost with the power
+#endif
+
 	pwr_led.mode(StatusLED::OFF);
 	ring_led.mode(StatusLED::OFF);
 
@@ -253,21 +404,27 @@ Door::door_state Door::power_off()
 // Refer to header for documentation
 void Door::run()
 {
-	switch (state) {
-		case INIT:		state = init(); 		break;
-		case CONNECTING:	state = connecting();		break;
-		case CONNECTED:		state = connected();		break;
-		case RINGING:		state = ringing();		break;
-		case ERROR:		state = error();		break;
-		case ERROR_HANDLING:	state = error_handling();	break;
-		case POWER_OFF:		state = power_off();		break;
-		case POWERED_OFF:					break;
+	LoopProfiler::loopStart(sm.state());
+
+	// Run the asynchronous components that are due first,
+	// so the state machine sees their latest state
+	Scheduler::run();
+
+	prof_mark_t m = LoopProfiler::enter(PROF_MAIN);
+
+	// The main state machine (See states)
+	bool changed = sm.step(this);
+
+	LoopProfiler::leave(m);
+
+	// Run the next state right away rather than idling
+	if (changed) {
+		CrashLog::state(sm.state());
+		EVT(EVT_STATE, sm.state(), 0);
+		Scheduler::wake();
 	}
 
-	wifi_handler.update();
-	ring_sender.update();
-	pwr_led.update();
-	ring_led.update();
+	LoopProfiler::loopEnd();
 }
 
 #endif
\ No newline at end of file
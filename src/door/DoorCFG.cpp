@@ -78,6 +78,16 @@ bool DoorCFG::checkValidity()
 		ret = false;
 	}
 
+	if (discovery_port == 0) {
+		log_msg("DoorCFG::valid", "No discovery port specified in cfg!");
+		ret = false;
+	}
+
+	if (sync && sync_port == 0) {
+		log_msg("DoorCFG::valid", "No sync port specified in cfg!");
+		ret = false;
+	}
+
 	return ret;
 }
 
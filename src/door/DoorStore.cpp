@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file DoorStore.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief DoorStore class implementation
+ * 
+ * The following file contains the implementation of the DoorStore class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#ifdef TARGET_DEV_DOOR
+
+#include <Arduino.h>
+#include <coredecls.h>
+
+extern "C" {
+#include <spi_flash.h>
+}
+
+#include <door/DoorStore.h>
+
+// Start of the EEPROM sector, provided by the linker script
+extern "C" uint32_t _EEPROM_start;
+
+// Refer to header for documentation
+uint32_t DoorStore::sector()
+{
+	return ((uintptr_t)&_EEPROM_start - 0x40200000) / SPI_FLASH_SEC_SIZE;
+}
+
+// Refer to header for documentation
+uint32_t DoorStore::crc()
+{
+	return crc32(&rec, offsetof(door_record_t, crc));
+}
+
+// Refer to header for documentation
+bool DoorStore::load()
+{
+	valid = spi_flash_read(sector() * SPI_FLASH_SEC_SIZE, (uint32_t *)&rec, sizeof(rec)) == SPI_FLASH_RESULT_OK &&
+		rec.magic == DOOR_STORE_MAGIC &&
+		rec.version == DOOR_STORE_VERSION &&
+		rec.crc == crc();
+
+	if (!valid) {
+		memset(&rec, 0, sizeof(rec));
+		rec.magic = DOOR_STORE_MAGIC;
+		rec.version = DOOR_STORE_VERSION;
+	}
+
+	return valid;
+}
+
+// Refer to header for documentation
+bool DoorStore::save()
+{
+	rec.crc = crc();
+
+	if (spi_flash_erase_sector(sector()) != SPI_FLASH_RESULT_OK)
+		return false;
+
+	return spi_flash_write(sector() * SPI_FLASH_SEC_SIZE, (uint32_t *)&rec, sizeof(rec)) == SPI_FLASH_RESULT_OK;
+}
+
+// Refer to header for documentation
+bool DoorStore::loaded()
+{
+	return valid;
+}
+
+// Refer to header for documentation
+door_record_t &DoorStore::record()
+{
+	return rec;
+}
+
+#endif
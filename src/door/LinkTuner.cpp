@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file LinkTuner.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief LinkTuner class implementation
+ * 
+ * The following file contains the implementation of the LinkTuner class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#ifdef TARGET_DEV_DOOR
+
+#include <config.h>
+#include <log.h>
+
+#include <door/DoorStore.h>
+#include <door/LinkTuner.h>
+
+// Ordered from most efficient to most robust
+static const link_level_t levels[] = {
+	{WIFI_PHY_MODE_11N, 8.0},
+	{WIFI_PHY_MODE_11N, 12.0},
+	{WIFI_PHY_MODE_11N, 16.0},
+	{WIFI_PHY_MODE_11N, 20.5},	// SDK default
+	{WIFI_PHY_MODE_11G, 20.5},
+	{WIFI_PHY_MODE_11B, 20.5}
+};
+
+#define N_LEVELS (sizeof(levels) / sizeof(levels[0]))
+#define DEFAULT_LEVEL 3
+
+static const char *phy_names[] = {"?", "11b", "11g", "11n"};
+
+// Refer to header for documentation
+void LinkTuner::apply()
+{
+	door_record_t &rec = DoorStore::record();
+
+	// Start out with the SDK defaults
+	if (!DoorStore::loaded())
+		rec.link_level = DEFAULT_LEVEL;
+
+	if (rec.link_level >= N_LEVELS)
+		rec.link_level = N_LEVELS - 1;
+
+	const link_level_t &l = levels[rec.link_level];
+
+	WiFi.setPhyMode(l.phy);
+	WiFi.setOutputPower(l.dbm);
+
+	log_msg("LinkTuner::apply", "Link level " + String(rec.link_level) + ": " + 
+		phy_names[l.phy] + " at " + String(l.dbm) + "dBm");
+}
+
+// Refer to header for documentation
+void LinkTuner::report(link_result result, int8_t rssi, uint8_t retries)
+{
+	door_record_t &rec = DoorStore::record();
+	uint8_t prev = rec.link_level;
+
+	rec.link_rssi = rssi;
+	rec.link_retries = retries;
+
+	switch (result) {
+		case LINK_CLEAN:
+			if (rec.link_streak < UINT8_MAX)
+				rec.link_streak++;
+
+			if (rec.link_streak >= DOOR_LINK_STEP_DOWN_AFTER &&
+			    rec.link_level > 0 && rssi >= DOOR_LINK_STEP_DOWN_RSSI) {
+				rec.link_level--;
+				rec.link_streak = 0;
+			}
+			break;
+
+		case LINK_DEGRADED:
+			if (rec.link_level < N_LEVELS - 1)
+				rec.link_level++;
+			rec.link_streak = 0;
+			break;
+
+		case LINK_NO_WIFI:
+			rec.link_level = N_LEVELS - 1;
+			rec.link_streak = 0;
+			break;
+	}
+
+	log_msg("LinkTuner::report", "RSSI: " + String(rssi) + "dBm, association retries: " + String(retries) +
+		", link level: " + String(prev) + " -> " + String(rec.link_level));
+}
+
+#endif
@@ -35,16 +35,27 @@
 #include <config.h>
 
 #include <log.h>
+#include <Scheduler.h>
+#include <trace.h>
 
 #include <door/power_latch.h>
+#include <door/RFCal.h>
 #include <door/Door.h>
 
 Door door;
 
+// Called by the SDK before the RF is initialized
+RF_PRE_INIT()
+{
+	RFCal::preInit();
+}
+
 void setup()
 {
 	// Latch power ASAP before capacitor charges to P-MOSES threshold voltage
 	LATCH_POWER();
+	TRACE_INIT();
+	TRACE_HIGH(DOOR_BOOT);
 
 	// Phew, we're safe here, now to the rest of the firmware
 
@@ -66,8 +77,30 @@ void setup()
 	cfg.gateway 		= GATEWAY;
 	cfg.subnet 		= "255.255.255.0";
 	cfg.port 		= TCP_PORT;
+	cfg.discovery_port	= DISCOVERY_PORT;
 	cfg.con_timeout_s 	= DOOR_CONNECT_TIMEOUT_S;
 	cfg.bell_timeout_ms 	= DOOR_BELL_TCP_TIMEOUT_MS;
+	cfg.ring_msg 		= DOOR_RING_MSG;
+
+#ifdef USE_MESH
+	cfg.mesh		= true;
+#endif
+
+#ifdef USE_SYNC
+	cfg.sync		= true;
+	cfg.sync_port		= SYNC_PORT;
+#endif
+
+#ifdef USE_BELL_AP
+	// Join the access point of the primary bell instead,
+	// which relays the ring to all other bells
+	cfg.n_bells		= 1;
+	cfg.ssid		= BELL_AP_SSID;
+	cfg.psk			= BELL_AP_PSK;
+	cfg.wifi_channel	= BELL_AP_CHANNEL;
+	cfg.static_ip		= BELL_AP_DOOR_IP;
+	cfg.gateway		= BELL_AP_IP;
+#endif
 
 	door = Door(cfg);
 }
@@ -75,6 +108,9 @@ void setup()
 void loop()
 {
 	door.run();
+
+	// Sleep until the next component is due
+	Scheduler::idle();
 }
 
 #endif
\ No newline at end of file
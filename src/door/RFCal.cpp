@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TU-DO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ * 
+ */
+
+/**
+ * @file RFCal.cpp
+ * @author Patrick Pedersen
+ * 
+ * @brief RFCal class implementation
+ * 
+ * The following file contains the implementation of the RFCal class.
+ * For more information on the class, see the header file.
+ * 
+ */
+
+#ifdef TARGET_DEV_DOOR
+
+#include <Arduino.h>
+
+extern "C" {
+#include <user_interface.h>
+}
+
+#include <config.h>
+#include <log.h>
+
+#include <door/DoorStore.h>
+#include <door/RFCal.h>
+
+// Refer to header for documentation
+void RFCal::preInit()
+{
+	// Runs before Serial and global constructors, no logging here!
+	bool valid = DoorStore::load();
+	door_record_t &rec = DoorStore::record();
+
+	full = !valid || rec.recal || rec.boots_since_cal >= DOOR_RF_CAL_MAX_BOOTS;
+
+	system_phy_set_powerup_option(full ? RF_CAL_OPTION_FULL : DOOR_RF_CAL_OPTION);
+}
+
+// Refer to header for documentation
+bool RFCal::fullCal()
+{
+	return full;
+}
+
+// Refer to header for documentation
+void RFCal::report(clock_ms_t con_ms, bool drift)
+{
+	door_record_t &rec = DoorStore::record();
+
+	rec.boots_since_cal = full ? 0 : rec.boots_since_cal + 1;
+	rec.recal = drift;
+
+	if (con_ms > 0) {
+		uint16_t *avg = full ? &rec.con_ms_full : &rec.con_ms_reduced;
+
+		// Exponential average, 1/4 weight on the current boot
+		*avg = *avg == 0 ? con_ms : *avg - (*avg >> 2) + (uint16_t)(con_ms >> 2);
+	}
+
+	log_msg("RFCal::report", String(full ? "Full" : "Reduced") + " RF calibration, WiFi connected after " +
+		String((unsigned long)con_ms) + "ms");
+
+	if (rec.con_ms_full > 0 && rec.con_ms_reduced > 0)
+		log_msg("RFCal::report", "Average boot to WiFi: " + String(rec.con_ms_full) + "ms (full), " +
+			String(rec.con_ms_reduced) + "ms (reduced), saving ~" + 
+			String((long)rec.con_ms_full - (long)rec.con_ms_reduced) + "ms per ring");
+
+	if (drift)
+		log_msg("RFCal::report", "RF calibration suspected to be off, forcing a full calibration on next boot");
+}
+
+#endif
@@ -33,6 +33,11 @@
 #include <ESP8266WiFi.h>
 
 #include <log.h>
+#include <Scheduler.h>
+#include <QuantileSketch.h>
+
+#include <door/BellHistory.h>
+#include <door/DoorStore.h>
 #include <door/RingSender.h>
 
 // Refer to header for documentation
@@ -42,19 +47,21 @@ RingSender::RingSender()
 }
 
 // Refer to header for documentation
-RingSender::RingSender(IPAddress door_ip, unsigned int port, uint8_t n_bells, unsigned long timeout_ms)
-: n_bells(n_bells)
+RingSender::RingSender(unsigned long timeout_ms, uint8_t msg)
+: timeout_ms(timeout_ms)
 {
 	log_msg("RingSender::RingSender", "Initializing RingSender");
-	
-	const String door_network_address = String(door_ip[0]) + "." + String(door_ip[1]) + "." + String(door_ip[2]);
-	const uint8_t door_host_id = door_ip[3];
 
+	task.prof = PROF_RING_SENDER;
+
+	door_record_t &rec = DoorStore::record();
+
+	n_bells = rec.n_bells;
 	tx = new RingTX[n_bells];
 
 	for (uint8_t i = 0; i < n_bells; i++) {
-		String dest_ip = door_network_address + "." + String((door_host_id + 1) + i);
-		tx[i] = RingTX(dest_ip, port, timeout_ms);
+		String dest_ip = IPAddress(rec.bells[i].ip).toString();
+		tx[i] = RingTX(dest_ip, rec.bells[i].port, timeout_ms, msg);
 	}
 
 	stat = AWAITING;
@@ -76,6 +83,7 @@ RingSender& RingSender::operator=(const RingSender& other)
 		return *this;
 
 	n_bells = other.n_bells;
+	timeout_ms = other.timeout_ms;
 	stat = other.stat;
 	
 	tx = new RingTX[n_bells];
@@ -96,6 +104,17 @@ uint8_t RingSender::acks() {
 	return ret;
 }
 
+// Refer to header for documentation
+uint8_t RingSender::delivered() {
+	uint8_t ret = 0;
+	for (int i = 0; i < n_bells; i++) {
+		if (tx[i].delivered())
+			ret++;
+	}
+
+	return ret;
+}
+
 // Refer to header for documentation
 uint8_t RingSender::fails() {
 	uint8_t ret = 0;
@@ -117,11 +136,58 @@ void RingSender::send()
 
 	log_msg("RingSender::send", "Sending ring msg to " + String(n_bells) + " bells");
 
+	door_record_t &rec = DoorStore::record();
+
 	for (uint8_t i = 0; i < n_bells; i++) {
-		tx[i].send();
+		unsigned long t = BellHistory::timeout(rec.bells[i].hist, timeout_ms);
+
+		log_msg("RingSender::send", "Bell " + String(i) + " timeout: " + String(t) + "ms");
+
+		tx[i].setTimeout(t);
+		tx[i].send(&task);
 	}
 
 	stat = SENDING;
+	Scheduler::schedule(&task, RING_SENDER_POLL_MS, &on_task, this);
+}
+
+// Refer to header for documentation
+void RingSender::setStartAt(uint32_t start_at)
+{
+	for (uint8_t i = 0; i < n_bells; i++)
+		tx[i].setStartAt(start_at);
+}
+
+// Refer to header for documentation
+void RingSender::addTLV(uint8_t type, const void *val, uint8_t len)
+{
+	for (uint8_t i = 0; i < n_bells; i++)
+		tx[i].addTLV(type, val, len);
+}
+
+// Refer to header for documentation
+void RingSender::setTrace(const ring_trace_t &t)
+{
+	for (uint8_t i = 0; i < n_bells; i++)
+		tx[i].setTrace(t);
+}
+
+// Refer to header for documentation
+void RingSender::setSeq(uint16_t seq)
+{
+	for (uint8_t i = 0; i < n_bells; i++)
+		tx[i].setSeq(seq);
+}
+
+// Refer to header for documentation
+void RingSender::on_task(void *arg)
+{
+	RingSender *s = (RingSender *)arg;
+
+	s->update();
+
+	if (s->stat == SENDING)
+		Scheduler::schedule(&s->task, RING_SENDER_POLL_MS, &on_task, s);
 }
 
 // Refer to header for documentation
@@ -140,6 +206,8 @@ void RingSender::update()
 
 	if (total < n_bells)
 		return;
+
+	learn();
 	
 	if (_fails == n_bells) {
 		log_msg("RingSender::update", 
@@ -157,6 +225,39 @@ void RingSender::update()
 	}
 }
 
+// Refer to header for documentation
+void RingSender::learn()
+{
+	door_record_t &rec = DoorStore::record();
+
+	for (uint8_t i = 0; i < n_bells; i++) {
+		if (tx[i].status() == RingTX::SUCCESS) {
+			log_msg("RingSender::learn", "Bell " + String(i) + " latency: " + 
+				String((unsigned long)tx[i].latency()) + "ms");
+			BellHistory::success(rec.bells[i].hist, tx[i].latency());
+		} else {
+			BellHistory::fail(rec.bells[i].hist);
+		}
+	}
+}
+
+// Refer to header for documentation
+void RingSender::learnAcks()
+{
+	door_record_t &rec = DoorStore::record();
+
+	for (uint8_t i = 0; i < n_bells; i++) {
+		if (tx[i].delivered())
+			QuantileSketch::add(rec.ack_sketch, tx[i].ackLatency());
+	}
+
+	log_msg("RingSender::learnAcks", "Ack latency over " + String(rec.ack_sketch.n) + " rings, p50: " +
+		String(QuantileSketch::quantile(rec.ack_sketch, 500)) + "ms, p95: " +
+		String(QuantileSketch::quantile(rec.ack_sketch, 950)) + "ms, p99: " +
+		String(QuantileSketch::quantile(rec.ack_sketch, 990)) + "ms, max: " +
+		String(rec.ack_sketch.max) + "ms");
+}
+
 // Refer to header for documentation
 RingSender::ring_stat RingSender::status()
 {
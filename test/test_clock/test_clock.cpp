@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file test_clock.cpp
+ * @author Patrick Pedersen
+ *
+ * @brief Host tests of the Clock, Deadline and Scheduler classes
+ *
+ * The Clock is driven by a fake time source, which lets the tests
+ * simulate a year of bell uptime within seconds. Rings are placed
+ * across every point at which a 32-bit millis() would wrap, or turn
+ * negative if taken as signed.
+ *
+ * Run with: pio test -e native
+ *
+ */
+
+#include <unity.h>
+
+#include <Clock.h>
+#include <Scheduler.h>
+
+#define WRAP_MS (1ULL << 31)			// Every second one is a millis() wrap
+#define DAY_MS (24ULL * 60 * 60 * 1000)
+#define YEAR_MS (365 * DAY_MS)
+
+#define HEARTBEAT_MS 30000			// Periodic task, such as the WiFi checks
+#define NOTE_MS 250				// Note length of the simulated ring tone
+#define RING_NOTES 12				// Notes per ring tone
+#define RING_EARLY_MS 1000			// Rings across a wrap start this long before it
+#define RINGS_MAX 512
+
+static uint64_t now_us;
+static uint32_t idle_ms;
+
+static uint64_t fake_time()
+{
+	return now_us;
+}
+
+static void set_ms(clock_ms_t ms)
+{
+	now_us = ms * 1000;
+}
+
+// Captures the time Scheduler::idle() would have slept for
+static void on_idle(uint32_t ms)
+{
+	idle_ms = ms;
+}
+
+/* Simulated bell */
+
+static clock_ms_t ring_at[RINGS_MAX];
+static uint16_t n_rings;
+static uint16_t i_ring;
+
+static sched_task_t door_task;
+static sched_task_t note_task;
+static sched_task_t heartbeat_task;
+
+static clock_ms_t next_note;
+static uint8_t notes;
+static Deadline ring_done;
+
+static uint32_t rings;
+static uint32_t heartbeats;
+static uint32_t misses; // Tasks not run right at their deadline
+
+static void on_note(void *arg)
+{
+	if (Clock::now() != next_note)
+		misses++;
+
+	if (++notes < RING_NOTES) {
+		next_note += NOTE_MS;
+		Scheduler::schedule(&note_task, NOTE_MS, on_note, NULL);
+		return;
+	}
+
+	// The ring tone must end exactly with its deadline
+	if (!ring_done.expired() || ring_done.time() != Clock::now())
+		misses++;
+
+	rings++;
+}
+
+static void on_door(void *arg)
+{
+	if (Clock::now() != ring_at[i_ring])
+		misses++;
+
+	// First note right away, as Buzzer::ring() does
+	notes = 0;
+	next_note = Clock::now();
+	ring_done.in((RING_NOTES - 1) * NOTE_MS);
+	on_note(NULL);
+
+	if (++i_ring < n_rings)
+		Scheduler::schedule(&door_task, ring_at[i_ring] - Clock::now(), on_door, NULL);
+}
+
+static void on_heartbeat(void *arg)
+{
+	if (Clock::now() != (clock_ms_t)(heartbeats + 1) * HEARTBEAT_MS)
+		misses++;
+
+	heartbeats++;
+	Scheduler::schedule(&heartbeat_task, HEARTBEAT_MS, on_heartbeat, NULL);
+}
+
+/**
+ * @brief Adds a ring, unless it would overlap with the previous one
+ */
+static void add_ring(clock_ms_t at)
+{
+	if (n_rings > 0 && at < ring_at[n_rings - 1] + RING_NOTES * NOTE_MS + SCHED_TICK_MS)
+		return;
+
+	TEST_ASSERT_LESS_THAN(RINGS_MAX, n_rings);
+	ring_at[n_rings++] = at;
+}
+
+/* Tests */
+
+void setUp()
+{
+	Clock::source(fake_time);
+	LoopProfiler::onIdle(on_idle);
+}
+
+void tearDown()
+{
+}
+
+/**
+ * @brief Deadlines across the wraps behave as anywhere else
+ */
+void test_deadline_wrap()
+{
+	for (clock_ms_t wrap = WRAP_MS; wrap < YEAR_MS; wrap += WRAP_MS) {
+		Deadline d;
+
+		set_ms(wrap - 500);
+		d.in(1000);
+		TEST_ASSERT_FALSE(d.expired());
+		TEST_ASSERT_EQUAL_UINT64(1000, d.remaining());
+		TEST_ASSERT_EQUAL_UINT64(wrap + 500, d.time());
+
+		set_ms(wrap);
+		TEST_ASSERT_FALSE(d.expired());
+		TEST_ASSERT_EQUAL_UINT64(500, d.remaining());
+
+		set_ms(wrap + 499);
+		TEST_ASSERT_FALSE(d.expired());
+
+		set_ms(wrap + 500);
+		TEST_ASSERT_TRUE(d.expired());
+		TEST_ASSERT_EQUAL_UINT64(0, d.remaining());
+	}
+}
+
+/**
+ * @brief Periodic deadlines don't drift across the wraps, and recover from stalls
+ */
+void test_deadline_advance()
+{
+	for (clock_ms_t wrap = WRAP_MS; wrap < YEAR_MS; wrap += WRAP_MS) {
+		Deadline d;
+
+		set_ms(wrap - 3500);
+		d.in(1000);
+
+		for (clock_ms_t at = wrap - 2500; at < wrap + 3000; at += 1000) {
+			TEST_ASSERT_EQUAL_UINT64(at, d.time());
+			set_ms(at);
+			TEST_ASSERT_TRUE(d.expired());
+			d.advance(1000);
+		}
+
+		// Stalled past a full period
+		set_ms(d.time() + 5000);
+		d.advance(1000);
+		TEST_ASSERT_EQUAL_UINT64(Clock::now() + 1000, d.time());
+	}
+}
+
+/**
+ * @brief Runs the simulated bell for a year
+ *
+ * Instead of waiting, every idle period moves the clock ahead by the
+ * time Scheduler::idle() planned to idle, so all tasks should be run
+ * right at their deadlines.
+ */
+void test_scheduler_year()
+{
+	uint8_t busy = 0;
+
+	// One ring across every wrap, and one ring a day at varying times
+	n_rings = 0;
+	for (clock_ms_t day = 0, wrap = WRAP_MS; day < 365; day++) {
+		clock_ms_t at = day * DAY_MS + ((day * 7) % 24) * 60 * 60 * 1000 + day * 1009;
+
+		if (wrap - RING_EARLY_MS < at) {
+			add_ring(wrap - RING_EARLY_MS);
+			wrap += WRAP_MS;
+		}
+
+		if (at > 0)
+			add_ring(at);
+	}
+
+	set_ms(0);
+	Scheduler::schedule(&heartbeat_task, HEARTBEAT_MS, on_heartbeat, NULL);
+	Scheduler::schedule(&door_task, ring_at[0], on_door, NULL);
+
+	while (now_us <= YEAR_MS * 1000) {
+		Scheduler::run();
+
+		idle_ms = 0;
+		Scheduler::idle();
+
+		// idle() only returns early if a task is due, which the next run() must pick up
+		if (idle_ms == 0) {
+			TEST_ASSERT_LESS_THAN_MESSAGE(2, ++busy, "Due task not run");
+			continue;
+		}
+
+		busy = 0;
+		now_us += (uint64_t)idle_ms * 1000;
+	}
+
+	Scheduler::cancel(&heartbeat_task);
+	Scheduler::cancel(&door_task);
+	Scheduler::cancel(&note_task);
+
+	TEST_ASSERT_EQUAL_UINT32(0, misses);
+	TEST_ASSERT_EQUAL_UINT32(n_rings, rings);
+	TEST_ASSERT_EQUAL_UINT32(YEAR_MS / HEARTBEAT_MS, heartbeats);
+	TEST_ASSERT_EQUAL_UINT32(0, Scheduler::latencyMax());
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_deadline_wrap);
+	RUN_TEST(test_deadline_advance);
+	RUN_TEST(test_scheduler_year);
+	return UNITY_END();
+}
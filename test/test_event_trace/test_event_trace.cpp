@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file test_event_trace.cpp
+ * @author Patrick Pedersen
+ *
+ * @brief Host tests of the EventTrace class
+ *
+ * Checks the dump format read by tools/evtrace2chrome.py, as well as
+ * the ring buffer once it overflows. Events are timestamped through
+ * a fake time source.
+ *
+ * Run with: pio test -e native
+ *
+ */
+
+#include <stdio.h>
+
+#include <unity.h>
+
+#include <Clock.h>
+#include <EventTrace.h>
+
+#define N_STATES 2
+
+static uint64_t now_us;
+static char buf[64];
+static char expected[64];
+
+static uint64_t fake_time()
+{
+	return now_us;
+}
+
+static const char *state_name(uint8_t s, void *arg)
+{
+	static const char *names[N_STATES] = { "IDLE", "BUSY" };
+	return names[s];
+}
+
+/**
+ * @brief Returns the number of events in the trace
+ */
+static uint16_t n_events()
+{
+	return EventTrace::lines() - 1 - N_STATES - 1;
+}
+
+/**
+ * @brief Asserts a line of the dump
+ */
+static void assert_line(uint16_t i, const char *line)
+{
+	EventTrace::line(i, buf, sizeof(buf));
+	TEST_ASSERT_EQUAL_STRING(line, buf);
+}
+
+/* Tests */
+
+void setUp()
+{
+	Clock::source(fake_time);
+	EventTrace::begin("test", N_STATES, state_name, NULL);
+}
+
+void tearDown()
+{
+}
+
+/**
+ * @brief The dump lists the device, its states and the events oldest first
+ */
+void test_dump_format()
+{
+	now_us = 1000;
+	EVT(EVT_STATE, 1, 0);
+	now_us = 1500;
+	EVT(EVT_RX, 2, 9);
+
+	TEST_ASSERT_EQUAL_UINT16(2, n_events());
+	assert_line(0, "EVT_BEGIN,test,2,0\n");
+	assert_line(1, "EVT_STATE,0,IDLE\n");
+	assert_line(2, "EVT_STATE,1,BUSY\n");
+	assert_line(3, "EVT,1000,0,1,0\n");
+	assert_line(4, "EVT,1500,6,2,9\n");
+	assert_line(5, "EVT_END\n");
+}
+
+/**
+ * @brief Nothing is recorded while the trace is held
+ */
+void test_hold()
+{
+	uint16_t n = n_events();
+
+	EventTrace::hold(true);
+	EVT(EVT_NOTE, 0, 440);
+	TEST_ASSERT_EQUAL_UINT16(n, n_events());
+
+	EventTrace::hold(false);
+	EVT(EVT_NOTE, 0, 440);
+	TEST_ASSERT_EQUAL_UINT16(n + 1, n_events());
+}
+
+/**
+ * @brief Once full, the oldest events are overwritten and counted as lost
+ */
+void test_overwrite()
+{
+	uint16_t before = n_events();
+
+	for (uint16_t i = 0; i < EVENT_TRACE_LEN + 5; i++) {
+		now_us = 10000 + i;
+		EVT(EVT_NOTE, i & 0xFF, i);
+	}
+
+	TEST_ASSERT_EQUAL_UINT16(EVENT_TRACE_LEN, n_events());
+
+	snprintf(expected, sizeof(expected), "EVT_BEGIN,test,%u,%u\n", EVENT_TRACE_LEN, before + 5);
+	assert_line(0, expected);
+
+	// Oldest and latest event
+	assert_line(1 + N_STATES, "EVT,10005,8,5,5\n");
+	snprintf(expected, sizeof(expected), "EVT,%u,8,%u,%u\n", 10000 + EVENT_TRACE_LEN + 4,
+		 (EVENT_TRACE_LEN + 4) & 0xFF, EVENT_TRACE_LEN + 4);
+	assert_line(N_STATES + EVENT_TRACE_LEN, expected);
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_dump_format);
+	RUN_TEST(test_hold);
+	RUN_TEST(test_overwrite);
+	return UNITY_END();
+}
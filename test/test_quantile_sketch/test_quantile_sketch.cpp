@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file test_quantile_sketch.cpp
+ * @author Patrick Pedersen
+ *
+ * @brief Host tests of the QuantileSketch class
+ *
+ * Checks the estimated quantiles against the error bound of the
+ * buckets, that outliers survive the halving of saturated buckets,
+ * and that merged sketches combine both streams.
+ *
+ * Run with: pio test -e native
+ *
+ */
+
+#include <unity.h>
+
+#include <QuantileSketch.h>
+
+#define FAST_MS 10		// Typical latency
+#define SLOW_MS 1000		// Outlier latency
+#define ERR(v) ((v) / SKETCH_SUB / 2) // Error bound of the bucket midpoint
+
+static quantile_sketch_t a;
+static quantile_sketch_t b;
+
+/**
+ * @brief Adds a value to a sketch n times
+ */
+static void add_n(quantile_sketch_t &s, uint32_t v, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++)
+		QuantileSketch::add(s, v);
+}
+
+/* Tests */
+
+void setUp()
+{
+	QuantileSketch::reset(a);
+	QuantileSketch::reset(b);
+}
+
+void tearDown()
+{
+}
+
+/**
+ * @brief Quantiles fall within the error bound, the tail is capped to the largest value
+ */
+void test_quantile()
+{
+	TEST_ASSERT_EQUAL_UINT32(0, QuantileSketch::quantile(a, 500));
+
+	add_n(a, FAST_MS, 99);
+	add_n(a, SLOW_MS, 1);
+
+	TEST_ASSERT_EQUAL_UINT32(100, a.n);
+	TEST_ASSERT_EQUAL_UINT32(SLOW_MS, a.max);
+	TEST_ASSERT_UINT32_WITHIN(ERR(FAST_MS), FAST_MS, QuantileSketch::quantile(a, 500));
+	TEST_ASSERT_UINT32_WITHIN(ERR(FAST_MS), FAST_MS, QuantileSketch::quantile(a, 990));
+	TEST_ASSERT_UINT32_WITHIN(ERR(SLOW_MS), SLOW_MS, QuantileSketch::quantile(a, 1000));
+	TEST_ASSERT_TRUE(QuantileSketch::quantile(a, 1000) <= SLOW_MS);
+}
+
+/**
+ * @brief A saturated bucket halves the sketch, without dropping the outlier
+ */
+void test_halve()
+{
+	add_n(a, SLOW_MS, 1);
+	add_n(a, FAST_MS, UINT16_MAX + 1);
+
+	TEST_ASSERT_EQUAL_UINT32(UINT16_MAX + 2, a.n);
+	TEST_ASSERT_UINT32_WITHIN(ERR(FAST_MS), FAST_MS, QuantileSketch::quantile(a, 999));
+	TEST_ASSERT_UINT32_WITHIN(ERR(SLOW_MS), SLOW_MS, QuantileSketch::quantile(a, 1000));
+}
+
+/**
+ * @brief Merged sketches hold the values of both streams
+ */
+void test_merge()
+{
+	add_n(a, FAST_MS, 90);
+	add_n(b, SLOW_MS, 10);
+
+	QuantileSketch::merge(a, b);
+
+	TEST_ASSERT_EQUAL_UINT32(100, a.n);
+	TEST_ASSERT_EQUAL_UINT32(SLOW_MS, a.max);
+	TEST_ASSERT_UINT32_WITHIN(ERR(FAST_MS), FAST_MS, QuantileSketch::quantile(a, 900));
+	TEST_ASSERT_UINT32_WITHIN(ERR(SLOW_MS), SLOW_MS, QuantileSketch::quantile(a, 950));
+
+	// The source is left untouched
+	TEST_ASSERT_EQUAL_UINT32(10, b.n);
+	TEST_ASSERT_UINT32_WITHIN(ERR(SLOW_MS), SLOW_MS, QuantileSketch::quantile(b, 500));
+}
+
+/**
+ * @brief Merged buckets saturate instead of wrapping around
+ */
+void test_merge_saturate()
+{
+	add_n(a, FAST_MS, UINT16_MAX);
+	add_n(b, FAST_MS, 2);
+	add_n(b, SLOW_MS, 1);
+
+	QuantileSketch::merge(a, b);
+
+	TEST_ASSERT_EQUAL_UINT32(UINT16_MAX + 3, a.n);
+	TEST_ASSERT_UINT32_WITHIN(ERR(FAST_MS), FAST_MS, QuantileSketch::quantile(a, 999));
+	TEST_ASSERT_UINT32_WITHIN(ERR(SLOW_MS), SLOW_MS, QuantileSketch::quantile(a, 1000));
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_quantile);
+	RUN_TEST(test_halve);
+	RUN_TEST(test_merge);
+	RUN_TEST(test_merge_saturate);
+	return UNITY_END();
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/**
+ * @file test_trace.cpp
+ * @author Patrick Pedersen
+ *
+ * @brief Host tests of the trace points
+ *
+ * On host builds, the trace points are recorded into the EventTrace.
+ * Walks the trace points of the bell along a ring, and checks that
+ * the mapped points have been recorded in order, while unmapped
+ * points are compiled out.
+ *
+ * Run with: pio test -e native
+ *
+ */
+
+#include <unity.h>
+
+#include <Clock.h>
+#include <EventTrace.h>
+
+// Included ahead of USE_TRACE, so the pins of the device builds aren't mapped
+#include <config.h>
+
+#define USE_TRACE
+#define TRACE_PIN_RING_RX 1
+#define TRACE_PIN_BELL_RING 2
+#define TRACE_PIN_BUZZER_NOTE 2 // Shares the pin with BELL_RING
+#include <trace.h>
+
+static uint64_t now_us;
+static char buf[64];
+
+static uint64_t fake_time()
+{
+	return now_us;
+}
+
+static const char *state_name(uint8_t s, void *arg)
+{
+	return "IDLE";
+}
+
+/**
+ * @brief Returns the number of events in the trace
+ */
+static uint16_t n_events()
+{
+	return EventTrace::lines() - 1 - 1 - 1;
+}
+
+/**
+ * @brief Asserts an event of the dump, oldest first
+ */
+static void assert_event(uint16_t i, const char *line)
+{
+	EventTrace::line(2 + i, buf, sizeof(buf));
+	TEST_ASSERT_EQUAL_STRING(line, buf);
+}
+
+/* Tests */
+
+void setUp()
+{
+	now_us = 0;
+	Clock::source(fake_time);
+	EventTrace::begin("test", 1, state_name, NULL);
+}
+
+void tearDown()
+{
+}
+
+/**
+ * @brief Trace points of a ring are recorded in order, with their level
+ */
+void test_ring_order()
+{
+	uint16_t n = n_events();
+
+	TRACE_INIT();
+
+	now_us = 100;
+	TRACE_HIGH(RING_RX);
+	now_us = 150;
+	TRACE_LOW(RING_RX);
+	now_us = 200;
+	TRACE_HIGH(BELL_RING);
+	now_us = 250;
+	TRACE_PULSE(BUZZER_NOTE);
+	now_us = 900;
+	TRACE_LOW(BELL_RING);
+
+	TEST_ASSERT_EQUAL_UINT16(n + 6, n_events());
+	assert_event(n + 0, "EVT,100,10,3,1\n");
+	assert_event(n + 1, "EVT,150,10,3,0\n");
+	assert_event(n + 2, "EVT,200,10,4,1\n");
+	assert_event(n + 3, "EVT,250,10,5,1\n");
+	assert_event(n + 4, "EVT,250,10,5,0\n");
+	assert_event(n + 5, "EVT,900,10,4,0\n");
+}
+
+/**
+ * @brief Unmapped trace points aren't recorded
+ */
+void test_unmapped()
+{
+	uint16_t n = n_events();
+
+	TRACE_HIGH(DOOR_BOOT);
+	TRACE_LOW(DOOR_WIFI);
+	TRACE_PULSE(RING_TX);
+
+	TEST_ASSERT_EQUAL_UINT16(n, n_events());
+}
+
+int main(int argc, char **argv)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_ring_order);
+	RUN_TEST(test_unmapped);
+	return UNITY_END();
+}
@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2022 Patrick Pedersen, TUDO Makerspace
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""
+Converts event trace dumps (See include/common/EventTrace.h) into a Chrome
+trace, which can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+
+Dumps are read from serial logs of the door, or from the /trace response of
+bells, for example:
+
+	curl http://192.168.0.21:9100/trace > bell.log
+	./evtrace2chrome.py door.log bell.log > trace.json
+
+Every dump is shown as a process of its own. As the devices don't share a
+clock, the dumps of doors are aligned to the first bell dump by matching
+their ring messages (EVT_SENT) with the received ones (EVT_RX) in order,
+which neglects the network latency. Use --no-align to keep the raw clocks,
+or --offset to shift a dump by hand.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+# Must match evt_type in EventTrace.h
+EVT_STATE, EVT_CONNECT, EVT_CONNECTED, EVT_SENT, EVT_ACK, EVT_TX_FAIL, \
+	EVT_RX, EVT_RX_INVALID, EVT_NOTE, EVT_LED, EVT_TRACE = range(11)
+
+# Must match trace_point in trace.h
+TRACE_POINTS = ["door_boot", "door_wifi", "ring_tx", "ring_rx", "bell_ring", "buzzer_note"]
+
+US_WRAP = 1 << 32 # micros() wraps after ~71 minutes
+
+LINE_RE = re.compile(r'(EVT_BEGIN|EVT_STATE|EVT_END|EVT),?([^\r\n]*)')
+
+TID_STATE = 0
+TID_RX = 1
+TID_BUZZER = 2
+TID_TX = 10 # + host ID
+
+class Dump:
+	def __init__(self, src, device, lost):
+		self.src = src
+		self.device = device
+		self.lost = lost
+		self.states = {}
+		self.events = [] # (us, type, a, b)
+		self.offset = 0
+
+	def name(self, i):
+		return "%s (%s #%d)" % (self.device, self.src, i)
+
+def parse(path):
+	dumps = []
+	cur = None
+	base = 0
+	last = None
+
+	with open(path, errors="replace") as f:
+		for line in f:
+			m = LINE_RE.search(line)
+			if m is None:
+				continue
+
+			kind, fields = m.group(1), m.group(2).split(",")
+
+			if kind == "EVT_BEGIN":
+				cur = Dump(path, fields[0], int(fields[2]) if len(fields) > 2 else 0)
+				base = 0
+				last = None
+			elif cur is None:
+				continue
+			elif kind == "EVT_STATE":
+				cur.states[int(fields[0])] = fields[1]
+			elif kind == "EVT":
+				us, typ, a, b = (int(x) for x in fields[:4])
+
+				# Unwrap micros()
+				if last is not None and us < last:
+					base += US_WRAP
+				last = us
+
+				cur.events.append((us + base, typ, a, b))
+			elif kind == "EVT_END":
+				dumps.append(cur)
+				cur = None
+
+	if cur is not None:
+		print("%s: incomplete dump, using what was received" % path, file=sys.stderr)
+		dumps.append(cur)
+
+	return dumps
+
+def align(dumps):
+	bells = [d for d in dumps if d.device != "door"]
+	if not bells:
+		return
+
+	rx = [e[0] for e in bells[0].events if e[1] == EVT_RX]
+	i_rx = 0
+
+	for d in dumps:
+		if d.device != "door":
+			continue
+
+		sent = [e[0] for e in d.events if e[1] == EVT_SENT]
+		if not sent or i_rx >= len(rx):
+			print("%s: no ring message to align the door with" % d.src, file=sys.stderr)
+			continue
+
+		d.offset = rx[i_rx] - sent[0]
+		i_rx += 1
+
+def thread(out, pid, tid, name):
+	out.append({"ph": "M", "name": "thread_name", "pid": pid, "tid": tid, "args": {"name": name}})
+
+def span(out, pid, tid, name, start, end, args=None):
+	out.append({"ph": "X", "name": name, "pid": pid, "tid": tid, "ts": start, "dur": max(end - start, 0),
+		    "args": args or {}})
+
+def instant(out, pid, tid, name, ts, args=None):
+	out.append({"ph": "i", "s": "t", "name": name, "pid": pid, "tid": tid, "ts": ts, "args": args or {}})
+
+def convert(dump, pid, origin):
+	out = []
+	ev = [(us + dump.offset - origin, typ, a, b) for us, typ, a, b in dump.events]
+
+	out.append({"ph": "M", "name": "process_name", "pid": pid, "args": {"name": dump.name(pid)}})
+	thread(out, pid, TID_STATE, "state")
+
+	if dump.lost:
+		instant(out, pid, TID_STATE, "%d events lost" % dump.lost, ev[0][0] if ev else 0)
+
+	end = ev[-1][0] if ev else 0
+	state = None
+	tx = {}
+	note = None
+	gpio = 0
+
+	for ts, typ, a, b in ev:
+		if typ == EVT_STATE:
+			if state is not None:
+				span(out, pid, TID_STATE, dump.states.get(state[0], str(state[0])), state[1], ts)
+			state = (a, ts)
+
+		elif typ in (EVT_CONNECT, EVT_CONNECTED, EVT_SENT, EVT_ACK, EVT_TX_FAIL):
+			tid = TID_TX + a
+			if a not in tx:
+				thread(out, pid, tid, "ring tx .%d" % a)
+				tx[a] = None
+
+			if typ == EVT_CONNECT:
+				tx[a] = ("connect", ts)
+			elif typ == EVT_CONNECTED and tx[a] is not None:
+				span(out, pid, tid, tx[a][0], tx[a][1], ts)
+				tx[a] = ("send", ts)
+			elif typ == EVT_SENT and tx[a] is not None:
+				span(out, pid, tid, tx[a][0], tx[a][1], ts, {"msg": b})
+				tx[a] = None
+			elif typ == EVT_ACK:
+				instant(out, pid, tid, "ack", ts, {"bytes": b})
+			elif typ == EVT_TX_FAIL:
+				if tx[a] is not None:
+					span(out, pid, tid, tx[a][0], tx[a][1], ts)
+				instant(out, pid, tid, "fail", ts)
+				tx[a] = None
+
+		elif typ == EVT_RX:
+			instant(out, pid, TID_RX, "rx", ts, {"class": a, "len": b})
+		elif typ == EVT_RX_INVALID:
+			instant(out, pid, TID_RX, "rx invalid", ts, {"len": b})
+
+		elif typ == EVT_NOTE:
+			if note is not None:
+				span(out, pid, TID_BUZZER, note[0], note[1], ts)
+			note = None
+			if a == 0xFF:
+				note = ("sample", ts)
+			elif b != 0:
+				note = ("note %d (%d Hz)" % (a, b), ts)
+
+		elif typ == EVT_LED:
+			gpio = gpio | b if a else gpio & ~b
+			out.append({"ph": "C", "name": "gpio", "pid": pid, "ts": ts,
+				    "args": {"gpio%d" % i: (gpio >> i) & 1 for i in range(16) if (b >> i) & 1}})
+
+		elif typ == EVT_TRACE:
+			name = TRACE_POINTS[a] if a < len(TRACE_POINTS) else str(a)
+			out.append({"ph": "C", "name": "trace", "pid": pid, "ts": ts, "args": {name: b}})
+
+	# Close what is still open at the end of the dump
+	if state is not None:
+		span(out, pid, TID_STATE, dump.states.get(state[0], str(state[0])), state[1], end)
+	if note is not None:
+		span(out, pid, TID_BUZZER, note[0], note[1], end)
+
+	if any(e[1] in (EVT_RX, EVT_RX_INVALID) for e in ev):
+		thread(out, pid, TID_RX, "ring rx")
+	if any(e[1] == EVT_NOTE for e in ev):
+		thread(out, pid, TID_BUZZER, "buzzer")
+
+	return out
+
+def main():
+	ap = argparse.ArgumentParser(description="Converts event trace dumps into a Chrome trace")
+	ap.add_argument("logs", nargs="+", help="Serial logs or /trace responses")
+	ap.add_argument("--no-align", action="store_true", help="Don't align the doors to the bells")
+	ap.add_argument("--offset", action="append", default=[], metavar="N=US",
+			help="Shifts the N-th dump (from 1, in order of the logs) by US microseconds")
+	ap.add_argument("-o", "--output", help="Output file (default: stdout)")
+	args = ap.parse_args()
+
+	dumps = []
+	for path in args.logs:
+		dumps += parse(path)
+
+	if not dumps:
+		sys.exit("No event trace dumps found")
+
+	if not args.no_align:
+		align(dumps)
+
+	for o in args.offset:
+		n, us = o.split("=")
+		dumps[int(n) - 1].offset += int(us)
+
+	origin = min((d.events[0][0] + d.offset for d in dumps if d.events), default=0)
+
+	events = []
+	for pid, d in enumerate(dumps, 1):
+		events += convert(d, pid, origin)
+
+	out = open(args.output, "w") if args.output else sys.stdout
+	json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, out)
+
+if __name__ == "__main__":
+	main()